@@ -0,0 +1,269 @@
+#include "ATrousDenoiser.h"
+
+#include "GBuffer.h"
+#include "ThreadPool.h"
+
+#include <emmintrin.h>
+#include <algorithm>
+#include <cfloat>
+#include <future>
+
+namespace {
+    const int BAND_ROWS = 16;
+    const float LOG2E = 1.44269504f;
+    const float MIN_WEIGHT = 0.001f; // below this the centre is kept as it is
+    const float MIN_ALBEDO = 0.001f; // emitters and black surfaces are not demodulated
+
+    // B3-spline taps; the 5x5 kernel is their outer product (1 4 6 4 1 / 16 squared)
+    const float KERNEL[5] = { 1.0f / 16, 4.0f / 16, 6.0f / 16, 4.0f / 16, 1.0f / 16 };
+
+    struct Pass {
+        const float* src[3];
+        float* dst[3];
+        const float* normal[3];
+        const float* depth;
+        int width;
+        int height;
+        int step;
+        float colorScale;  // log2(e) / (2 sigma_c^2)
+        float depthScale;  // log2(e) / (2 sigma_d^2)
+        float normalPower;
+    };
+
+    // 2^x, about 1e-4 relative: good enough for filter weights
+    inline __m128 exp2_ps(__m128 x) {
+        x = _mm_max_ps(x, _mm_set1_ps(-126.0f));
+        __m128 fi = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+        fi = _mm_sub_ps(fi, _mm_and_ps(_mm_cmpgt_ps(fi, x), _mm_set1_ps(1.0f))); // floor
+        __m128 f = _mm_sub_ps(x, fi);
+        __m128 p = _mm_add_ps(_mm_mul_ps(f, _mm_set1_ps(0.00133336f)), _mm_set1_ps(0.00961813f));
+        p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(0.0555041f));
+        p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(0.240227f));
+        p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(0.693147f));
+        p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(1.0f));
+        __m128i e = _mm_slli_epi32(_mm_add_epi32(_mm_cvttps_epi32(fi), _mm_set1_epi32(127)), 23);
+        return _mm_mul_ps(p, _mm_castsi128_ps(e));
+    }
+
+    // log2(x) for normal positive x
+    inline __m128 log2_ps(__m128 x) {
+        __m128i bits = _mm_castps_si128(x);
+        __m128 e = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127)));
+        __m128 m = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x007fffff)), _mm_set1_epi32(0x3f800000)));
+        // log2(m) = 2 atanh(t) / ln 2 with t = (m - 1) / (m + 1) in [0, 1/3)
+        __m128 one = _mm_set1_ps(1.0f);
+        __m128 t = _mm_div_ps(_mm_sub_ps(m, one), _mm_add_ps(m, one));
+        __m128 t2 = _mm_mul_ps(t, t);
+        __m128 s = _mm_add_ps(_mm_mul_ps(t2, _mm_set1_ps(1.0f / 7)), _mm_set1_ps(1.0f / 5));
+        s = _mm_add_ps(_mm_mul_ps(s, t2), _mm_set1_ps(1.0f / 3));
+        s = _mm_add_ps(_mm_mul_ps(s, t2), one);
+        return _mm_add_ps(e, _mm_mul_ps(_mm_mul_ps(s, t), _mm_set1_ps(2.0f * LOG2E)));
+    }
+
+    inline __m128 finite_ps(__m128 x) {
+        __m128 abs = _mm_and_ps(x, _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff)));
+        return _mm_cmple_ps(abs, _mm_set1_ps(FLT_MAX));
+    }
+
+    inline bool finite(float x) {
+        return fabsf(x) <= FLT_MAX;
+    }
+
+    // one pixel, for the borders where a tap row would leave the image part way
+    void filter_pixel(const Pass& p, int x, int y) {
+        size_t c = size_t(p.width) * y + x;
+        float cc[3] = { p.src[0][c], p.src[1][c], p.src[2][c] };
+        float cd = p.depth[c];
+        if ( cd <= 0 || !finite(cc[0]) || !finite(cc[1]) || !finite(cc[2]) ) {
+            for ( int k = 0; k < 3; ++k ) p.dst[k][c] = cc[k];
+            return;
+        }
+
+        float sum[3] = { 0, 0, 0 };
+        float total = 0;
+        for ( int ky = -2; ky <= 2; ++ky ) {
+            int sy = y + ky * p.step;
+            if ( sy < 0 || sy >= p.height ) continue;
+            for ( int kx = -2; kx <= 2; ++kx ) {
+                int sx = x + kx * p.step;
+                if ( sx < 0 || sx >= p.width ) continue;
+                size_t s = size_t(p.width) * sy + sx;
+                float sc[3] = { p.src[0][s], p.src[1][s], p.src[2][s] };
+                float sd = p.depth[s];
+                float cosine = p.normal[0][c] * p.normal[0][s] + p.normal[1][c] * p.normal[1][s] + p.normal[2][c] * p.normal[2][s];
+                if ( sd <= 0 || cosine <= 0 || !finite(sc[0]) || !finite(sc[1]) || !finite(sc[2]) ) continue;
+
+                float dc = pow2(cc[0] - sc[0]) + pow2(cc[1] - sc[1]) + pow2(cc[2] - sc[2]);
+                float dd = pow2(( cd - sd ) / cd);
+                float w = KERNEL[ky + 2] * KERNEL[kx + 2] *
+                    exp2f(p.normalPower * log2f(cosine) - dc * p.colorScale - dd * p.depthScale);
+                for ( int k = 0; k < 3; ++k ) sum[k] += w * sc[k];
+                total += w;
+            }
+        }
+        for ( int k = 0; k < 3; ++k ) {
+            p.dst[k][c] = total > MIN_WEIGHT ? sum[k] / total : cc[k];
+        }
+    }
+
+    // pixels x..x+3, all of whose taps are inside the row
+    void filter_quad(const Pass& p, int x, int y) {
+        size_t c = size_t(p.width) * y + x;
+        __m128 cc[3], cn[3];
+        for ( int k = 0; k < 3; ++k ) {
+            cc[k] = _mm_loadu_ps(p.src[k] + c);
+            cn[k] = _mm_loadu_ps(p.normal[k] + c);
+        }
+        __m128 zero = _mm_setzero_ps();
+        __m128 cd = _mm_loadu_ps(p.depth + c);
+        __m128 valid = _mm_and_ps(_mm_cmpgt_ps(cd, zero),
+            _mm_and_ps(finite_ps(cc[0]), _mm_and_ps(finite_ps(cc[1]), finite_ps(cc[2]))));
+        if ( _mm_movemask_ps(valid) == 0 ) {
+            for ( int k = 0; k < 3; ++k ) _mm_storeu_ps(p.dst[k] + c, cc[k]);
+            return;
+        }
+        __m128 invDepth = _mm_div_ps(_mm_set1_ps(1.0f), _mm_max_ps(cd, _mm_set1_ps(FLT_MIN)));
+        __m128 colorScale = _mm_set1_ps(p.colorScale);
+        __m128 depthScale = _mm_set1_ps(p.depthScale);
+        __m128 normalPower = _mm_set1_ps(p.normalPower);
+        __m128 minCosine = _mm_set1_ps(FLT_MIN);
+
+        __m128 sum[3] = { zero, zero, zero };
+        __m128 total = zero;
+        for ( int ky = -2; ky <= 2; ++ky ) {
+            int sy = y + ky * p.step;
+            if ( sy < 0 || sy >= p.height ) continue;
+            for ( int kx = -2; kx <= 2; ++kx ) {
+                size_t s = size_t(p.width) * sy + x + kx * p.step;
+                __m128 sc[3], cosine = zero, dc = zero;
+                for ( int k = 0; k < 3; ++k ) {
+                    sc[k] = _mm_loadu_ps(p.src[k] + s);
+                    cosine = _mm_add_ps(cosine, _mm_mul_ps(cn[k], _mm_loadu_ps(p.normal[k] + s)));
+                    __m128 d = _mm_sub_ps(cc[k], sc[k]);
+                    dc = _mm_add_ps(dc, _mm_mul_ps(d, d));
+                }
+                __m128 sd = _mm_loadu_ps(p.depth + s);
+                __m128 use = _mm_and_ps(_mm_and_ps(_mm_cmpgt_ps(sd, zero), _mm_cmpgt_ps(cosine, zero)),
+                    _mm_and_ps(finite_ps(sc[0]), _mm_and_ps(finite_ps(sc[1]), finite_ps(sc[2]))));
+                if ( _mm_movemask_ps(use) == 0 ) continue;
+
+                __m128 dd = _mm_mul_ps(_mm_sub_ps(cd, sd), invDepth);
+                __m128 e = _mm_mul_ps(normalPower, log2_ps(_mm_max_ps(cosine, minCosine)));
+                e = _mm_sub_ps(e, _mm_add_ps(_mm_mul_ps(dc, colorScale), _mm_mul_ps(_mm_mul_ps(dd, dd), depthScale)));
+                __m128 w = _mm_mul_ps(exp2_ps(e), _mm_set1_ps(KERNEL[ky + 2] * KERNEL[kx + 2]));
+                w = _mm_and_ps(use, w);
+                for ( int k = 0; k < 3; ++k ) {
+                    sum[k] = _mm_add_ps(sum[k], _mm_mul_ps(w, _mm_and_ps(use, sc[k])));
+                }
+                total = _mm_add_ps(total, w);
+            }
+        }
+        __m128 keep = _mm_andnot_ps(_mm_and_ps(valid, _mm_cmpgt_ps(total, _mm_set1_ps(MIN_WEIGHT))), _mm_castsi128_ps(_mm_set1_epi32(-1)));
+        __m128 inv = _mm_div_ps(_mm_set1_ps(1.0f), _mm_max_ps(total, _mm_set1_ps(MIN_WEIGHT)));
+        for ( int k = 0; k < 3; ++k ) {
+            __m128 v = _mm_mul_ps(sum[k], inv);
+            _mm_storeu_ps(p.dst[k] + c, _mm_or_ps(_mm_and_ps(keep, cc[k]), _mm_andnot_ps(keep, v)));
+        }
+    }
+
+    void filter_rows(const Pass& p, int y0, int y1) {
+        int reach = 2 * p.step;
+        for ( int y = y0; y < y1; ++y ) {
+            int x = 0;
+            for ( ; x < std::min(reach, p.width); ++x ) {
+                filter_pixel(p, x, y);
+            }
+            for ( ; x + 3 + reach < p.width; x += 4 ) {
+                filter_quad(p, x, y);
+            }
+            for ( ; x < p.width; ++x ) {
+                filter_pixel(p, x, y);
+            }
+        }
+    }
+
+    float demodulation(float albedo) {
+        return albedo > MIN_ALBEDO ? albedo : 1.0f;
+    }
+}
+
+ATrousDenoiser::ATrousDenoiser(const Settings& settings)
+    : m_settings(settings) {
+}
+
+ATrousDenoiser::~ATrousDenoiser() {
+}
+
+ThreadPool& ATrousDenoiser::pool() {
+    if ( !m_pool ) {
+        m_pool = std::make_unique<ThreadPool>();
+    }
+    return *m_pool;
+}
+
+void ATrousDenoiser::for_bands(int height, const std::function<void(int, int)>& rows) {
+    if ( height <= BAND_ROWS ) {
+        rows(0, height);
+        return;
+    }
+    ThreadPool& threads = pool();
+    std::vector< std::future<void> > bands;
+    for ( int y = 0; y < height; y += BAND_ROWS ) {
+        int y1 = std::min(y + BAND_ROWS, height);
+        bands.push_back(threads.enqueue([&rows, y, y1] { rows(y, y1); }));
+    }
+    for ( auto& b : bands ) {
+        b.get();
+    }
+}
+
+void ATrousDenoiser::run(float* rgb, const GBuffer& gbuffer) {
+    if ( m_settings.iterations <= 0 ) return;
+    int width = gbuffer.width();
+    int height = gbuffer.height();
+    size_t n = size_t(width) * height;
+    m_planes.resize(6 * n);
+    float* a[3] = { &m_planes[0], &m_planes[n], &m_planes[2 * n] };
+    float* b[3] = { &m_planes[3 * n], &m_planes[4 * n], &m_planes[5 * n] };
+    const float* albedo[3] = {
+        gbuffer.plane(GBuffer::kAlbedoR), gbuffer.plane(GBuffer::kAlbedoG), gbuffer.plane(GBuffer::kAlbedoB)
+    };
+    bool demodulate = m_settings.demodulate;
+
+    for_bands(height, [&](int y0, int y1) {
+        for ( size_t i = size_t(width) * y0; i < size_t(width) * y1; ++i ) {
+            for ( int k = 0; k < 3; ++k ) {
+                a[k][i] = demodulate ? rgb[3 * i + k] / demodulation(albedo[k][i]) : rgb[3 * i + k];
+            }
+        }
+    });
+
+    Pass pass;
+    pass.normal[0] = gbuffer.plane(GBuffer::kNormalX);
+    pass.normal[1] = gbuffer.plane(GBuffer::kNormalY);
+    pass.normal[2] = gbuffer.plane(GBuffer::kNormalZ);
+    pass.depth = gbuffer.plane(GBuffer::kDepth);
+    pass.width = width;
+    pass.height = height;
+    pass.colorScale = LOG2E / ( 2.0f * pow2(m_settings.colorSigma) );
+    pass.depthScale = LOG2E / ( 2.0f * pow2(m_settings.depthSigma) );
+    pass.normalPower = m_settings.normalSigma;
+    for ( int i = 0; i < m_settings.iterations; ++i ) {
+        // each pass reads the previous one's output, with the taps twice as far apart
+        for ( int k = 0; k < 3; ++k ) {
+            pass.src[k] = a[k];
+            pass.dst[k] = b[k];
+        }
+        pass.step = 1 << i;
+        for_bands(height, [&](int y0, int y1) { filter_rows(pass, y0, y1); });
+        std::swap(a, b);
+    }
+
+    for_bands(height, [&](int y0, int y1) {
+        for ( size_t i = size_t(width) * y0; i < size_t(width) * y1; ++i ) {
+            for ( int k = 0; k < 3; ++k ) {
+                rgb[3 * i + k] = demodulate ? a[k][i] * demodulation(albedo[k][i]) : a[k][i];
+            }
+        }
+    });
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+class GBuffer;
+class ThreadPool;
+
+// Edge-avoiding A-Trous wavelet filter (Dammertz et al. 2010), the CPU counterpart of
+// DXRTest's ATrousDenoiser.hlsl. Every iteration runs the 5x5 B3-spline kernel with its taps
+// 1, 2, 4... pixels apart and weights each tap by how close its colour, normal and depth
+// are to the centre's, so noise is averaged away while edges are kept.
+// Rows are split across a thread pool and run 4 pixels at a time in SSE2.
+class ATrousDenoiser {
+public:
+    struct Settings {
+        int iterations;    // 0: off
+        float colorSigma;  // on linear colour (irradiance when demodulating)
+        float normalSigma; // exponent on the cosine between the normals
+        float depthSigma;  // on the depth difference relative to the centre's depth
+        bool demodulate;   // filter colour / albedo and multiply back, so textures stay sharp
+
+        Settings(int n = 5, float c = 0.45f, float nrm = 8.0f, float d = 0.3f, bool demod = true)
+            : iterations(n), colorSigma(c), normalSigma(nrm), depthSigma(d), demodulate(demod) {}
+    };
+
+    explicit ATrousDenoiser(const Settings& settings = Settings());
+    ~ATrousDenoiser();
+
+    ATrousDenoiser(const ATrousDenoiser&) = delete;
+    ATrousDenoiser& operator=(const ATrousDenoiser&) = delete;
+
+    const Settings& settings() const { return m_settings; }
+    void set_settings(const Settings& settings) { m_settings = settings; }
+
+    // rgb: the G-buffer's width * height linear RGB floats, rows top to bottom, filtered in place
+    void run(float* rgb, const GBuffer& gbuffer);
+
+private:
+    void for_bands(int height, const std::function<void(int, int)>& rows);
+    ThreadPool& pool();
+
+    Settings m_settings;
+    std::vector<float> m_planes; // two planar RGB copies, ping-ponged between iterations
+    std::unique_ptr<ThreadPool> m_pool;
+};
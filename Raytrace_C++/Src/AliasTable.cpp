@@ -0,0 +1,50 @@
+#include "AliasTable.h"
+
+AliasTable::AliasTable(const std::vector<float>& weights) {
+    double sum = 0;
+    for ( float w : weights ) {
+        sum += std::max(w, 0.0f);
+    }
+    if ( !( sum > 0 ) ) return;
+
+    size_t n = weights.size();
+    m_slots.resize(n);
+    m_pmf.resize(n);
+    // weights scaled so the average is 1; slots under 1 are topped up from those over 1
+    std::vector<double> scaled(n);
+    std::vector<int> small, large;
+    for ( size_t i = 0; i < n; ++i ) {
+        m_pmf[i] = float(std::max(weights[i], 0.0f) / sum);
+        scaled[i] = std::max(weights[i], 0.0f) / sum * n;
+        ( scaled[i] < 1.0 ? small : large ).push_back(int(i));
+    }
+    while ( !small.empty() && !large.empty() ) {
+        int s = small.back();
+        small.pop_back();
+        int l = large.back();
+        m_slots[s].keep = float(scaled[s]);
+        m_slots[s].alias = l;
+        scaled[l] -= 1.0 - scaled[s];
+        if ( scaled[l] < 1.0 ) {
+            large.pop_back();
+            small.push_back(l);
+        }
+    }
+    // what is left is 1 up to rounding
+    for ( int i : small ) {
+        m_slots[i].keep = 1;
+        m_slots[i].alias = i;
+    }
+    for ( int i : large ) {
+        m_slots[i].keep = 1;
+        m_slots[i].alias = i;
+    }
+}
+
+int AliasTable::sample(float u) const {
+    // the integer part picks the slot, the fraction decides between it and its alias
+    float x = u * m_slots.size();
+    int i = std::min(int(x), int(m_slots.size()) - 1);
+    const Slot& slot = m_slots[i];
+    return x - i < slot.keep ? i : slot.alias;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <vector>
+
+// Discrete distribution over 0..n-1 in proportion to non-negative weights, sampled in O(1)
+// with Walker's alias method (Vose's construction). Every slot holds the probability of
+// keeping its own index and the index it otherwise hands over to, so one uniform number
+// picks a slot and decides between the two. Built once; used for picking lights by power.
+class AliasTable {
+public:
+    AliasTable() {}
+    // all-zero (or no) weights give an empty table
+    explicit AliasTable(const std::vector<float>& weights);
+
+    bool empty() const { return m_slots.empty(); }
+    size_t size() const { return m_slots.size(); }
+
+    // index for u uniform in [0, 1)
+    int sample(float u) const;
+
+    // probability of sample() returning i
+    float pmf(int i) const { return m_pmf[i]; }
+
+private:
+    struct Slot {
+        float keep; // probability of returning the slot's own index
+        int alias;  // returned otherwise
+    };
+    std::vector<Slot> m_slots;
+    std::vector<float> m_pmf;
+};
@@ -0,0 +1,214 @@
+#include "AssetManager.h"
+
+#include "ThreadPool.h"
+#include "Mesh.h"
+
+#include <stb_image.h>
+
+#include <fstream>
+#include <chrono>
+#include <iomanip>
+
+namespace {
+    typedef std::chrono::steady_clock Clock;
+
+    double elapsed_ms(const Clock::time_point& from) {
+        return std::chrono::duration<double, std::milli>(Clock::now() - from).count();
+    }
+
+    std::string normalize_path(const std::string& path) {
+        std::string s = path;
+        std::replace(s.begin(), s.end(), '\\', '/');
+        while ( s.compare(0, 2, "./") == 0 ) {
+            s.erase(0, 2);
+        }
+        return s;
+    }
+
+    bool read_file(const std::string& path, std::vector<char>& bytes) {
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if ( !file ) return false;
+        std::streamsize size = file.tellg();
+        file.seekg(0, std::ios::beg);
+        bytes.resize(size_t(size));
+        return size == 0 || bool(file.read(bytes.data(), size));
+    }
+
+    // FNV-1a
+    uint64_t hash_bytes(const std::vector<char>& bytes) {
+        uint64_t h = 14695981039346656037ull;
+        for ( char c : bytes ) {
+            h ^= uint64_t(static_cast<unsigned char>( c ));
+            h *= 1099511628211ull;
+        }
+        return h;
+    }
+
+    std::shared_ptr<const ImageData> decode_image(const std::vector<char>& bytes) {
+        int w, h, n;
+        unsigned char* texels = stbi_load_from_memory(
+            reinterpret_cast<const stbi_uc*>( bytes.data() ), int(bytes.size()), &w, &h, &n, 3);
+        if ( !texels ) return nullptr;
+        auto image = std::make_shared<ImageData>();
+        image->width = w;
+        image->height = h;
+        image->texels.assign(texels, texels + 3 * w * h);
+        stbi_image_free(texels);
+        return image;
+    }
+
+    std::shared_ptr<const HdrImageData> decode_hdr_image(const std::vector<char>& bytes) {
+        int w, h, n;
+        float* texels = stbi_loadf_from_memory(
+            reinterpret_cast<const stbi_uc*>( bytes.data() ), int(bytes.size()), &w, &h, &n, 3);
+        if ( !texels ) return nullptr;
+        auto image = std::make_shared<HdrImageData>();
+        image->width = w;
+        image->height = h;
+        image->texels.assign(texels, texels + 3 * w * h);
+        stbi_image_free(texels);
+        return image;
+    }
+
+    std::shared_ptr<const Mesh> decode_mesh(const std::vector<char>& bytes, AssetManager::Stats& stats) {
+        auto mesh = std::make_shared<Mesh>();
+        if ( !mesh->load_obj(bytes.data(), bytes.size()) ) return nullptr;
+        // the BVH is built right here on the loader thread, so geometry that finished
+        // loading gets its BVH while other assets are still being read and decoded
+        Clock::time_point start = Clock::now();
+        mesh->build_bvh();
+        stats.bvhMs = elapsed_ms(start);
+        return mesh;
+    }
+}
+
+AssetManager::AssetManager(int numThreads)
+    : m_numThreads(numThreads)
+    , m_wallMs(0) {
+}
+
+AssetManager::~AssetManager() {
+    wait();
+}
+
+ThreadPool& AssetManager::pool() {
+    // threads are only started once the scene actually asks for a file
+    if ( !m_pool ) {
+        m_pool = std::make_unique<ThreadPool>(m_numThreads);
+    }
+    return *m_pool;
+}
+
+ImageAssetPtr AssetManager::image(const std::string& path) {
+    // images have no BVH, so nothing beyond the decode time to report
+    return request(path, m_images, [](const std::vector<char>& bytes, Stats&) { return decode_image(bytes); });
+}
+
+HdrImageAssetPtr AssetManager::hdr_image(const std::string& path) {
+    return request(path, m_hdrImages, [](const std::vector<char>& bytes, Stats&) { return decode_hdr_image(bytes); });
+}
+
+MeshAssetPtr AssetManager::mesh(const std::string& path) {
+    return request(path, m_meshes, decode_mesh);
+}
+
+template<typename T, typename Decode>
+std::shared_ptr< Asset<T> > AssetManager::request(const std::string& path, Table<T>& table, Decode decode) {
+    std::string key = normalize_path(path);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto found = table.byPath.find(key);
+    if ( found != table.byPath.end() ) {
+        return found->second;
+    }
+
+    auto asset = std::make_shared< Asset<T> >(key);
+    table.byPath[key] = asset;
+    size_t slot = m_stats.size();
+    Stats s = { key, 0, 0.0, 0.0, 0.0, false };
+    m_stats.push_back(s);
+
+    m_pending.push_back(pool().enqueue([this, asset, &table, decode, slot] {
+        Stats stats = { asset->path(), 0, 0.0, 0.0, 0.0, false };
+
+        Clock::time_point start = Clock::now();
+        std::vector<char> bytes;
+        bool ok = read_file(asset->path(), bytes);
+        stats.bytes = bytes.size();
+        stats.readMs = elapsed_ms(start);
+
+        if ( ok ) {
+            uint64_t hash = hash_bytes(bytes);
+            std::shared_future< std::shared_ptr<const T> > existing;
+            std::promise< std::shared_ptr<const T> > promise;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                auto it = table.byContent.find(hash);
+                if ( it != table.byContent.end() ) {
+                    existing = it->second;
+                }
+                else {
+                    table.byContent[hash] = promise.get_future().share();
+                }
+            }
+
+            if ( existing.valid() ) {
+                // the owner of this content is already running, so this cannot deadlock
+                asset->m_data = existing.get();
+                stats.shared = true;
+            }
+            else {
+                start = Clock::now();
+                asset->m_data = decode(bytes, stats);
+                stats.decodeMs = elapsed_ms(start) - stats.bvhMs;
+                promise.set_value(asset->m_data);
+            }
+        }
+
+        if ( !asset->m_data ) {
+            std::cerr << "AssetManager: failed to load " << asset->path() << std::endl;
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stats[slot] = stats;
+    }));
+
+    return asset;
+}
+
+void AssetManager::wait() {
+    Clock::time_point start = Clock::now();
+    std::vector< std::future<void> > pending;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        pending.swap(m_pending);
+    }
+    for ( auto& f : pending ) {
+        f.get();
+    }
+    m_wallMs += elapsed_ms(start);
+}
+
+void AssetManager::report(std::ostream& os) const {
+    if ( m_stats.empty() ) return;
+
+    std::ios::fmtflags flags = os.flags();
+    std::streamsize precision = os.precision();
+    double total = 0;
+    os << "Assets (" << m_stats.size() << " requested, "
+        << ( m_pool ? m_pool->size() : 0 ) << " loader threads)" << std::endl;
+    for ( auto& s : m_stats ) {
+        double sum = s.readMs + s.decodeMs + s.bvhMs;
+        total += sum;
+        os << std::fixed << std::setprecision(2)
+            << "  " << std::setw(9) << sum << " ms"
+            << "  read " << s.readMs
+            << "  decode " << s.decodeMs
+            << "  bvh " << s.bvhMs
+            << "  " << ( s.bytes >> 10 ) << " KiB"
+            << ( s.shared ? "  (shared)  " : "  " ) << s.path << std::endl;
+    }
+    os << "  " << total << " ms of loading, " << m_wallMs << " ms waited in build" << std::endl;
+    os.flags(flags);
+    os.precision(precision);
+}
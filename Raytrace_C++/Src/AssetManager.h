@@ -0,0 +1,100 @@
+#pragma once
+
+#include <string>
+#include <map>
+#include <mutex>
+#include <future>
+#include <cstdint>
+
+class ThreadPool;
+class Mesh;
+
+// 8-bit RGB texels decoded from an image file
+struct ImageData {
+    int width;
+    int height;
+    std::vector<unsigned char> texels;
+};
+
+// linear RGB texels decoded from an HDR image file (Radiance .hdr; 8-bit files are
+// converted from sRGB)
+struct HdrImageData {
+    int width;
+    int height;
+    std::vector<float> texels;
+};
+
+// Handle returned immediately by AssetManager; the data is filled in by the loader
+// threads and is only safe to read after AssetManager::wait().
+template<typename T>
+class Asset {
+public:
+    explicit Asset(const std::string& path) : m_path(path) {}
+
+    const T* get() const { return m_data.get(); }
+    const std::string& path() const { return m_path; }
+
+private:
+    friend class AssetManager;
+    std::string m_path;
+    std::shared_ptr<const T> m_data;
+};
+
+typedef Asset<ImageData> ImageAsset;
+typedef Asset<HdrImageData> HdrImageAsset;
+typedef Asset<Mesh> MeshAsset;
+typedef std::shared_ptr<ImageAsset> ImageAssetPtr;
+typedef std::shared_ptr<HdrImageAsset> HdrImageAssetPtr;
+typedef std::shared_ptr<MeshAsset> MeshAssetPtr;
+
+// Loads images (8-bit textures and HDR environments) and meshes concurrently while
+// Scene::build is still constructing the scene. Requests are deduplicated by path, then by a
+// hash of the file contents, so the same texture or mesh is decoded once however many times
+// (and under whatever names) it is used.
+class AssetManager {
+public:
+    struct Stats {
+        std::string path;
+        size_t bytes;
+        double readMs;
+        double decodeMs; // image decode or OBJ parse
+        double bvhMs;    // meshes only
+        bool shared;     // contents matched an asset already loaded from another path
+    };
+
+    explicit AssetManager(int numThreads = 0);
+    ~AssetManager();
+
+    ImageAssetPtr image(const std::string& path);
+    HdrImageAssetPtr hdr_image(const std::string& path);
+    MeshAssetPtr mesh(const std::string& path);
+
+    // blocks until every requested asset has been loaded
+    void wait();
+
+    const std::vector<Stats>& stats() const { return m_stats; }
+    // one line per requested file with its load times; prints nothing when none was requested
+    void report(std::ostream& os) const;
+
+private:
+    template<typename T>
+    struct Table {
+        std::map<std::string, std::shared_ptr< Asset<T> > > byPath;
+        std::map<uint64_t, std::shared_future< std::shared_ptr<const T> > > byContent;
+    };
+
+    template<typename T, typename Decode>
+    std::shared_ptr< Asset<T> > request(const std::string& path, Table<T>& table, Decode decode);
+
+    ThreadPool& pool();
+
+    int m_numThreads;
+    std::unique_ptr<ThreadPool> m_pool;
+    std::mutex m_mutex;
+    Table<ImageData> m_images;
+    Table<HdrImageData> m_hdrImages;
+    Table<Mesh> m_meshes;
+    std::vector< std::future<void> > m_pending;
+    std::vector<Stats> m_stats;
+    double m_wallMs;
+};
@@ -0,0 +1,285 @@
+#include "Bdpt.h"
+
+#include "Shape.h"
+#include "Material.h"
+#include "PDF.h"
+#include "ONB.h"
+#include "Camera.h"
+#include "EnvironmentLight.h"
+
+#include <cfloat>
+
+#define ROULETTE_DEPTH 3 // bounces from here on may end a subpath by Russian roulette
+
+Bdpt::Bdpt(const Shape* world, const std::vector<ShapePtr>& emitters, const Camera* camera, const Vector3& background,
+    const EnvironmentLight* environment, int maxDepth, int width, int height, int threads)
+    : m_world(world)
+    , m_emitters(emitters)
+    , m_camera(camera)
+    , m_background(background)
+    , m_environment(environment)
+    , m_maxDepth(maxDepth)
+    , m_width(width)
+    , m_height(height)
+    , m_threads(threads) {
+    std::vector<float> power;
+    for ( auto& e : m_emitters ) {
+        m_areas.push_back(e->area());
+        power.push_back(e->power());
+    }
+    m_pick = AliasTable(power);
+}
+
+Vector3 Bdpt::towards(const Vertex& v, const Vector3& d) const {
+    if ( v.type == Vertex::kLight ) {
+        float cosine = std::max(dot(v.hrec.n, normalize(d)), 0.0f);
+        return v.hrec.mat->emitted(Ray(v.hrec.p + d, -d), v.hrec) * cosine;
+    }
+    return v.srec.albedo * v.hrec.mat->scattering_pdf(Ray(v.hrec.p, d), v.hrec);
+}
+
+float Bdpt::convert(float pdf, const Vertex& from, const Vertex& to) {
+    Vector3 d = to.hrec.p - from.hrec.p;
+    float dd = lengthSqr(d);
+    if ( dd <= 0 ) return 0;
+    if ( to.type != Vertex::kCamera ) {
+        pdf *= fabsf(dot(to.hrec.n, d)) / sqrtf(dd);
+    }
+    return pdf / dd;
+}
+
+float Bdpt::pdf(const Vertex& from, const Vertex& to, const Vector3* wo) const {
+    Vector3 d = to.hrec.p - from.hrec.p;
+    float density;
+    if ( from.type == Vertex::kCamera ) {
+        density = m_camera->pdf(d);
+    }
+    else if ( from.type == Vertex::kLight ) {
+        density = std::max(dot(from.hrec.n, normalize(d)), 0.0f) / PI;
+    }
+    else if ( wo ) {
+        HitRec hrec = from.hrec;
+        hrec.wo = *wo;
+        density = from.srec.pdf->value(hrec, d);
+    }
+    else {
+        density = from.srec.pdf->value(from.hrec, d);
+    }
+    return convert(density, from, to);
+}
+
+int Bdpt::find_light(const Ray& r, const HitRec& hrec) const {
+    // the emitter the world hit belongs to: the one hit at the same distance
+    int light = -1;
+    float closest = FLT_MAX;
+    for ( size_t k = 0; k < m_emitters.size(); ++k ) {
+        HitRec lrec;
+        if ( m_emitters[k]->hit(r, 0.001f, FLT_MAX, lrec) && fabsf(lrec.t - hrec.t) < closest ) {
+            closest = fabsf(lrec.t - hrec.t);
+            light = int(k);
+        }
+    }
+    return closest <= 1e-3f * hrec.t ? light : -1;
+}
+
+bool Bdpt::visible(const Vector3& from, const Vector3& to) const {
+    HitRec hrec;
+    return !m_world->hit(Ray(from, to - from), 0.001f, 0.999f, hrec);
+}
+
+void Bdpt::walk(std::vector<Vertex>& path, Ray r, Vector3 beta, float pdf, size_t maxVertices, Vector3& escaped) const {
+    for ( int bounce = 0; path.size() < maxVertices; ++bounce ) {
+        Vertex v;
+        if ( !m_world->hit(r, 0.001f, FLT_MAX, v.hrec) ) {
+            if ( path[0].type == Vertex::kCamera ) {
+                Vector3 le = m_environment ? m_environment->radiance(r.direction()) : m_background;
+                escaped += mulPerElem(beta, le);
+            }
+            return;
+        }
+        v.type = Vertex::kSurface;
+        v.beta = beta;
+        v.pdfFwd = 0;
+        v.pdfRev = 0;
+        v.delta = false;
+        v.light = -1;
+        bool scattered = v.hrec.mat->scatter(r, v.hrec, v.srec);
+        if ( !scattered ) {
+            // an emitter ends a camera subpath; anything else that does not scatter ends both
+            if ( path[0].type == Vertex::kLight ) return;
+            v.light = find_light(r, v.hrec);
+            if ( v.light < 0 ) return;
+            v.type = Vertex::kLight;
+        }
+        v.pdfFwd = convert(pdf, path.back(), v);
+        path.push_back(v);
+        if ( !scattered || path.size() >= maxVertices ) return;
+
+        Vertex& current = path.back();
+        Vertex& previous = path[path.size() - 2];
+        if ( current.srec.is_specular ) {
+            current.delta = true;
+            beta = mulPerElem(beta, current.srec.albedo);
+            r = current.srec.ray;
+            pdf = 0;
+            continue;
+        }
+        Vector3 d = current.srec.pdf->generate(current.hrec);
+        pdf = current.srec.pdf->value(current.hrec, d);
+        if ( !( pdf > 0 ) ) return;
+        Vector3 wo = normalize(d);
+        previous.pdfRev = this->pdf(current, previous, &wo);
+        beta = mulPerElem(beta, towards(current, d)) / pdf;
+        r = Ray(current.hrec.p, d);
+        if ( bounce >= ROULETTE_DEPTH ) {
+            float survive = std::min(maxElem(current.srec.albedo), 0.95f);
+            if ( drand48() >= survive ) return;
+            beta /= survive;
+        }
+    }
+}
+
+Vector3 Bdpt::sample(const Ray& r, int thread, std::vector<Splat>& splats) {
+    ThreadState& state = m_threads[thread];
+    Vector3 c(0);
+
+    // the camera subpath, with the camera's density for the ray over the whole frame
+    std::vector<Vertex>& camera = state.camera;
+    camera.clear();
+    Vertex eye;
+    eye.type = Vertex::kCamera;
+    eye.hrec.p = m_camera->origin();
+    eye.hrec.n = Vector3(0);
+    eye.beta = Vector3(1);
+    eye.pdfFwd = 1;
+    eye.pdfRev = 0;
+    eye.delta = false;
+    eye.light = -1;
+    camera.push_back(eye);
+    walk(camera, r, eye.beta, m_camera->pdf(r.direction()), m_maxDepth + 2, c);
+
+    // the light subpath: a point by area on an emitter picked by power, a direction by cosine
+    std::vector<Vertex>& light = state.light;
+    light.clear();
+    if ( !m_pick.empty() ) {
+        Vertex l;
+        l.type = Vertex::kLight;
+        l.light = m_pick.sample(drand48());
+        m_emitters[l.light]->sample_area(l.hrec);
+        l.pdfFwd = light_pdf(l.light);
+        l.pdfRev = 0;
+        l.beta = Vector3(1.0f / l.pdfFwd);
+        l.delta = false;
+        light.push_back(l);
+        ONB uvw;
+        uvw.build_from_w(l.hrec.n);
+        Vector3 d = uvw.local(random_cosine_direction());
+        float pdf = std::max(dot(l.hrec.n, normalize(d)), 0.0f) / PI;
+        if ( pdf > 0 ) {
+            Vector3 none(0);
+            walk(light, Ray(l.hrec.p, d), mulPerElem(l.beta, towards(l, d)) / pdf, pdf, m_maxDepth + 1, none);
+        }
+    }
+
+    // Every join of s light and t camera vertices that is no longer than maxDepth bounces.
+    // An emitter seen straight from the camera is only counted by the camera subpath
+    // (s = 0), not also by projecting the light vertex onto the film (s = t = 1).
+    for ( int t = 1; t <= int(camera.size()); ++t ) {
+        for ( int s = 0; s <= int(light.size()); ++s ) {
+            int depth = s + t - 2;
+            if ( ( t == 1 && s <= 1 ) || depth > m_maxDepth ) continue;
+            c += connect(state, s, t, splats);
+        }
+    }
+    return c;
+}
+
+Vector3 Bdpt::connect(ThreadState& state, int s, int t, std::vector<Splat>& splats) const {
+    std::vector<Vertex>& camera = state.camera;
+    std::vector<Vertex>& light = state.light;
+    const Vertex& pt = camera[t - 1];
+    Vector3 c(0);
+    if ( s == 0 ) {
+        // the camera subpath found an emitter by itself
+        if ( pt.type != Vertex::kLight ) return c;
+        const Vector3& from = camera[t - 2].hrec.p;
+        c = mulPerElem(pt.beta, pt.hrec.mat->emitted(Ray(from, pt.hrec.p - from), pt.hrec));
+    }
+    else {
+        const Vertex& qs = light[s - 1];
+        if ( qs.delta || pt.delta || pt.type == Vertex::kLight ) return c;
+        Vector3 d = pt.hrec.p - qs.hrec.p;
+        float dd = lengthSqr(d);
+        if ( dd <= 0 ) return c;
+        if ( t == 1 ) {
+            // light tracing: the camera's pdf is its importance times the cosine there
+            float u, v;
+            if ( !m_camera->project(qs.hrec.p, u, v) ) return c;
+            Vector3 splat = mulPerElem(qs.beta, towards(qs, d)) * ( m_camera->pdf(-d) / dd );
+            if ( maxElem(splat) <= 0 || !visible(qs.hrec.p, pt.hrec.p) ) return c;
+            Splat sp = { std::min(int(u * m_width), m_width - 1), std::min(int(v * m_height), m_height - 1),
+                splat * mis_weight(camera, light, s, t) };
+            splats.push_back(sp);
+            return c;
+        }
+        c = mulPerElem(mulPerElem(pt.beta, towards(pt, -d)), mulPerElem(towards(qs, d), qs.beta)) / dd;
+        if ( maxElem(c) <= 0 || !visible(pt.hrec.p, qs.hrec.p) ) return Vector3(0);
+    }
+    return maxElem(c) > 0 ? c * mis_weight(camera, light, s, t) : Vector3(0);
+}
+
+float Bdpt::mis_weight(std::vector<Vertex>& camera, std::vector<Vertex>& light, int s, int t) const {
+    if ( s + t == 2 ) return 1;
+
+    // Densities of the join's end vertices and their predecessors as sampled from the other
+    // side, set for the weight and restored after. Sampled that way, the paths through the
+    // end vertices come from across the join.
+    Vertex* pt = &camera[t - 1];
+    Vertex* ptMinus = t > 1 ? &camera[t - 2] : nullptr;
+    Vertex* qs = s > 0 ? &light[s - 1] : nullptr;
+    Vertex* qsMinus = s > 1 ? &light[s - 2] : nullptr;
+    Vertex* changed[4] = { pt, ptMinus, qs, qsMinus };
+    float saved[4];
+    for ( int i = 0; i < 4; ++i ) {
+        saved[i] = changed[i] ? changed[i]->pdfRev : 0;
+    }
+    pt->pdfRev = qs ? pdf(*qs, *pt) : light_pdf(pt->light);
+    if ( ptMinus ) {
+        Vector3 wo = qs ? normalize(qs->hrec.p - pt->hrec.p) : pt->hrec.wo;
+        ptMinus->pdfRev = pdf(*pt, *ptMinus, &wo);
+    }
+    if ( qs ) {
+        qs->pdfRev = pdf(*pt, *qs);
+    }
+    if ( qsMinus ) {
+        Vector3 wo = normalize(pt->hrec.p - qs->hrec.p);
+        qsMinus->pdfRev = pdf(*qs, *qsMinus, &wo);
+    }
+
+    // Every other strategy for the same path, as a ratio of its density to this one's,
+    // moving the join one vertex at a time towards either end. Joins at mirrors and glass
+    // are impossible; their zero densities count as 1 so the ratios pass through them.
+    auto remap = [](float pdf) { return pdf != 0 ? pdf : 1.0f; };
+    float sum = 0;
+    float ratio = 1;
+    for ( int i = t - 1; i > 0; --i ) {
+        ratio *= remap(camera[i].pdfRev) / remap(camera[i].pdfFwd);
+        if ( !camera[i].delta && !camera[i - 1].delta ) {
+            sum += ratio * ratio;
+        }
+    }
+    ratio = 1;
+    for ( int i = s - 1; i >= 0; --i ) {
+        ratio *= remap(light[i].pdfRev) / remap(light[i].pdfFwd);
+        if ( !light[i].delta && ( i == 0 || !light[i - 1].delta ) ) {
+            sum += ratio * ratio;
+        }
+    }
+
+    for ( int i = 0; i < 4; ++i ) {
+        if ( changed[i] ) {
+            changed[i]->pdfRev = saved[i];
+        }
+    }
+    return 1.0f / ( 1.0f + sum );
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "HitRec.h"
+#include "ScatterRec.h"
+#include "AliasTable.h"
+#include "SplatBuffer.h"
+
+#include <vector>
+
+class Shape;
+class Camera;
+class EnvironmentLight;
+
+// Bidirectional path tracing (Veach 1997, laid out as in pbrt). Every camera sample traces
+// a subpath from the camera and one from an emitter, then joins every prefix of one to
+// every prefix of the other with a shadow ray. Each join is a separate strategy for the
+// same path; the power heuristic over all of them decides how much each one counts.
+// Paths hitting an emitter (s = 0) and next-event estimation (s = 1) are two of them.
+// The joins straight to the camera (t = 1, light tracing) land on whatever pixel they
+// project to, and are handed back as splats.
+//
+// Emitters are picked by power and sampled by area, emitting by cosine. Mirrors and glass
+// are followed but never joined. Surfaces are one-sided: the material's scattering_pdf()
+// decides which side they reflect to.
+class Bdpt {
+public:
+    // emitters: every shape whose material emits; environment: what escaping camera subpaths
+    // see instead of background if not null, never sampled from the light side; maxDepth:
+    // bounces, as in the path tracer; threads: the render threads, each with its own subpaths
+    Bdpt(const Shape* world, const std::vector<ShapePtr>& emitters, const Camera* camera, const Vector3& background,
+        const EnvironmentLight* environment, int maxDepth, int width, int height, int threads);
+
+    // radiance along a camera ray by all strategies but light tracing, whose share of the
+    // sample is appended to splats
+    Vector3 sample(const Ray& r, int thread, std::vector<Splat>& splats);
+
+private:
+    struct Vertex {
+        enum Type {
+            kCamera,
+            kLight,  // a point on an emitter, first on a light subpath or last on a camera one
+            kSurface
+        };
+        Type type;
+        HitRec hrec;
+        ScatterRec srec;
+        Vector3 beta;  // throughput of the subpath up to and including the vertex
+        float pdfFwd;  // area density of the vertex, sampled along its subpath
+        float pdfRev;  // the same, were it sampled from the other end of the path
+        bool delta;    // mirror or glass: never joined
+        int light;     // emitter index of a kLight vertex
+
+        // everything zero, so the camera and light vertices copy no uninitialized fields
+        Vertex()
+            : type(kSurface)
+            , beta(0)
+            , pdfFwd(0)
+            , pdfRev(0)
+            , delta(false)
+            , light(-1) {
+            hrec.t = hrec.u = hrec.v = 0;
+            hrec.p = hrec.n = hrec.wo = Vector3(0);
+            srec.ray = Ray(Vector3(0), Vector3(0));
+            srec.albedo = Vector3(0);
+            srec.pdf = nullptr;
+            srec.is_specular = false;
+            srec.is_diffuse = false;
+        }
+    };
+
+    struct ThreadState {
+        std::vector<Vertex> camera;
+        std::vector<Vertex> light;
+    };
+
+    // Extend path along r, whose direction its last vertex sampled with density pdf over
+    // solid angle. Camera subpaths that escape add the background to escaped.
+    void walk(std::vector<Vertex>& path, Ray r, Vector3 beta, float pdf, size_t maxVertices, Vector3& escaped) const;
+
+    // what a vertex sends towards d: emitted radiance for an emitter, the material's
+    // albedo * scattering_pdf() for a surface, each times the cosine at the vertex
+    Vector3 towards(const Vertex& v, const Vector3& d) const;
+    // area density at to of a direction sampled at from, with the density over solid angle
+    // given or the one from's sampling has; wo: where the path through from comes from, if
+    // not the way from was reached (glossy densities depend on it)
+    static float convert(float pdf, const Vertex& from, const Vertex& to);
+    float pdf(const Vertex& from, const Vertex& to, const Vector3* wo = nullptr) const;
+    float light_pdf(int light) const { return m_pick.pmf(light) / m_areas[light]; }
+    int find_light(const Ray& r, const HitRec& hrec) const;
+    bool visible(const Vector3& from, const Vector3& to) const;
+
+    // Join light[0, s) to camera[0, t) and return the weighted contribution; with t = 1 it
+    // is appended to splats instead and 0 is returned.
+    Vector3 connect(ThreadState& state, int s, int t, std::vector<Splat>& splats) const;
+    // power heuristic weight of that join
+    float mis_weight(std::vector<Vertex>& camera, std::vector<Vertex>& light, int s, int t) const;
+
+    const Shape* m_world;
+    std::vector<ShapePtr> m_emitters;
+    std::vector<float> m_areas;
+    AliasTable m_pick; // by power
+    const Camera* m_camera;
+    Vector3 m_background;
+    const EnvironmentLight* m_environment;
+    int m_maxDepth;
+    int m_width;
+    int m_height;
+    std::vector<ThreadState> m_threads;
+};
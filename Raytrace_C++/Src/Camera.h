@@ -25,6 +25,32 @@ public:
         return Ray(m_origin, m_uvw[2] + m_uvw[0] * u + m_uvw[1] * v - m_origin);
     }
 
+    const Vector3& origin() const { return m_origin; }
+
+    // the u, v for which getRay() passes through p; false when p is behind the camera or
+    // outside the frame
+    bool project(const Vector3& p, float& u, float& v) const {
+        Vector3 forward = normalize(cross(m_uvw[1], m_uvw[0]));
+        float along = dot(p - m_origin, forward);
+        if ( along <= 0 ) return false;
+        Vector3 q = m_origin + ( p - m_origin ) * ( dot(m_uvw[2] - m_origin, forward) / along ) - m_uvw[2];
+        u = dot(q, m_uvw[0]) / lengthSqr(m_uvw[0]);
+        v = dot(q, m_uvw[1]) / lengthSqr(m_uvw[1]);
+        return u >= 0 && u < 1 && v >= 0 && v < 1;
+    }
+
+    // Density over solid angle of getRay() directions for u, v uniform over the frame, 0
+    // outside it: distance^2 / ( area * cos^3 ) for the image plane. For a pinhole it is
+    // also the importance times the cosine at the camera, which light tracing needs.
+    float pdf(const Vector3& d) const {
+        float u, v;
+        if ( !project(m_origin + d, u, v) ) return 0;
+        Vector3 forward = normalize(cross(m_uvw[1], m_uvw[0]));
+        float cosine = dot(normalize(d), forward);
+        float distance = dot(m_uvw[2] - m_origin, forward);
+        return pow2(distance) / ( length(cross(m_uvw[0], m_uvw[1])) * cosine * cosine * cosine );
+    }
+
 private:
     Vector3 m_origin;  // ʒu
     Vector3 m_uvw[3];  // xNg
@@ -0,0 +1,78 @@
+#include "Checkpoint.h"
+
+#include <cstdio>
+
+#define CHECKPOINT_MAGIC "RTCKPT\0"
+#define CHECKPOINT_VERSION 1
+#define CHECKPOINT_ALIGN 4096
+
+size_t Checkpoint::film_offset(int slot, int w, int h) {
+    size_t filmSize = ( Film::storage_size(w, h) + CHECKPOINT_ALIGN - 1 ) / CHECKPOINT_ALIGN * CHECKPOINT_ALIGN;
+    return CHECKPOINT_ALIGN + slot * filmSize;
+}
+
+bool Checkpoint::open(const char* path, int w, int h, uint64_t settings, State& state) {
+    m_path = path;
+    if ( !m_file.open(path, film_offset(2, w, h)) ) {
+        std::cerr << "Checkpoint: cannot map " << path << std::endl;
+        m_live = std::make_unique<Film>(w, h);
+        return false;
+    }
+    char* base = static_cast<char*>( m_file.data() );
+    m_live = std::make_unique<Film>(w, h, base + film_offset(0, w, h));
+    m_committed = std::make_unique<Film>(w, h, base + film_offset(1, w, h));
+
+    Header* hd = header();
+    bool match = m_file.reused()
+        && memcmp(hd->magic, CHECKPOINT_MAGIC, sizeof(hd->magic)) == 0
+        && hd->version == CHECKPOINT_VERSION
+        && hd->width == w && hd->height == h
+        && hd->settings == settings;
+    if ( match && hd->status == kCommitted ) {
+        m_live->copy_from(*m_committed);
+        state = hd->committed;
+        return true;
+    }
+    if ( match && hd->status == kCopying ) {
+        // interrupted while committing: the live film is exactly the state being copied
+        state = hd->copying;
+        return true;
+    }
+
+    memset(hd, 0, sizeof(Header));
+    memcpy(hd->magic, CHECKPOINT_MAGIC, sizeof(hd->magic));
+    hd->version = CHECKPOINT_VERSION;
+    hd->status = kEmpty;
+    hd->width = w;
+    hd->height = h;
+    hd->settings = settings;
+    m_live->clear();
+    return false;
+}
+
+void Checkpoint::commit(const State& state) {
+    Header* hd = header();
+    if ( !hd ) return;
+    int w = hd->width;
+    int h = hd->height;
+
+    // the live film has to be on disk before the header can point at it
+    m_file.flush(film_offset(0, w, h), film_offset(1, w, h) - film_offset(0, w, h));
+    hd->copying = state;
+    hd->status = kCopying;
+    m_file.flush(0, sizeof(Header));
+
+    m_committed->copy_from(*m_live);
+    m_file.flush(film_offset(1, w, h), film_offset(2, w, h) - film_offset(1, w, h));
+
+    hd->committed = state;
+    hd->status = kCommitted;
+    m_file.flush(0, sizeof(Header));
+}
+
+void Checkpoint::remove() {
+    m_live.reset();
+    m_committed.reset();
+    m_file.close();
+    std::remove(m_path.c_str());
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "MappedFile.h"
+#include "Film.h"
+
+#include <string>
+#include <cstdint>
+
+// Render state kept in a memory-mapped file so a pre-empted render can resume.
+// The file holds a header, the live film the passes accumulate into, and a committed copy
+// of the film taken at the last checkpoint. The header says which of the two is consistent:
+// while a pass runs the committed copy is, while a commit is copying the live film is.
+// A kill at any point therefore leaves one consistent film on disk.
+class Checkpoint {
+public:
+    struct State {
+        int passes;
+        int nextSample; // first sample index of the next pass; pixel RNG streams derive from it
+        int nextSpp;
+        double seconds; // wall-clock time spent by earlier runs
+    };
+
+    Checkpoint() {}
+
+    // Maps the checkpoint file for a w x h render. Returns true and fills state when the file
+    // holds a resumable render made with the same settings; otherwise starts a fresh one.
+    bool open(const char* path, int w, int h, uint64_t settings, State& state);
+
+    // the film to render into; lives in the mapped file
+    Film& film() { return *m_live; }
+
+    // copies the live film to the committed slot and syncs both to disk
+    void commit(const State& state);
+
+    // closes and deletes the file once the render has finished; film() is gone afterwards
+    void remove();
+
+private:
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t status;
+        int32_t width;
+        int32_t height;
+        uint64_t settings;
+        State committed;
+        State copying;
+    };
+
+    enum Status {
+        kEmpty = 0,
+        kCommitted,
+        kCopying
+    };
+
+    static size_t film_offset(int slot, int w, int h);
+
+    Header* header() const { return static_cast<Header*>( m_file.data() ); }
+
+    std::string m_path;
+    MappedFile m_file;
+    std::unique_ptr<Film> m_live;
+    std::unique_ptr<Film> m_committed;
+};
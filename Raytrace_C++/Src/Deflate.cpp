@@ -0,0 +1,214 @@
+#include "Deflate.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+    const int WINDOW = 32768;
+    const int HASH_BITS = 15;
+    const int MIN_MATCH = 3;
+    const int MAX_MATCH = 258;
+    const int MAX_CHAIN = 32;
+    const uint32_t ADLER_MOD = 65521;
+
+    const unsigned short LENGTH_BASE[] = {
+        3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+        35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+    };
+    const unsigned char LENGTH_EXTRA[] = {
+        0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+    };
+    const unsigned short DIST_BASE[] = {
+        1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+        257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+    };
+    const unsigned char DIST_EXTRA[] = {
+        0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+    };
+
+    class BitWriter {
+    public:
+        explicit BitWriter(std::vector<unsigned char>& out) : m_out(out), m_bits(0), m_count(0) {}
+
+        void put(uint32_t value, int count) {
+            m_bits |= uint64_t(value) << m_count;
+            m_count += count;
+            while ( m_count >= 8 ) {
+                m_out.push_back(static_cast<unsigned char>( m_bits ));
+                m_bits >>= 8;
+                m_count -= 8;
+            }
+        }
+
+        // Huffman codes go most significant bit first
+        void put_code(uint32_t code, int count) {
+            uint32_t reversed = 0;
+            for ( int i = 0; i < count; ++i ) {
+                reversed = ( reversed << 1 ) | ( ( code >> i ) & 1 );
+            }
+            put(reversed, count);
+        }
+
+        void align() {
+            if ( m_count > 0 ) {
+                put(0, 8 - m_count);
+            }
+        }
+
+    private:
+        std::vector<unsigned char>& m_out;
+        uint64_t m_bits;
+        int m_count;
+    };
+
+    void put_symbol(BitWriter& bits, int sym) {
+        if ( sym < 144 ) bits.put_code(0x30 + sym, 8);
+        else if ( sym < 256 ) bits.put_code(0x190 + sym - 144, 9);
+        else if ( sym < 280 ) bits.put_code(sym - 256, 7);
+        else bits.put_code(0xc0 + sym - 280, 8);
+    }
+
+    void put_match(BitWriter& bits, int length, int distance) {
+        int l = 0;
+        while ( l < 28 && LENGTH_BASE[l + 1] <= length ) ++l;
+        put_symbol(bits, 257 + l);
+        bits.put(length - LENGTH_BASE[l], LENGTH_EXTRA[l]);
+
+        int d = 0;
+        while ( d < 29 && DIST_BASE[d + 1] <= distance ) ++d;
+        bits.put_code(d, 5);
+        bits.put(distance - DIST_BASE[d], DIST_EXTRA[d]);
+    }
+
+    inline uint32_t hash3(const unsigned char* p) {
+        return ( ( uint32_t(p[0]) << 16 | uint32_t(p[1]) << 8 | p[2] ) * 2654435761u ) >> ( 32 - HASH_BITS );
+    }
+}
+
+void Deflate::compress(const unsigned char* data, size_t size, bool last, std::vector<unsigned char>& out) {
+    BitWriter bits(out);
+    bits.put(last ? 1 : 0, 1);
+    bits.put(1, 2); // fixed Huffman codes
+
+    std::vector<int> head(size_t(1) << HASH_BITS, -1);
+    std::vector<int> prev(WINDOW);
+
+    auto insert = [&](size_t pos) {
+        uint32_t h = hash3(data + pos);
+        prev[pos & ( WINDOW - 1 )] = head[h];
+        head[h] = int(pos);
+    };
+
+    auto longest = [&](size_t pos, int& distance) {
+        int best = 0;
+        int limit = int(std::min<size_t>(MAX_MATCH, size - pos));
+        int candidate = head[hash3(data + pos)];
+        for ( int chain = 0; candidate >= 0 && chain < MAX_CHAIN; ++chain ) {
+            if ( pos - candidate > size_t(WINDOW) ) break;
+            const unsigned char* a = data + candidate;
+            const unsigned char* b = data + pos;
+            if ( a[best] == b[best] ) {
+                int n = 0;
+                while ( n < limit && a[n] == b[n] ) ++n;
+                if ( n > best ) {
+                    best = n;
+                    distance = int(pos - candidate);
+                    if ( n == limit ) break;
+                }
+            }
+            int next = prev[candidate & ( WINDOW - 1 )];
+            if ( next >= candidate ) break;
+            candidate = next;
+        }
+        return best;
+    };
+
+    size_t pos = 0;
+    while ( pos < size ) {
+        int distance = 0;
+        int length = pos + MIN_MATCH <= size ? longest(pos, distance) : 0;
+        if ( length >= MIN_MATCH && pos + 1 + MIN_MATCH <= size ) {
+            // lazy matching: a longer match one byte later wins over this one
+            insert(pos);
+            int nextDistance = 0;
+            int nextLength = longest(pos + 1, nextDistance);
+            if ( nextLength > length ) {
+                put_symbol(bits, data[pos]);
+                ++pos;
+                continue;
+            }
+            put_match(bits, length, distance);
+            for ( size_t i = pos + 1; i < pos + length && i + MIN_MATCH <= size; ++i ) {
+                insert(i);
+            }
+            pos += length;
+        }
+        else if ( length >= MIN_MATCH ) {
+            put_match(bits, length, distance);
+            pos += length;
+        }
+        else {
+            if ( pos + MIN_MATCH <= size ) insert(pos);
+            put_symbol(bits, data[pos]);
+            ++pos;
+        }
+    }
+    put_symbol(bits, 256);
+
+    if ( !last ) {
+        // sync flush: empty stored block ends the chunk on a byte boundary
+        bits.put(0, 3);
+        bits.align();
+        bits.put(0x0000, 16);
+        bits.put(0xffff, 16);
+    }
+    bits.align();
+}
+
+uint32_t Deflate::adler32(const unsigned char* data, size_t size, uint32_t adler) {
+    uint32_t a = adler & 0xffff;
+    uint32_t b = adler >> 16;
+    while ( size > 0 ) {
+        // largest run that cannot overflow b before the modulo
+        size_t n = std::min<size_t>(size, 5552);
+        size -= n;
+        while ( n-- ) {
+            a += *data++;
+            b += a;
+        }
+        a %= ADLER_MOD;
+        b %= ADLER_MOD;
+    }
+    return ( b << 16 ) | a;
+}
+
+uint32_t Deflate::adler32_combine(uint32_t a, uint32_t b, size_t sizeB) {
+    uint32_t rem = uint32_t(sizeB % ADLER_MOD);
+    uint32_t a1 = a & 0xffff;
+    uint32_t b1 = a >> 16;
+    uint32_t a2 = b & 0xffff;
+    uint32_t b2 = b >> 16;
+    uint32_t sumA = ( a1 + a2 + ADLER_MOD - 1 ) % ADLER_MOD;
+    uint32_t sumB = uint32_t(( uint64_t(rem) * a1 + b1 + b2 + ADLER_MOD - rem ) % ADLER_MOD);
+    return ( sumB << 16 ) | sumA;
+}
+
+uint32_t Deflate::crc32(const unsigned char* data, size_t size, uint32_t crc) {
+    static uint32_t table[256];
+    static bool ready = [] {
+        for ( uint32_t n = 0; n < 256; ++n ) {
+            uint32_t c = n;
+            for ( int k = 0; k < 8; ++k ) {
+                c = ( c & 1 ) ? 0xedb88320u ^ ( c >> 1 ) : c >> 1;
+            }
+            table[n] = c;
+        }
+        return true;
+    }();
+    (void)ready;
+    crc = ~crc;
+    for ( size_t i = 0; i < size; ++i ) {
+        crc = table[( crc ^ data[i] ) & 0xff] ^ ( crc >> 8 );
+    }
+    return ~crc;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Raw deflate (RFC 1951) with fixed Huffman codes and LZ77 over hash chains.
+// Every call starts a fresh window, so independent chunks can be compressed on
+// different threads and concatenated: all but the last end in a sync flush.
+class Deflate {
+public:
+    static void compress(const unsigned char* data, size_t size, bool last, std::vector<unsigned char>& out);
+
+    static uint32_t adler32(const unsigned char* data, size_t size, uint32_t adler = 1);
+    // adler32 of A followed by B, from adler32(A), adler32(B) and the length of B
+    static uint32_t adler32_combine(uint32_t a, uint32_t b, size_t sizeB);
+
+    static uint32_t crc32(const unsigned char* data, size_t size, uint32_t crc = 0);
+};
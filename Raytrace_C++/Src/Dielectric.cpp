@@ -40,6 +40,7 @@ bool Dielectric::scatter(const Ray& r, const HitRec& hrec, ScatterRec& srec) con
 
     srec.pdf = nullptr;
     srec.is_specular = true;
+    srec.is_diffuse = false;
 
     return true;
 }
@@ -0,0 +1,166 @@
+#include "DirectionalTree.h"
+
+namespace {
+    // unit square <-> sphere, equal area: x is (cos theta + 1) / 2, y is phi / 2pi
+    void to_square(const Vector3& d, float& x, float& y) {
+        Vector3 n = normalize(d);
+        x = clamp(0.5f * ( n.getZ() + 1.0f ), 0.0f, 1.0f);
+        float phi = atan2f(n.getY(), n.getX());
+        y = phi < 0 ? phi / PI2 + 1.0f : phi / PI2;
+        y = clamp(y, 0.0f, 1.0f);
+    }
+
+    Vector3 to_direction(float x, float y) {
+        float z = 2.0f * x - 1.0f;
+        float r = sqrtf(std::max(0.0f, 1.0f - z * z));
+        float phi = PI2 * y;
+        return Vector3(r * cosf(phi), r * sinf(phi), z);
+    }
+
+    // quarter of the unit square holding x, y, which are then mapped into that quarter
+    int descend(float& x, float& y) {
+        int i = 0;
+        x *= 2.0f;
+        y *= 2.0f;
+        if ( x >= 1.0f ) {
+            x -= 1.0f;
+            i |= 1;
+        }
+        if ( y >= 1.0f ) {
+            y -= 1.0f;
+            i |= 2;
+        }
+        return i;
+    }
+}
+
+DirectionalTree::Node::Node() {
+    for ( int i = 0; i < 4; ++i ) {
+        sum[i].store(0, std::memory_order_relaxed);
+        child[i] = 0;
+    }
+}
+
+DirectionalTree::Node::Node(const Node& other) {
+    *this = other;
+}
+
+DirectionalTree::Node& DirectionalTree::Node::operator=(const Node& other) {
+    for ( int i = 0; i < 4; ++i ) {
+        sum[i].store(other.sum[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+        child[i] = other.child[i];
+    }
+    return *this;
+}
+
+DirectionalTree::DirectionalTree()
+    : m_nodes(1) {
+}
+
+DirectionalTree::DirectionalTree(const DirectionalTree& other)
+    : m_nodes(other.m_nodes) {
+}
+
+DirectionalTree& DirectionalTree::operator=(const DirectionalTree& other) {
+    m_nodes = other.m_nodes;
+    return *this;
+}
+
+void DirectionalTree::record(const Vector3& direction, float value) {
+    if ( !( value > 0 ) || !std::isfinite(value) ) return;
+    float x, y;
+    to_square(direction, x, y);
+    int node = 0;
+    for ( ;;) {
+        int i = descend(x, y);
+        atomic_add(m_nodes[node].sum[i], value);
+        if ( m_nodes[node].child[i] == 0 ) break;
+        node = m_nodes[node].child[i];
+    }
+}
+
+float DirectionalTree::load(const Node& node, float sum[4]) {
+    float total = 0;
+    for ( int i = 0; i < 4; ++i ) {
+        sum[i] = node.sum[i].load(std::memory_order_relaxed);
+        total += sum[i];
+    }
+    return total;
+}
+
+float DirectionalTree::total() const {
+    float sum[4];
+    return load(m_nodes[0], sum);
+}
+
+float DirectionalTree::pdf(const Vector3& direction) const {
+    float x, y;
+    to_square(direction, x, y);
+    float density = 1.0f;
+    int node = 0;
+    for ( ;;) {
+        const Node& n = m_nodes[node];
+        float s[4];
+        float total = load(n, s);
+        if ( !( total > 0 ) ) return 0;
+        int i = descend(x, y);
+        density *= 4.0f * s[i] / total;
+        if ( n.child[i] == 0 ) break;
+        node = n.child[i];
+    }
+    return density / ( 2.0f * PI2 );
+}
+
+Vector3 DirectionalTree::sample() const {
+    float x = 0;
+    float y = 0;
+    float size = 1.0f;
+    int node = 0;
+    for ( ;;) {
+        const Node& n = m_nodes[node];
+        float s[4];
+        float total = load(n, s);
+        float r = drand48() * total;
+        int i = 0;
+        for ( int k = 0; k < 4; ++k ) {
+            if ( s[k] <= 0 ) continue;
+            i = k; // the last quarter with energy takes whatever rounding leaves over
+            if ( r < s[k] ) break;
+            r -= s[k];
+        }
+        size *= 0.5f;
+        x += ( i & 1 ) ? size : 0.0f;
+        y += ( i & 2 ) ? size : 0.0f;
+        if ( n.child[i] == 0 ) break;
+        node = n.child[i];
+    }
+    return to_direction(x + drand48() * size, y + drand48() * size);
+}
+
+void DirectionalTree::refine(float threshold) {
+    // Walk the old tree and build the new one beside it. Below an old leaf there is no
+    // record of where in it the energy landed, so it is taken to be spread evenly.
+    struct Item {
+        int node;     // in the new tree
+        int old;      // matching node in the old tree, -1 below an old leaf
+        float energy; // of the quarter the node covers, when old is -1
+        int depth;
+    };
+    float total = this->total();
+    std::vector<Node> nodes(1);
+    std::vector<Item> stack;
+    stack.push_back({ 0, 0, total, 1 });
+    while ( !stack.empty() ) {
+        Item item = stack.back();
+        stack.pop_back();
+        for ( int i = 0; i < 4; ++i ) {
+            float energy = item.old >= 0 ? m_nodes[item.old].sum[i].load(std::memory_order_relaxed) : 0.25f * item.energy;
+            if ( !( total > 0 ) || energy <= threshold * total || item.depth >= MAX_DEPTH ) continue;
+            int old = item.old >= 0 && m_nodes[item.old].child[i] ? m_nodes[item.old].child[i] : -1;
+            nodes[item.node].child[i] = int(nodes.size());
+            nodes.push_back(Node());
+            stack.push_back({ nodes[item.node].child[i], old, energy, item.depth + 1 });
+        }
+    }
+    m_nodes.swap(nodes);
+}
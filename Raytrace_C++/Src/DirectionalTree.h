@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+
+// lock-free float accumulation for counters shared by render threads
+inline void atomic_add(std::atomic<float>& a, float value) {
+    float old = a.load(std::memory_order_relaxed);
+    while ( !a.compare_exchange_weak(old, old + value, std::memory_order_relaxed) ) {}
+}
+
+// Piecewise-constant distribution over the sphere of directions, the directional half of the
+// SD-tree in "Practical Path Guiding" (Muller et al. 2017). Directions map to the unit square
+// by the equal-area cylindrical projection (cos theta, phi), which a quadtree divides finely
+// where much light arrives and coarsely elsewhere. Every node keeps the energy recorded in
+// each of its four quarters; recording is lock-free, so render threads can share a tree.
+class DirectionalTree {
+public:
+    DirectionalTree();
+    DirectionalTree(const DirectionalTree& other);
+    DirectionalTree& operator=(const DirectionalTree& other);
+
+    // add value (incident radiance over the pdf of the direction it was sampled in)
+    void record(const Vector3& direction, float value);
+
+    // energy recorded over all directions
+    float total() const;
+
+    // density over the sphere; 0 everywhere while total() is 0
+    float pdf(const Vector3& direction) const;
+
+    // a direction drawn from pdf(); total() must be above 0
+    Vector3 sample() const;
+
+    // Rebuild the quadtree so that every quarter holding more than threshold of the total
+    // energy is subdivided, and every other one is a leaf, then clear the energy. What was
+    // recorded decides where the next round of records is resolved finely.
+    void refine(float threshold);
+
+private:
+    struct Node {
+        std::atomic<float> sum[4];
+        int child[4]; // 0: the quarter is a leaf
+
+        Node();
+        Node(const Node& other);
+        Node& operator=(const Node& other);
+    };
+
+    static const int MAX_DEPTH = 20;
+
+    // the node's four sums, and their total
+    static float load(const Node& node, float sum[4]);
+
+    std::vector<Node> m_nodes; // root at 0
+};
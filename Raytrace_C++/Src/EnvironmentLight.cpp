@@ -0,0 +1,88 @@
+#include "EnvironmentLight.h"
+
+#include "Film.h"
+
+EnvironmentLight::EnvironmentLight(const HdrImageAssetPtr& image, const Settings& settings)
+    : m_image(image)
+    , m_settings(settings)
+    , m_rotation(radians(settings.rotation))
+    , m_power(0) {
+    const HdrImageData* data = m_image->get();
+    if ( !data || data->width <= 0 || data->height <= 0 ) return;
+
+    // every texel by its luminance times sin(theta), in proportion to the solid angle it covers
+    int w = data->width;
+    int h = data->height;
+    std::vector<float> rows(h);
+    std::vector<float> columns(w);
+    double sum = 0;
+    double solidAngle = 0;
+    m_columns.resize(h);
+    for ( int j = 0; j < h; ++j ) {
+        float sinTheta = sinf(( j + 0.5f ) * PI / h);
+        double row = 0;
+        for ( int i = 0; i < w; ++i ) {
+            const float* t = &data->texels[3 * ( size_t(j) * w + i )];
+            columns[i] = std::max(luminance(Vector3(t[0], t[1], t[2])), 0.0f) * sinTheta;
+            row += columns[i];
+        }
+        rows[j] = float(row);
+        m_columns[j] = AliasTable(columns);
+        sum += row;
+        solidAngle += double(sinTheta) * w;
+    }
+    m_rows = AliasTable(rows);
+    m_power = float(4 * PI * PI * pow2(m_settings.radius) * m_settings.scale * sum / solidAngle);
+}
+
+void EnvironmentLight::texel(const Vector3& d, int& i, int& j, float& sinTheta) const {
+    const HdrImageData* data = m_image->get();
+    Vector3 n = normalize(d);
+    float theta = acosf(clamp(n.getY(), -1.0f, 1.0f));
+    float phi = atan2f(n.getZ(), n.getX()) - m_rotation;
+    phi -= PI2 * floorf(phi / PI2);
+    i = std::min(int(phi / PI2 * data->width), data->width - 1);
+    j = std::min(int(theta / PI * data->height), data->height - 1);
+    sinTheta = sinf(theta);
+}
+
+Vector3 EnvironmentLight::radiance(const Vector3& d) const {
+    const HdrImageData* data = m_image->get();
+    if ( !data ) {
+        return Vector3(0);
+    }
+    int i, j;
+    float sinTheta;
+    texel(d, i, j, sinTheta);
+    const float* t = &data->texels[3 * ( size_t(j) * data->width + i )];
+    return Vector3(t[0], t[1], t[2]) * m_settings.scale;
+}
+
+float EnvironmentLight::pdf_value(const Vector3& o, const Vector3& v) const {
+    if ( m_rows.empty() ) {
+        return 0;
+    }
+    int i, j;
+    float sinTheta;
+    texel(v, i, j, sinTheta);
+    float pmf = m_rows.pmf(j);
+    if ( pmf <= 0 || sinTheta <= 0 ) {
+        return 0;
+    }
+    // uniform over the texel in (phi, theta), where a solid angle is 2 * PI^2 * sin(theta) times larger
+    const HdrImageData* data = m_image->get();
+    pmf *= m_columns[j].pmf(i);
+    return pmf * data->width * data->height / ( 2 * PI * PI * sinTheta );
+}
+
+Vector3 EnvironmentLight::random(const Vector3& o) const {
+    if ( m_rows.empty() ) {
+        return Vector3(0, 1, 0);
+    }
+    const HdrImageData* data = m_image->get();
+    int j = m_rows.sample(drand48());
+    int i = m_columns[j].sample(drand48());
+    float theta = ( j + drand48() ) / data->height * PI;
+    float phi = ( i + drand48() ) / data->width * PI2 + m_rotation;
+    return Vector3(sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi));
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "Shape.h"
+#include "AssetManager.h"
+#include "AliasTable.h"
+
+#include <string>
+#include <vector>
+
+// Light from an equirectangular HDR image all around the scene, infinitely far away. Rows
+// run from +y at the top to -y at the bottom, columns once around y. Light sampling picks
+// a texel in proportion to its luminance times the solid angle it covers, by a row from the
+// marginal distribution and then a column from that row's conditional one (both alias
+// tables), and a direction uniformly inside the texel, so a small bright sun gets most of
+// the samples. The texels are the ones the AssetManager loaded and are not copied.
+//
+// As a Shape it is never hit. It takes part in light selection next to the emitters through
+// random() and pdf_value(), and in picking by power as if it lit a sphere of the given
+// radius around the scene.
+class EnvironmentLight : public Shape {
+public:
+    struct Settings {
+        std::string path; // of the image; empty: no environment
+        float scale;      // multiplies the texels
+        float rotation;   // of the image around y, in degrees
+        float radius;     // of a sphere around the scene, in scene units
+
+        Settings(const std::string& p = std::string(), float s = 1, float rot = 0, float r = 500)
+            : path(p), scale(s), rotation(rot), radius(r) {}
+    };
+
+    // image must be loaded (AssetManager::wait()); one that failed to load is black
+    EnvironmentLight(const HdrImageAssetPtr& image, const Settings& settings);
+
+    // radiance arriving from direction d
+    Vector3 radiance(const Vector3& d) const;
+
+    virtual bool hit(const Ray& r, float t0, float t1, HitRec& hrec) const override { return false; }
+
+    virtual float pdf_value(const Vector3& o, const Vector3& v) const override;
+
+    virtual Vector3 random(const Vector3& o) const override;
+
+    // 4 * PI^2 * radius^2 times the luminance averaged over all directions
+    virtual float power() const override { return m_power; }
+
+private:
+    // the texel direction d falls on, with sin(theta) there
+    void texel(const Vector3& d, int& i, int& j, float& sinTheta) const;
+
+    HdrImageAssetPtr m_image;
+    Settings m_settings;
+    float m_rotation; // radians
+    AliasTable m_rows;                 // marginal, by the sum over every row
+    std::vector<AliasTable> m_columns; // conditional on the row
+    float m_power;
+};
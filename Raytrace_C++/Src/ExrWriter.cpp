@@ -0,0 +1,289 @@
+#include "ExrWriter.h"
+
+#include "Half.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+// zlib stream from stb_image_write (implemented in Scene.cpp)
+extern "C" unsigned char* stbi_zlib_compress(unsigned char* data, int data_len, int* out_len, int quality);
+
+namespace {
+    const int ZIP_LEVEL = 6;
+
+    template<typename T>
+    void put(std::vector<char>& out, T value) {
+        // EXR is little endian, like every machine this builds for
+        const char* bytes = reinterpret_cast<const char*>( &value );
+        out.insert(out.end(), bytes, bytes + sizeof(T));
+    }
+
+    void put_string(std::vector<char>& out, const std::string& s) {
+        out.insert(out.end(), s.begin(), s.end());
+        out.push_back('\0');
+    }
+
+    void begin_attribute(std::vector<char>& out, const char* name, const char* type, int32_t size) {
+        put_string(out, name);
+        put_string(out, type);
+        put(out, size);
+    }
+
+    // The byte shuffle and delta that OpenEXR runs before RLE and zlib: low and high bytes
+    // of each value end up in separate halves, then neighbours are differenced.
+    void predict(const std::vector<unsigned char>& raw, std::vector<unsigned char>& out) {
+        size_t n = raw.size();
+        out.resize(n);
+        unsigned char* t1 = out.data();
+        unsigned char* t2 = out.data() + ( n + 1 ) / 2;
+        for ( size_t i = 0; i < n; ++i ) {
+            if ( i & 1 ) *t2++ = raw[i];
+            else *t1++ = raw[i];
+        }
+        int p = n > 0 ? out[0] : 0;
+        for ( size_t i = 1; i < n; ++i ) {
+            int d = int(out[i]) - p + ( 128 + 256 );
+            p = out[i];
+            out[i] = static_cast<unsigned char>( d );
+        }
+    }
+
+    // OpenEXR RLE: runs of 3..128 equal bytes as (count - 1, byte), literals as (-count, bytes...)
+    void rle(const std::vector<unsigned char>& in, std::vector<unsigned char>& out) {
+        const int MAX_RUN = 127;
+        const int MIN_RUN = 3;
+        out.clear();
+        const unsigned char* end = in.data() + in.size();
+        const unsigned char* runStart = in.data();
+        const unsigned char* runEnd = runStart + 1;
+        while ( runStart < end ) {
+            while ( runEnd < end && *runStart == *runEnd && runEnd - runStart - 1 < MAX_RUN ) {
+                ++runEnd;
+            }
+            if ( runEnd - runStart >= MIN_RUN ) {
+                out.push_back(static_cast<unsigned char>( ( runEnd - runStart ) - 1 ));
+                out.push_back(*runStart);
+                runStart = runEnd;
+            }
+            else {
+                while ( runEnd < end &&
+                    ( runEnd + 1 >= end || *runEnd != *( runEnd + 1 ) ||
+                      runEnd + 2 >= end || *( runEnd + 1 ) != *( runEnd + 2 ) ) &&
+                    runEnd - runStart < MAX_RUN ) {
+                    ++runEnd;
+                }
+                out.push_back(static_cast<unsigned char>( runStart - runEnd ));
+                out.insert(out.end(), runStart, runEnd);
+                runStart = runEnd;
+            }
+            ++runEnd;
+        }
+    }
+}
+
+ExrWriter::ExrWriter(const Options& options)
+    : m_options(options)
+    , m_width(0)
+    , m_height(0)
+    , m_linesPerChunk(1)
+    , m_tableOffset(0)
+    , m_pendingRows(0)
+    , m_nextRow(0)
+    , m_ok(false) {
+}
+
+ExrWriter::~ExrWriter() {
+    if ( m_file.is_open() ) {
+        close();
+    }
+}
+
+void ExrWriter::set_attribute(const std::string& name, const std::string& value) {
+    m_attributes.push_back(std::make_pair(name, value));
+}
+
+int ExrWriter::tiles_x() const {
+    return m_options.tileSize > 0 ? ( m_width + m_options.tileSize - 1 ) / m_options.tileSize : 1;
+}
+
+int ExrWriter::tiles_y() const {
+    return m_options.tileSize > 0 ? ( m_height + m_options.tileSize - 1 ) / m_options.tileSize : m_height;
+}
+
+bool ExrWriter::open(const char* path, int width, int height) {
+    m_file.open(path, std::ios::binary | std::ios::trunc);
+    if ( !m_file ) return false;
+    m_width = width;
+    m_height = height;
+    m_nextRow = 0;
+    m_pendingRows = 0;
+    m_linesPerChunk = m_options.compression == kZip ? 16 : 1;
+
+    bool tiled = m_options.tileSize > 0;
+    int chunks = tiled ? tiles_x() * tiles_y() : ( height + m_linesPerChunk - 1 ) / m_linesPerChunk;
+    m_offsets.assign(size_t(chunks), 0);
+
+    std::vector<char> h;
+    put(h, int32_t(20000630));
+    put(h, int32_t(2 | ( tiled ? 0x200 : 0 )));
+
+    // channels must be sorted by name
+    const char* channels[] = { "B", "G", "R" };
+    begin_attribute(h, "channels", "chlist", 3 * 18 + 1);
+    for ( const char* c : channels ) {
+        put_string(h, c);
+        put(h, int32_t(m_options.type));
+        put(h, int32_t(0)); // pLinear and reserved
+        put(h, int32_t(1));
+        put(h, int32_t(1));
+    }
+    h.push_back('\0');
+
+    begin_attribute(h, "compression", "compression", 1);
+    h.push_back(char(m_options.compression));
+
+    int32_t window[] = { 0, 0, width - 1, height - 1 };
+    begin_attribute(h, "dataWindow", "box2i", 16);
+    for ( int32_t v : window ) put(h, v);
+    begin_attribute(h, "displayWindow", "box2i", 16);
+    for ( int32_t v : window ) put(h, v);
+
+    // tiles may be finished out of order; scanlines always go top to bottom
+    begin_attribute(h, "lineOrder", "lineOrder", 1);
+    h.push_back(char(tiled ? 2 : 0));
+
+    begin_attribute(h, "pixelAspectRatio", "float", 4);
+    put(h, 1.0f);
+    begin_attribute(h, "screenWindowCenter", "v2f", 8);
+    put(h, 0.0f);
+    put(h, 0.0f);
+    begin_attribute(h, "screenWindowWidth", "float", 4);
+    put(h, 1.0f);
+
+    if ( tiled ) {
+        begin_attribute(h, "tiles", "tiledesc", 9);
+        put(h, uint32_t(m_options.tileSize));
+        put(h, uint32_t(m_options.tileSize));
+        h.push_back(0); // ONE_LEVEL, ROUND_DOWN
+    }
+
+    for ( auto& a : m_attributes ) {
+        begin_attribute(h, a.first.c_str(), "string", int32_t(a.second.size()));
+        h.insert(h.end(), a.second.begin(), a.second.end());
+    }
+    h.push_back('\0');
+
+    // offset table is filled in by close()
+    m_tableOffset = h.size();
+    h.resize(h.size() + m_offsets.size() * sizeof(uint64_t), 0);
+
+    m_file.write(h.data(), h.size());
+    m_ok = bool(m_file);
+    return m_ok;
+}
+
+const std::vector<unsigned char>& ExrWriter::encode(const float* rgb, size_t stride, int width, int rows,
+    Buffers& buffers) const {
+    size_t bytesPerValue = m_options.type == kHalf ? 2 : 4;
+    buffers.raw.resize(size_t(rows) * width * 3 * bytesPerValue);
+    unsigned char* out = buffers.raw.data();
+    for ( int y = 0; y < rows; ++y ) {
+        const float* row = rgb + stride * y;
+        // per line, channel by channel in B, G, R order
+        for ( int c = 2; c >= 0; --c ) {
+            for ( int x = 0; x < width; ++x ) {
+                float v = row[3 * x + c];
+                if ( m_options.type == kHalf ) {
+                    uint16_t hv = float_to_half(v);
+                    memcpy(out, &hv, 2);
+                }
+                else {
+                    memcpy(out, &v, 4);
+                }
+                out += bytesPerValue;
+            }
+        }
+    }
+
+    if ( m_options.compression == kNone ) {
+        return buffers.raw;
+    }
+
+    predict(buffers.raw, buffers.scratch);
+    if ( m_options.compression == kRle ) {
+        rle(buffers.scratch, buffers.packed);
+    }
+    else {
+        int size = 0;
+        unsigned char* z = stbi_zlib_compress(buffers.scratch.data(), int(buffers.scratch.size()), &size, ZIP_LEVEL);
+        buffers.packed.assign(z, z + size);
+        free(z);
+    }
+    // a chunk that does not shrink is stored raw; readers tell by its size
+    return buffers.packed.size() < buffers.raw.size() ? buffers.packed : buffers.raw;
+}
+
+bool ExrWriter::write_chunk(int index, const int32_t* coords, int coordCount, const std::vector<unsigned char>& data) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if ( !m_ok ) return false;
+    m_offsets[index] = uint64_t(m_file.tellp());
+    m_file.write(reinterpret_cast<const char*>( coords ), coordCount * sizeof(int32_t));
+    int32_t size = int32_t(data.size());
+    m_file.write(reinterpret_cast<const char*>( &size ), sizeof(size));
+    m_file.write(reinterpret_cast<const char*>( data.data() ), data.size());
+    m_ok = bool(m_file);
+    return m_ok;
+}
+
+bool ExrWriter::write_rows(const float* rgb, int count) {
+    if ( m_options.tileSize > 0 ) return false;
+    size_t rowFloats = size_t(m_width) * 3;
+    while ( count > 0 && m_ok ) {
+        if ( m_pendingRows == 0 && count >= m_linesPerChunk ) {
+            // whole chunks straight from the caller's rows
+            int32_t y = m_nextRow;
+            int rows = std::min(m_linesPerChunk, m_height - m_nextRow);
+            write_chunk(m_nextRow / m_linesPerChunk, &y, 1, encode(rgb, rowFloats, m_width, rows, m_buffers));
+            m_nextRow += rows;
+            rgb += rowFloats * rows;
+            count -= rows;
+            continue;
+        }
+        m_pending.insert(m_pending.end(), rgb, rgb + rowFloats);
+        ++m_pendingRows;
+        rgb += rowFloats;
+        --count;
+        if ( m_pendingRows == m_linesPerChunk || m_nextRow + m_pendingRows == m_height ) {
+            int32_t y = m_nextRow;
+            write_chunk(m_nextRow / m_linesPerChunk, &y, 1,
+                encode(m_pending.data(), rowFloats, m_width, m_pendingRows, m_buffers));
+            m_nextRow += m_pendingRows;
+            m_pendingRows = 0;
+            m_pending.clear();
+        }
+    }
+    return m_ok;
+}
+
+bool ExrWriter::write_tile(int tx, int ty, const float* rgb, size_t stride) {
+    int size = m_options.tileSize;
+    if ( size <= 0 || tx < 0 || ty < 0 || tx >= tiles_x() || ty >= tiles_y() ) return false;
+    int32_t coords[] = { tx, ty, 0, 0 };
+    int w = std::min(size, m_width - tx * size);
+    int h = std::min(size, m_height - ty * size);
+    Buffers buffers;
+    return write_chunk(ty * tiles_x() + tx, coords, 4, encode(rgb, stride, w, h, buffers));
+}
+
+bool ExrWriter::close() {
+    if ( !m_file.is_open() ) return false;
+    bool complete = true;
+    for ( uint64_t offset : m_offsets ) {
+        complete = complete && offset != 0;
+    }
+    m_file.seekp(std::streamoff(m_tableOffset));
+    m_file.write(reinterpret_cast<const char*>( m_offsets.data() ), m_offsets.size() * sizeof(uint64_t));
+    m_ok = m_ok && bool(m_file);
+    m_file.close();
+    return m_ok && complete;
+}
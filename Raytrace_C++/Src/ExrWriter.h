@@ -0,0 +1,87 @@
+#pragma once
+
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// OpenEXR writer for linear RGB: half or float channels, scanline or tiled (one level),
+// uncompressed, RLE, ZIPS or ZIP. Chunks are encoded as they arrive, so a file can be
+// streamed out without holding the whole image.
+class ExrWriter {
+public:
+    enum PixelType {
+        kHalf = 1,
+        kFloat = 2
+    };
+
+    enum Compression {
+        kNone = 0,
+        kRle = 1,
+        kZips = 2, // zlib, one scanline per chunk
+        kZip = 3   // zlib, 16 scanlines per chunk
+    };
+
+    struct Options {
+        PixelType type;
+        Compression compression;
+        int tileSize; // 0 writes scanlines
+
+        Options(PixelType t = kHalf, Compression c = kZip, int tile = 0)
+            : type(t), compression(c), tileSize(tile) {}
+    };
+
+    explicit ExrWriter(const Options& options = Options());
+    ~ExrWriter();
+
+    ExrWriter(const ExrWriter&) = delete;
+    ExrWriter& operator=(const ExrWriter&) = delete;
+
+    // extra string attribute for the header; call before open()
+    void set_attribute(const std::string& name, const std::string& value);
+
+    bool open(const char* path, int width, int height);
+
+    // Scanline files: count rows of RGB (3 floats per pixel), top to bottom, in order.
+    bool write_rows(const float* rgb, int count);
+
+    // Tiled files: tile (tx, ty) in any order. rgb is the tile's top-left pixel and
+    // stride the distance between its rows in floats. Safe to call from several threads:
+    // each encodes its tile itself and only the write to the file is serialized.
+    bool write_tile(int tx, int ty, const float* rgb, size_t stride);
+
+    // Writes the chunk offset table. False if any write failed or chunks are missing.
+    bool close();
+
+    const Options& options() const { return m_options; }
+    int tiles_x() const;
+    int tiles_y() const;
+
+private:
+    // scratch space for encoding one chunk
+    struct Buffers {
+        std::vector<unsigned char> raw;
+        std::vector<unsigned char> scratch;
+        std::vector<unsigned char> packed;
+    };
+
+    bool write_chunk(int index, const int32_t* coords, int coordCount, const std::vector<unsigned char>& data);
+    const std::vector<unsigned char>& encode(const float* rgb, size_t stride, int width, int rows,
+        Buffers& buffers) const;
+
+    Options m_options;
+    std::vector< std::pair<std::string, std::string> > m_attributes;
+    std::ofstream m_file;
+    int m_width;
+    int m_height;
+    int m_linesPerChunk;
+    std::vector<uint64_t> m_offsets;
+    uint64_t m_tableOffset;
+    std::vector<float> m_pending; // scanlines waiting for a full chunk
+    int m_pendingRows;
+    int m_nextRow;
+    bool m_ok;
+    Buffers m_buffers; // for scanlines
+    std::mutex m_mutex; // around the file, offsets and m_ok while tiles are written
+};
@@ -0,0 +1,166 @@
+#include "Film.h"
+
+#include "Image.h"
+
+#include <stb_image_write.h>
+
+Film::Film(int w, int h)
+    : m_width(w)
+    , m_height(h)
+    , m_owned(new float[( storage_size(w, h) + sizeof(float) - 1 ) / sizeof(float)]) {
+    bind(m_owned.get());
+    clear();
+}
+
+Film::Film(int w, int h, void* storage)
+    : m_width(w)
+    , m_height(h) {
+    bind(storage);
+}
+
+size_t Film::storage_size(int w, int h) {
+    size_t n = size_t(w) * h;
+    return n * ( 3 * sizeof(float) + sizeof(float) + sizeof(int) + sizeof(unsigned char) );
+}
+
+void Film::bind(void* storage) {
+    size_t n = size_t(m_width) * m_height;
+    m_sum = static_cast<float*>( storage );
+    m_lumSq = m_sum + 3 * n;
+    m_count = reinterpret_cast<int*>( m_lumSq + n );
+    m_active = reinterpret_cast<unsigned char*>( m_count + n );
+}
+
+void Film::clear() {
+    size_t n = size_t(m_width) * m_height;
+    std::fill(m_sum, m_sum + 3 * n, 0.0f);
+    std::fill(m_lumSq, m_lumSq + n, 0.0f);
+    std::fill(m_count, m_count + n, 0);
+    std::fill(m_active, m_active + n, 1);
+}
+
+void Film::copy_from(const Film& other) {
+    memcpy(m_sum, other.m_sum, storage_size(m_width, m_height));
+}
+
+void Film::blend(const Film& other, float weight) {
+    for ( size_t index = 0; index < size_t(m_width) * m_height; ++index ) {
+        float n = float(std::max(m_count[index], 1));
+        float scale = weight * n / float(std::max(other.m_count[index], 1));
+        for ( int c = 0; c < 3; ++c ) {
+            m_sum[3 * index + c] = ( 1.0f - weight ) * m_sum[3 * index + c] + scale * other.m_sum[3 * index + c];
+        }
+    }
+}
+
+void Film::merge(const Film& other) {
+    for ( size_t index = 0; index < size_t(m_width) * m_height; ++index ) {
+        for ( int c = 0; c < 3; ++c ) {
+            m_sum[3 * index + c] += other.m_sum[3 * index + c];
+        }
+        m_lumSq[index] += other.m_lumSq[index];
+        m_count[index] += other.m_count[index];
+    }
+}
+
+void Film::resolve(Image& image) const {
+    for ( int j = 0; j < m_height; ++j ) {
+        for ( int i = 0; i < m_width; ++i ) {
+            Vector3 c = average(i, j);
+            image.write(i, ( m_height - j - 1 ), c.getX(), c.getY(), c.getZ());
+        }
+    }
+}
+
+float Film::relative_error(int x, int y) const {
+    size_t index = size_t(m_width) * y + x;
+    int n = m_count[index];
+    if ( n < 2 ) return FLT_MAX;
+    float mean = luminance(average(x, y));
+    float variance = std::max(0.0f, ( m_lumSq[index] - n * pow2(mean) ) / float(n - 1));
+    return sqrtf(variance / n) / ( mean + 0.01f );
+}
+
+int Film::update_convergence(float threshold, int minSamples) {
+    std::vector<unsigned char> noisy(size_t(m_width) * m_height);
+    for ( int j = 0; j < m_height; ++j ) {
+        for ( int i = 0; i < m_width; ++i ) {
+            size_t index = size_t(m_width) * j + i;
+            noisy[index] = m_active[index] &&
+                ( m_count[index] < minSamples || relative_error(i, j) > threshold );
+        }
+    }
+
+    int count = 0;
+    for ( int j = 0; j < m_height; ++j ) {
+        for ( int i = 0; i < m_width; ++i ) {
+            size_t index = size_t(m_width) * j + i;
+            if ( !m_active[index] ) continue;
+            bool keep = false;
+            for ( int y = std::max(j - 1, 0); y <= std::min(j + 1, m_height - 1) && !keep; ++y ) {
+                for ( int x = std::max(i - 1, 0); x <= std::min(i + 1, m_width - 1) && !keep; ++x ) {
+                    keep = noisy[size_t(m_width) * y + x] != 0;
+                }
+            }
+            m_active[index] = keep;
+            count += keep;
+        }
+    }
+    return count;
+}
+
+float Film::relative_rmse() const {
+    double sum = 0;
+    for ( int j = 0; j < m_height; ++j ) {
+        for ( int i = 0; i < m_width; ++i ) {
+            float e = relative_error(i, j);
+            if ( e == FLT_MAX ) return FLT_MAX;
+            sum += double(e) * e;
+        }
+    }
+    return float(sqrt(sum / ( double(m_width) * m_height )));
+}
+
+long long Film::equal_error_samples() const {
+    // with n samples everywhere the mean square relative error is the mean per-sample
+    // variance over n; n is chosen to match the mean square error reached
+    double variance = 0, error = 0;
+    for ( int j = 0; j < m_height; ++j ) {
+        for ( int i = 0; i < m_width; ++i ) {
+            float e = relative_error(i, j);
+            if ( e == FLT_MAX ) return 0;
+            variance += double(e) * e * m_count[size_t(m_width) * j + i];
+            error += double(e) * e;
+        }
+    }
+    return error > 0 ? (long long)( variance / error * ( double(m_width) * m_height ) ) : 0;
+}
+
+long long Film::total_samples() const {
+    long long total = 0;
+    for ( size_t i = 0; i < size_t(m_width) * m_height; ++i ) total += m_count[i];
+    return total;
+}
+
+int Film::max_samples() const {
+    int m = 0;
+    for ( size_t i = 0; i < size_t(m_width) * m_height; ++i ) m = std::max(m, m_count[i]);
+    return m;
+}
+
+void Film::write_spp_heatmap(const char* fileName, int maxSpp) const {
+    std::vector<unsigned char> rgb(size_t(m_width) * m_height * 3);
+    for ( int j = 0; j < m_height; ++j ) {
+        for ( int i = 0; i < m_width; ++i ) {
+            float t = saturate(float(samples(i, j)) / float(std::max(maxSpp, 1)));
+            Vector3 c = t < 0.5f
+                ? lerp(2.0f * t, Vector3(0.0f, 0.0f, 1.0f), Vector3(0.0f, 1.0f, 0.0f))
+                : lerp(2.0f * t - 1.0f, Vector3(0.0f, 1.0f, 0.0f), Vector3(1.0f, 0.0f, 0.0f));
+            unsigned char* p = &rgb[3 * ( size_t(m_width) * ( m_height - j - 1 ) + i )];
+            p[0] = static_cast<unsigned char>( c.getX() * 255.99f );
+            p[1] = static_cast<unsigned char>( c.getY() * 255.99f );
+            p[2] = static_cast<unsigned char>( c.getZ() * 255.99f );
+        }
+    }
+    stbi_write_bmp(fileName, m_width, m_height, 3, rgb.data());
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+class Image;
+
+// Linear HDR accumulation buffer: running radiance sums and sample counts per pixel.
+// Progressive passes add into it and any number of snapshots can be resolved from it.
+// The sum of squared sample luminance is kept as well, giving a per-pixel variance
+// estimate that drives adaptive sampling.
+// All state lives in one flat block, either owned by the film or supplied by the caller
+// (a checkpoint's memory-mapped file), so it can be copied and persisted as a whole.
+class Film {
+public:
+    Film(int w, int h);
+    Film(int w, int h, void* storage); // storage_size(w, h) bytes, not owned, contents kept
+
+    static size_t storage_size(int w, int h);
+    const void* storage() const { return m_sum; }
+
+    void clear();
+    void copy_from(const Film& other);
+
+    // Every pixel's average becomes ( 1 - weight ) times its own plus weight times other's;
+    // sample counts and variance estimates stay this film's.
+    void blend(const Film& other, float weight);
+
+    // adds other's samples, sums and variance estimates to this film's
+    void merge(const Film& other);
+
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+
+    // sum of count samples, and the sum of their squared luminances
+    void add(int x, int y, const Vector3& sum, float lumSq, int count) {
+        size_t index = size_t(m_width) * y + x;
+        m_sum[3 * index + 0] += sum.getX();
+        m_sum[3 * index + 1] += sum.getY();
+        m_sum[3 * index + 2] += sum.getZ();
+        m_lumSq[index] += lumSq;
+        m_count[index] += count;
+    }
+
+    int samples(int x, int y) const { return m_count[size_t(m_width) * y + x]; }
+
+    Vector3 average(int x, int y) const {
+        size_t index = size_t(m_width) * y + x;
+        float n = float(std::max(m_count[index], 1));
+        return Vector3(m_sum[3 * index + 0], m_sum[3 * index + 1], m_sum[3 * index + 2]) / n;
+    }
+
+    // standard error of the pixel's mean luminance relative to that mean
+    float relative_error(int x, int y) const;
+
+    // false once the pixel has converged and should receive no more samples
+    bool active(int x, int y) const { return m_active[size_t(m_width) * y + x] != 0; }
+
+    // Marks pixels whose relative error is below threshold (after at least minSamples) as
+    // converged. A pixel keeps sampling while any pixel in its 3x3 neighbourhood is still
+    // noisy, which guards against a lucky low-variance estimate. Returns the active count.
+    int update_convergence(float threshold, int minSamples);
+
+    // root mean square of relative_error over the frame: the global convergence estimate
+    float relative_rmse() const;
+    // samples a uniform render would need to reach the same relative_rmse, from each pixel's
+    // per-sample variance (relative_error squared times its count); 0 while that is unknown
+    long long equal_error_samples() const;
+
+    long long total_samples() const;
+    int max_samples() const;
+
+    // averages into an LDR image; film rows run bottom-up like the camera's v axis
+    void resolve(Image& image) const;
+
+    // false-colour map of samples per pixel (blue: few, red: maxSpp)
+    void write_spp_heatmap(const char* fileName, int maxSpp) const;
+
+private:
+    void bind(void* storage);
+
+    int m_width;
+    int m_height;
+    std::unique_ptr<float[]> m_owned;
+    float* m_sum;
+    float* m_lumSq;
+    int* m_count;
+    unsigned char* m_active;
+};
+
+inline float luminance(const Vector3& c) {
+    return 0.2126f * c.getX() + 0.7152f * c.getY() + 0.0722f * c.getZ();
+}
@@ -2,6 +2,7 @@
 
 #include "Ray.h"
 #include "HitRec.h"
+#include "LightBounds.h"
 
 bool FlipNormals::hit(const Ray& r, float t0, float t1, HitRec& hrec) const {
     if ( m_shape->hit(r, t0, t1, hrec) ) {
@@ -12,3 +13,16 @@ bool FlipNormals::hit(const Ray& r, float t0, float t1, HitRec& hrec) const {
         return false;
     }
 }
+
+void FlipNormals::sample_area(HitRec& hrec) const {
+    m_shape->sample_area(hrec);
+    hrec.n = -hrec.n;
+}
+
+bool FlipNormals::light_bounds(LightBounds& b) const {
+    if ( !m_shape->light_bounds(b) ) {
+        return false;
+    }
+    b.axis = -b.axis;
+    return true;
+}
@@ -0,0 +1,36 @@
+#include "GBuffer.h"
+
+#include "Image.h"
+
+GBuffer::GBuffer(int w, int h)
+    : m_width(w)
+    , m_height(h)
+    , m_data(size_t(kChannels) * w * h, 0.0f) {
+}
+
+void GBuffer::write(int x, int y, const Vector3& albedo, const Vector3& normal, float depth) {
+    size_t n = size_t(m_width) * m_height;
+    size_t index = size_t(m_width) * y + x;
+    float len = length(normal);
+    Vector3 nrm = len >= 0.1f ? normal / len : Vector3(0);
+    m_data[kAlbedoR * n + index] = albedo.getX();
+    m_data[kAlbedoG * n + index] = albedo.getY();
+    m_data[kAlbedoB * n + index] = albedo.getZ();
+    m_data[kNormalX * n + index] = nrm.getX();
+    m_data[kNormalY * n + index] = nrm.getY();
+    m_data[kNormalZ * n + index] = nrm.getZ();
+    m_data[kDepth * n + index] = len >= 0.1f ? depth : 0.0f;
+}
+
+void GBuffer::resolve(Channel first, Image& image) const {
+    const float* c[3];
+    for ( int k = 0; k < 3; ++k ) {
+        c[k] = plane(first == kDepth ? kDepth : Channel(first + k));
+    }
+    for ( int y = 0; y < m_height; ++y ) {
+        for ( int x = 0; x < m_width; ++x ) {
+            size_t index = size_t(m_width) * y + x;
+            image.write(x, y, c[0][index], c[1][index], c[2][index]);
+        }
+    }
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <vector>
+
+class Image;
+
+// First-hit auxiliary buffers (AOVs) that guide the denoiser: albedo, normal and the
+// distance from the camera. Each channel is a separate plane so the filter can load four
+// neighbouring pixels at once; rows run top to bottom like Image.
+// A pixel that saw only the background has a zero normal and depth.
+class GBuffer {
+public:
+    enum Channel {
+        kAlbedoR,
+        kAlbedoG,
+        kAlbedoB,
+        kNormalX,
+        kNormalY,
+        kNormalZ,
+        kDepth,
+        kChannels
+    };
+
+    GBuffer(int w, int h);
+
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+
+    const float* plane(Channel c) const { return &m_data[size_t(c) * m_width * m_height]; }
+
+    // averages of the pixel's samples; the normal is renormalized, or zeroed when the
+    // samples disagree too much to have one
+    void write(int x, int y, const Vector3& albedo, const Vector3& normal, float depth);
+
+    // albedo, normal (as -1..1) or depth (grey) as an image, for writing out
+    void resolve(Channel first, Image& image) const;
+
+private:
+    int m_width;
+    int m_height;
+    std::vector<float> m_data;
+};
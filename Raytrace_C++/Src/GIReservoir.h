@@ -0,0 +1,44 @@
+#pragma once
+
+// Weighted reservoir over secondary-bounce samples (ReSTIR GI): the point a path from a
+// pixel's first diffuse hit reached and the radiance it carried back from there. Another
+// pixel reuses a sample by reconnecting its own first hit to that point.
+struct GIReservoir {
+    Vector3 point;    // the chosen sample's secondary hit
+    Vector3 normal;   // surface normal there
+    Vector3 radiance; // outgoing radiance there towards the vertex that traced it
+    bool diffuse;     // false if that radiance depends on the direction; such samples are not reused
+    float wSum;       // sum of candidate weights
+    float M;          // number of candidates seen
+    float W;          // contribution weight of the chosen sample: wSum / (M * target)
+
+    void reset() {
+        wSum = 0;
+        M = 0;
+        W = 0;
+    }
+
+    // adds one candidate; u is uniform in [0, 1)
+    bool update(const Vector3& p, const Vector3& n, const Vector3& lo, bool d, float weight, float u) {
+        wSum += weight;
+        M += 1;
+        if ( weight > 0 && u * wSum < weight ) {
+            point = p;
+            normal = n;
+            radiance = lo;
+            diffuse = d;
+            return true;
+        }
+        return false;
+    }
+
+    // adds another pixel's reservoir; target is its sample's target value here, jacobian the
+    // change of solid angle from that pixel's vertex to this one, count caps how many
+    // candidates it stands for
+    bool merge(const GIReservoir& other, float target, float jacobian, float count, float u) {
+        float M0 = M;
+        bool taken = update(other.point, other.normal, other.radiance, other.diffuse, target * jacobian * other.W * count, u);
+        M = M0 + count;
+        return taken;
+    }
+};
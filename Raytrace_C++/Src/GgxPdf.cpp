@@ -0,0 +1,55 @@
+#include "GgxPdf.h"
+
+#include "HitRec.h"
+#include "ONB.h"
+
+float GgxPdf::distribution(float cosTheta, float alpha) {
+    if ( cosTheta <= 0 ) {
+        return 0;
+    }
+    float a2 = alpha * alpha;
+    float d = cosTheta * cosTheta * ( a2 - 1 ) + 1;
+    return a2 / ( PI * d * d );
+}
+
+float GgxPdf::lambda(float cosTheta, float alpha) {
+    float c2 = std::max(cosTheta * cosTheta, 1e-12f);
+    float tan2 = ( 1 - c2 ) / c2;
+    return 0.5f * ( sqrtf(1 + alpha * alpha * tan2) - 1 );
+}
+
+float GgxPdf::value(const HitRec& hrec, const Vector3& direction) const {
+    Vector3 wi = normalize(direction);
+    float cosO = dot(hrec.wo, hrec.n);
+    float cosI = dot(wi, hrec.n);
+    if ( cosO <= 0 || cosI <= 0 ) {
+        return 0;
+    }
+    Vector3 h = normalize(hrec.wo + wi);
+    return distribution(dot(h, hrec.n), m_alpha) / ( ( 1 + lambda(cosO, m_alpha) ) * 4 * cosO );
+}
+
+Vector3 GgxPdf::generate(const HitRec& hrec) const {
+    ONB uvw;
+    uvw.build_from_w(hrec.n);
+    const Vector3& wo = hrec.wo;
+    Vector3 v(dot(wo, uvw.u()), dot(wo, uvw.v()), dot(wo, uvw.w()));
+
+    // the view direction where the microfacets are a hemisphere, and a frame around it
+    Vector3 vh = normalize(Vector3(m_alpha * v.getX(), m_alpha * v.getY(), v.getZ()));
+    float lenSq = pow2(vh.getX()) + pow2(vh.getY());
+    Vector3 t1 = lenSq > 0 ? Vector3(-vh.getY(), vh.getX(), 0) / sqrtf(lenSq) : Vector3(1, 0, 0);
+    Vector3 t2 = cross(vh, t1);
+
+    // a point on the disc the hemisphere projects to, squeezed onto its visible part
+    float r = sqrtf(drand48());
+    float phi = PI2 * drand48();
+    float p1 = r * cosf(phi);
+    float p2 = r * sinf(phi);
+    float s = 0.5f * ( 1 + vh.getZ() );
+    p2 = ( 1 - s ) * sqrtf(std::max(1 - p1 * p1, 0.0f)) + s * p2;
+    Vector3 nh = p1 * t1 + p2 * t2 + sqrtf(std::max(1 - p1 * p1 - p2 * p2, 0.0f)) * vh;
+
+    Vector3 h = uvw.local(normalize(Vector3(m_alpha * nh.getX(), m_alpha * nh.getY(), std::max(nh.getZ(), 0.0f))));
+    return 2 * dot(wo, h) * h - wo;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "PDF.h"
+
+// Directions reflected off GGX (Trowbridge-Reitz) microfacets, sampled from the normals
+// visible from hrec.wo (Heitz 2018): the distribution is stretched into a hemisphere, the
+// disc it projects to as seen from wo is sampled, and the normal found is stretched back.
+// No samples go to microfacets facing away; the view direction mirrored about the normal has
+// density G1(wo) * D(h) / ( 4 * cos(theta_o) ). Directions below the surface have density 0.
+class GgxPdf : public Pdf {
+public:
+    // alpha: width of the distribution, the square of the roughness
+    explicit GgxPdf(float alpha) : m_alpha(alpha) {}
+
+    virtual float value(const HitRec& hrec, const Vector3& direction) const override;
+
+    virtual Vector3 generate(const HitRec& hrec) const override;
+
+    // density D of microfacet normals at cos(theta) to the surface normal
+    static float distribution(float cosTheta, float alpha);
+    // Smith's lambda of a direction at cos(theta) to the normal; G1 = 1 / ( 1 + lambda )
+    static float lambda(float cosTheta, float alpha);
+
+private:
+    float m_alpha;
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "PDF.h"
+#include "PathGuide.h"
+
+// The material's pdf mixed with a path guiding region's learned incident radiance, in the
+// proportion the region learned. Just the material's pdf where there is no region, or its
+// guide is still empty. Regions span surfaces facing different ways, so guide directions
+// below the surface are mirrored above it instead of being wasted; every non-specular
+// material only reflects.
+class GuidedPdf : public Pdf {
+public:
+    GuidedPdf(const Pdf* bsdf, const PathGuide::Region* region)
+        : m_bsdf(bsdf)
+        , m_guide(region && region->guide.total() > 0 ? &region->guide : nullptr)
+        , m_fraction(m_guide ? region->bsdfFraction : 1.0f) {
+    }
+
+    bool guided() const { return m_guide != nullptr; }
+
+    float bsdf_value(const HitRec& hrec, const Vector3& direction) const {
+        return m_bsdf->value(hrec, direction);
+    }
+
+    float guide_value(const HitRec& hrec, const Vector3& direction) const {
+        if ( !m_guide ) return 0;
+        float c = dot(direction, hrec.n);
+        if ( c <= 0 ) return 0;
+        return m_guide->pdf(direction) + m_guide->pdf(direction - 2.0f * c * hrec.n);
+    }
+
+    virtual float value(const HitRec& hrec, const Vector3& direction) const override {
+        float v = m_fraction * m_bsdf->value(hrec, direction);
+        if ( m_guide ) {
+            v += ( 1.0f - m_fraction ) * guide_value(hrec, direction);
+        }
+        return v;
+    }
+
+    virtual Vector3 generate(const HitRec& hrec) const override {
+        if ( m_guide && drand48() >= m_fraction ) {
+            Vector3 d = m_guide->sample();
+            float c = dot(d, hrec.n);
+            return c < 0 ? d - 2.0f * c * hrec.n : d;
+        }
+        return m_bsdf->generate(hrec);
+    }
+
+private:
+    const Pdf* m_bsdf;
+    const DirectionalTree* m_guide;
+    float m_fraction;
+};
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+// IEEE 754 binary16, as stored in half-float EXR channels.
+// Rounds to nearest even; overflow goes to infinity and NaN stays NaN.
+inline uint16_t float_to_half(float value) {
+    uint32_t f;
+    memcpy(&f, &value, sizeof(f));
+    uint32_t sign = f & 0x80000000u;
+    f ^= sign;
+
+    uint16_t h;
+    if ( f >= ( 127u + 16u ) << 23 ) {
+        h = f > 0x7f800000u ? 0x7e00 : 0x7c00;
+    }
+    else if ( f < 113u << 23 ) {
+        // denormal or zero: let the FPU align the mantissa by adding a magic number
+        const uint32_t magicBits = ( ( 127u - 15u ) + ( 23u - 10u ) + 1u ) << 23;
+        float magic, v;
+        memcpy(&magic, &magicBits, sizeof(magic));
+        memcpy(&v, &f, sizeof(v));
+        v += magic;
+        memcpy(&f, &v, sizeof(f));
+        h = uint16_t(f - magicBits);
+    }
+    else {
+        uint32_t odd = ( f >> 13 ) & 1;
+        f += ( uint32_t(15 - 127) << 23 ) + 0xfff + odd;
+        h = uint16_t(f >> 13);
+    }
+    return uint16_t(h | ( sign >> 16 ));
+}
@@ -6,5 +6,6 @@ struct HitRec {
 	float v; // texture coordinateY
 	Vector3 p; // hit point
 	Vector3 n; // normal
+	Vector3 wo; // unit, back along the ray that hit
 	MaterialPtr mat; // material
 };
\ No newline at end of file
@@ -0,0 +1,34 @@
+#include "Image.h"
+
+#include "ExrWriter.h"
+
+#include <fstream>
+#include <string>
+
+bool Image::write_pfm(const char* path) const {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if ( !file ) return false;
+    // negative scale marks little endian; rows go bottom to top
+    std::string header = "PF\n" + std::to_string(m_width) + " " + std::to_string(m_height) + "\n-1.0\n";
+    file.write(header.data(), header.size());
+    for ( int y = m_height - 1; y >= 0; --y ) {
+        file.write(reinterpret_cast<const char*>( &m_hdr[3 * size_t(m_width) * y] ), 3 * m_width * sizeof(float));
+    }
+    return bool(file);
+}
+
+bool Image::write_exr(const char* path, ExrWriter& writer) const {
+    if ( !writer.open(path, m_width, m_height) ) return false;
+    if ( writer.options().tileSize > 0 ) {
+        int size = writer.options().tileSize;
+        for ( int ty = 0; ty < writer.tiles_y(); ++ty ) {
+            for ( int tx = 0; tx < writer.tiles_x(); ++tx ) {
+                writer.write_tile(tx, ty, &m_hdr[3 * ( size_t(m_width) * ty * size + tx * size )], 3 * size_t(m_width));
+            }
+        }
+    }
+    else {
+        writer.write_rows(m_hdr.get(), m_height);
+    }
+    return writer.close();
+}
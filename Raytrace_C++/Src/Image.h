@@ -1,10 +1,11 @@
 #pragma once
 
-#include "ImageFilter.h"
-#include "GammaFilter.h"
-#include "TonemapFilter.h"
-#include "DenanFilter.h"
+#include "PostProcess.h"
 
+class ExrWriter;
+
+// Linear float framebuffer. The post-process (exposure, tone mapping, encode) runs only
+// when an 8-bit copy is made for LDR formats; EXR and PFM get the linear values.
 class Image {
 public:
     struct rgb {
@@ -13,35 +14,43 @@ public:
         unsigned char b;
     };
 
-    Image() : m_pixels(nullptr) {}
+    Image() : m_hdr(nullptr), m_pixels(nullptr) {}
     Image(int w, int h) {
         m_width = w;
         m_height = h;
-        m_pixels.reset(new rgb[m_width * m_height]);
-        m_filters.push_back(std::make_unique<DenanFilter>());
-        m_filters.push_back(std::make_unique<GammaFilter>(GAMMA_FACTOR));
-        m_filters.push_back(std::make_unique<TonemapFilter>());
+        m_hdr.reset(new float[3 * size_t(m_width) * m_height]);
+        m_pixels.reset(new rgb[size_t(m_width) * m_height]);
     }
 
     int width() const { return m_width; }
     int height() const { return m_height; }
-    void* pixels() const { return m_pixels.get(); }
+
+    // linear RGB, 3 floats per pixel, rows top to bottom
+    const float* hdr() const { return m_hdr.get(); }
+    float* hdr() { return m_hdr.get(); }
+
+    // 8-bit RGB after the post-process, for BMP/PNG
+    const void* pixels() {
+        m_post.run(m_hdr.get(), reinterpret_cast<unsigned char*>( m_pixels.get() ), m_width, m_height);
+        return m_pixels.get();
+    }
+
+    PostProcess& post_process() { return m_post; }
 
     void write(int x, int y, float r, float g, float b) {
-        Vector3 c(r, g, b);
-        for ( auto& f : m_filters ) {
-            c = f->filter(c);
-        }
-        int index = m_width * y + x;
-        m_pixels[index].r = static_cast<unsigned char>( c.getX() * 255.99f );
-        m_pixels[index].g = static_cast<unsigned char>( c.getY() * 255.99f );
-        m_pixels[index].b = static_cast<unsigned char>( c.getZ() * 255.99f );
+        float* p = &m_hdr[3 * ( size_t(m_width) * y + x )];
+        p[0] = r;
+        p[1] = g;
+        p[2] = b;
     }
 
+    bool write_pfm(const char* path) const;
+    bool write_exr(const char* path, ExrWriter& writer) const;
+
 private:
     int m_width;
     int m_height;
+    std::unique_ptr<float[]> m_hdr;
     std::unique_ptr<rgb[]> m_pixels;
-    std::vector< std::unique_ptr<ImageFilter> > m_filters;
+    PostProcess m_post;
 };
-
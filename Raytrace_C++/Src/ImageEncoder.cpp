@@ -0,0 +1,323 @@
+#include "ImageEncoder.h"
+
+#include "ThreadPool.h"
+#include "Deflate.h"
+
+#include <stb_image_write.h>
+
+#include <chrono>
+#include <fstream>
+#include <future>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+    // raw bytes per deflate chunk; small enough to spread a frame across all threads
+    const size_t PNG_CHUNK_BYTES = 256 * 1024;
+
+    void put_be32(std::vector<unsigned char>& out, uint32_t v) {
+        out.push_back(static_cast<unsigned char>( v >> 24 ));
+        out.push_back(static_cast<unsigned char>( v >> 16 ));
+        out.push_back(static_cast<unsigned char>( v >> 8 ));
+        out.push_back(static_cast<unsigned char>( v ));
+    }
+
+    int paeth(int a, int b, int c) {
+        int p = a + b - c;
+        int pa = abs(p - a);
+        int pb = abs(p - b);
+        int pc = abs(p - c);
+        if ( pa <= pb && pa <= pc ) return a;
+        return pb <= pc ? b : c;
+    }
+
+    void write_bytes(void* context, void* data, int size) {
+        std::vector<unsigned char>* out = static_cast<std::vector<unsigned char>*>( context );
+        const unsigned char* bytes = static_cast<const unsigned char*>( data );
+        out->insert(out->end(), bytes, bytes + size);
+    }
+}
+
+ImageEncoder::ImageEncoder(int numThreads)
+    : m_numThreads(numThreads)
+    , m_busy(false)
+    , m_stop(false) {
+    m_stats.frames = 0;
+    m_stats.dropped = 0;
+    m_stats.seconds = 0;
+    m_stats.bytes = 0;
+    m_thread = std::thread([this] { run(); });
+}
+
+ImageEncoder::~ImageEncoder() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cond.notify_all();
+    m_thread.join();
+}
+
+ThreadPool& ImageEncoder::pool() {
+    if ( !m_pool ) {
+        m_pool = std::make_unique<ThreadPool>(m_numThreads);
+    }
+    return *m_pool;
+}
+
+ImageEncoder::Format ImageEncoder::format_for(const std::string& path) {
+    size_t dot = path.find_last_of('.');
+    std::string ext = dot == std::string::npos ? "" : path.substr(dot + 1);
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](char c) { return char(tolower(c)); });
+    if ( ext == "png" ) return kPng;
+    if ( ext == "qoi" ) return kQoi;
+    return kBmp;
+}
+
+void ImageEncoder::submit(const std::string& path, int width, int height, std::vector<unsigned char> rgb) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto queued = std::find_if(m_jobs.begin(), m_jobs.end(), [&](const Job& j) { return j.path == path; });
+        if ( queued != m_jobs.end() ) {
+            queued->width = width;
+            queued->height = height;
+            queued->rgb.swap(rgb);
+            ++m_stats.dropped;
+            return;
+        }
+        Job job = { path, width, height, std::move(rgb) };
+        m_jobs.push_back(std::move(job));
+    }
+    m_cond.notify_one();
+}
+
+void ImageEncoder::wait() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_idle.wait(lock, [this] { return m_jobs.empty() && !m_busy; });
+}
+
+ImageEncoder::Stats ImageEncoder::stats() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+void ImageEncoder::run() {
+    typedef std::chrono::steady_clock Clock;
+    std::vector<unsigned char> encoded;
+    for ( ;;) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cond.wait(lock, [this] { return m_stop || !m_jobs.empty(); });
+            if ( m_jobs.empty() ) {
+                return;
+            }
+            job = std::move(m_jobs.front());
+            m_jobs.pop_front();
+            m_busy = true;
+        }
+
+        Clock::time_point start = Clock::now();
+        encoded.clear();
+        bool ok = encode(format_for(job.path), job.rgb.data(), job.width, job.height, encoded);
+        if ( ok ) {
+            std::ofstream file(job.path, std::ios::binary | std::ios::trunc);
+            ok = file.write(reinterpret_cast<const char*>( encoded.data() ), encoded.size()).good();
+        }
+        if ( !ok ) {
+            std::cerr << "ImageEncoder: failed to write " << job.path << std::endl;
+        }
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stats.frames += 1;
+            m_stats.seconds += seconds;
+            m_stats.bytes += encoded.size();
+            m_busy = false;
+        }
+        m_idle.notify_all();
+    }
+}
+
+bool ImageEncoder::encode(Format format, const unsigned char* rgb, int width, int height, std::vector<unsigned char>& out) {
+    switch ( format ) {
+        case kPng:
+            return encode_png(rgb, width, height, out);
+        case kQoi:
+            encode_qoi(rgb, width, height, out);
+            return true;
+        default:
+            encode_bmp(rgb, width, height, out);
+            return true;
+    }
+}
+
+void ImageEncoder::png_header(std::vector<unsigned char>& out, int width, int height) {
+    static const unsigned char signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    out.insert(out.end(), signature, signature + sizeof(signature));
+
+    std::vector<unsigned char> ihdr;
+    put_be32(ihdr, uint32_t(width));
+    put_be32(ihdr, uint32_t(height));
+    unsigned char format[] = { 8, 2, 0, 0, 0 }; // 8-bit RGB, deflate, adaptive filters, no interlace
+    ihdr.insert(ihdr.end(), format, format + sizeof(format));
+    png_chunk(out, "IHDR", ihdr.data(), ihdr.size());
+}
+
+void ImageEncoder::png_chunk(std::vector<unsigned char>& out, const char* type, const unsigned char* data, size_t size) {
+    put_be32(out, uint32_t(size));
+    size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    if ( size > 0 ) {
+        out.insert(out.end(), data, data + size);
+    }
+    put_be32(out, Deflate::crc32(&out[start], size + 4));
+}
+
+void ImageEncoder::png_filter_row(const unsigned char* row, const unsigned char* above, int bytes, unsigned char* out) {
+    std::vector<unsigned char> trial(bytes);
+    long best = -1;
+    for ( int f = 0; f < 5; ++f ) {
+        long cost = 0;
+        for ( int i = 0; i < bytes; ++i ) {
+            int a = i >= 3 ? row[i - 3] : 0;
+            int b = above ? above[i] : 0;
+            int c = above && i >= 3 ? above[i - 3] : 0;
+            int pred = 0;
+            switch ( f ) {
+                case 1: pred = a; break;
+                case 2: pred = b; break;
+                case 3: pred = ( a + b ) >> 1; break;
+                case 4: pred = paeth(a, b, c); break;
+            }
+            unsigned char r = static_cast<unsigned char>( row[i] - pred );
+            trial[i] = r;
+            cost += abs(int(static_cast<signed char>( r )));
+        }
+        if ( best < 0 || cost < best ) {
+            best = cost;
+            out[0] = static_cast<unsigned char>( f );
+            memcpy(out + 1, trial.data(), bytes);
+        }
+    }
+}
+
+bool ImageEncoder::encode_png(const unsigned char* rgb, int width, int height, std::vector<unsigned char>& out) {
+    int rowBytes = 3 * width;
+    int rowsPerChunk = int(std::max<size_t>(1, PNG_CHUNK_BYTES / ( rowBytes + 1 )));
+    int chunks = ( height + rowsPerChunk - 1 ) / rowsPerChunk;
+
+    // each chunk is filtered and deflated on its own; the deflate streams are joined with
+    // sync flushes and the adler32 is stitched together from the per-chunk sums
+    struct Chunk {
+        std::vector<unsigned char> deflated;
+        uint32_t adler;
+        size_t rawSize;
+    };
+    std::vector<Chunk> parts(chunks);
+    std::vector< std::future<void> > pending;
+    for ( int c = 0; c < chunks; ++c ) {
+        pending.push_back(pool().enqueue([=, &parts] {
+            int y0 = c * rowsPerChunk;
+            int y1 = std::min(y0 + rowsPerChunk, height);
+            std::vector<unsigned char> filtered(size_t(y1 - y0) * ( rowBytes + 1 ));
+            for ( int y = y0; y < y1; ++y ) {
+                const unsigned char* row = rgb + size_t(rowBytes) * y;
+                png_filter_row(row, y > 0 ? row - rowBytes : nullptr, rowBytes, &filtered[size_t(y - y0) * ( rowBytes + 1 )]);
+            }
+            Chunk& part = parts[c];
+            Deflate::compress(filtered.data(), filtered.size(), c == chunks - 1, part.deflated);
+            part.adler = Deflate::adler32(filtered.data(), filtered.size());
+            part.rawSize = filtered.size();
+        }));
+    }
+    for ( auto& p : pending ) {
+        p.get();
+    }
+
+    png_header(out, width, height);
+
+    uint32_t adler = 1;
+    std::vector<unsigned char> idat;
+    for ( int c = 0; c < chunks; ++c ) {
+        idat.clear();
+        if ( c == 0 ) {
+            idat.push_back(0x78);
+            idat.push_back(0x01);
+        }
+        idat.insert(idat.end(), parts[c].deflated.begin(), parts[c].deflated.end());
+        adler = Deflate::adler32_combine(adler, parts[c].adler, parts[c].rawSize);
+        if ( c == chunks - 1 ) {
+            put_be32(idat, adler);
+        }
+        png_chunk(out, "IDAT", idat.data(), idat.size());
+    }
+    png_chunk(out, "IEND", nullptr, 0);
+    return chunks > 0;
+}
+
+void ImageEncoder::encode_qoi(const unsigned char* rgb, int width, int height, std::vector<unsigned char>& out) {
+    static const unsigned char magic[] = { 'q', 'o', 'i', 'f' };
+    out.insert(out.end(), magic, magic + 4);
+    put_be32(out, uint32_t(width));
+    put_be32(out, uint32_t(height));
+    out.push_back(3); // RGB
+    out.push_back(0); // sRGB
+
+    struct Pixel {
+        unsigned char r, g, b, a;
+    };
+    Pixel index[64] = {};
+    Pixel prev = { 0, 0, 0, 255 };
+    int run = 0;
+    size_t count = size_t(width) * height;
+    for ( size_t i = 0; i < count; ++i ) {
+        Pixel px = { rgb[3 * i], rgb[3 * i + 1], rgb[3 * i + 2], 255 };
+        if ( px.r == prev.r && px.g == prev.g && px.b == prev.b ) {
+            ++run;
+            if ( run == 62 || i == count - 1 ) {
+                out.push_back(static_cast<unsigned char>( 0xc0 | ( run - 1 ) ));
+                run = 0;
+            }
+            continue;
+        }
+        if ( run > 0 ) {
+            out.push_back(static_cast<unsigned char>( 0xc0 | ( run - 1 ) ));
+            run = 0;
+        }
+
+        int slot = ( px.r * 3 + px.g * 5 + px.b * 7 + px.a * 11 ) % 64;
+        if ( index[slot].r == px.r && index[slot].g == px.g && index[slot].b == px.b && index[slot].a == px.a ) {
+            out.push_back(static_cast<unsigned char>( slot ));
+        }
+        else {
+            index[slot] = px;
+            signed char dr = static_cast<signed char>( px.r - prev.r );
+            signed char dg = static_cast<signed char>( px.g - prev.g );
+            signed char db = static_cast<signed char>( px.b - prev.b );
+            signed char drg = static_cast<signed char>( dr - dg );
+            signed char dbg = static_cast<signed char>( db - dg );
+            if ( dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1 ) {
+                out.push_back(static_cast<unsigned char>( 0x40 | ( dr + 2 ) << 4 | ( dg + 2 ) << 2 | ( db + 2 ) ));
+            }
+            else if ( dg >= -32 && dg <= 31 && drg >= -8 && drg <= 7 && dbg >= -8 && dbg <= 7 ) {
+                out.push_back(static_cast<unsigned char>( 0x80 | ( dg + 32 ) ));
+                out.push_back(static_cast<unsigned char>( ( drg + 8 ) << 4 | ( dbg + 8 ) ));
+            }
+            else {
+                out.push_back(0xfe);
+                out.push_back(px.r);
+                out.push_back(px.g);
+                out.push_back(px.b);
+            }
+        }
+        prev = px;
+    }
+    static const unsigned char end[] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+    out.insert(out.end(), end, end + sizeof(end));
+}
+
+void ImageEncoder::encode_bmp(const unsigned char* rgb, int width, int height, std::vector<unsigned char>& out) {
+    stbi_write_bmp_to_func(write_bytes, &out, width, height, 3, rgb);
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+class ThreadPool;
+
+// Writes 8-bit RGB images on a background thread so rendering carries on while
+// snapshots are encoded. The format follows the file extension: .png is deflated in
+// row chunks on a thread pool, .qoi is QOI, anything else is BMP.
+class ImageEncoder {
+public:
+    enum Format {
+        kBmp,
+        kPng,
+        kQoi
+    };
+
+    struct Stats {
+        int frames;
+        int dropped;  // snapshots replaced by a newer one before they were written
+        double seconds; // spent encoding and writing, on the encoder thread
+        size_t bytes;
+    };
+
+    explicit ImageEncoder(int numThreads = 0);
+    ~ImageEncoder();
+
+    ImageEncoder(const ImageEncoder&) = delete;
+    ImageEncoder& operator=(const ImageEncoder&) = delete;
+
+    static Format format_for(const std::string& path);
+
+    // Queues rows top to bottom, 3 bytes per pixel. A frame for the same path that is
+    // still waiting is replaced, so slow formats never fall behind the render.
+    void submit(const std::string& path, int width, int height, std::vector<unsigned char> rgb);
+
+    // blocks until everything queued has been written
+    void wait();
+
+    Stats stats() const;
+
+    bool encode(Format format, const unsigned char* rgb, int width, int height, std::vector<unsigned char>& out);
+    bool encode_png(const unsigned char* rgb, int width, int height, std::vector<unsigned char>& out);
+    static void encode_qoi(const unsigned char* rgb, int width, int height, std::vector<unsigned char>& out);
+    static void encode_bmp(const unsigned char* rgb, int width, int height, std::vector<unsigned char>& out);
+
+    // PNG building blocks, shared with StripWriter
+    static void png_header(std::vector<unsigned char>& out, int width, int height);
+    static void png_chunk(std::vector<unsigned char>& out, const char* type, const unsigned char* data, size_t size);
+    // one filtered scanline: the filter type byte, then the row, using whichever of the five
+    // PNG filters gives the smallest sum of absolute signed residuals
+    static void png_filter_row(const unsigned char* row, const unsigned char* above, int bytes, unsigned char* out);
+
+private:
+    struct Job {
+        std::string path;
+        int width;
+        int height;
+        std::vector<unsigned char> rgb;
+    };
+
+    void run();
+    ThreadPool& pool();
+
+    int m_numThreads;
+    std::unique_ptr<ThreadPool> m_pool;
+    std::thread m_thread;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::condition_variable m_idle;
+    std::deque<Job> m_jobs;
+    bool m_busy;
+    bool m_stop;
+    Stats m_stats;
+};
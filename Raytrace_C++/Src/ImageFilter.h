@@ -1,5 +0,0 @@
-#pragma once
-class ImageFilter {
-public:
-    virtual Vector3 filter(const Vector3& c) const = 0;
-};
\ No newline at end of file
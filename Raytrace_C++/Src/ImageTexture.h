@@ -1,35 +1,35 @@
 #pragma once
 
 #include "Texture.h"
+#include "AssetManager.h"
 
 class ImageTexture : public Texture {
 public:
-    ImageTexture(const char* name) {
-        int nn;
-        m_texels = stbi_load(name, &m_width, &m_height, &nn, 0);
-    }
-
-    virtual ~ImageTexture() {
-        stbi_image_free(m_texels);
+    // texels are decoded asynchronously by the AssetManager that created the asset
+    ImageTexture(const ImageAssetPtr& image)
+        : m_image(image) {
     }
 
     virtual Vector3 value(float u, float v, const Vector3& p) const override {
-        int i = (u)*m_width;
-        int j = ( 1 - v ) * m_height - 0.001;
-        return sample(i, j);
+        const ImageData* image = m_image->get();
+        if ( !image ) {
+            return Vector3(1, 0, 1);
+        }
+        int i = (u)*image->width;
+        int j = ( 1 - v ) * image->height - 0.001;
+        return sample(*image, i, j);
     }
 
-    Vector3 sample(int u, int v) const {
-        u = u < 0 ? 0 : u >= m_width ? m_width - 1 : u;
-        v = v < 0 ? 0 : v >= m_height ? m_height - 1 : v;
+    Vector3 sample(const ImageData& image, int u, int v) const {
+        u = u < 0 ? 0 : u >= image.width ? image.width - 1 : u;
+        v = v < 0 ? 0 : v >= image.height ? image.height - 1 : v;
+        const unsigned char* texel = &image.texels[3 * u + 3 * image.width * v];
         return Vector3(
-            int(m_texels[3 * u + 3 * m_width * v]) / 255.0,
-            int(m_texels[3 * u + 3 * m_width * v + 1]) / 255.0,
-            int(m_texels[3 * u + 3 * m_width * v + 2]) / 255.0);
+            int(texel[0]) / 255.0,
+            int(texel[1]) / 255.0,
+            int(texel[2]) / 255.0);
     }
 
 private:
-    int m_width;
-    int m_height;
-    unsigned char* m_texels;
-};
\ No newline at end of file
+    ImageAssetPtr m_image;
+};
@@ -17,6 +17,7 @@ bool Lambertian::scatter(const Ray& r, const HitRec& hrec, ScatterRec& srec) con
     srec.albedo = m_albedo->value(hrec.u, hrec.v, hrec.p);
     srec.pdf = m_pdf;
     srec.is_specular = false;
+    srec.is_diffuse = true;
     return true;
 }
 
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "Ray.h"
+
+// Where an emitter (or a group of them) is, which way it faces and how much it emits, for
+// the light tree (Conty Estevez and Kulla 2018). The directions light leaves in are bounded
+// by a cone: every normal lies within thetaO of axis, and light leaves at most thetaE
+// beyond its normal (PI / 2 for diffuse emitters).
+struct LightBounds {
+    Vector3 lo, hi;
+    Vector3 axis;
+    float thetaO;
+    float thetaE;
+    float power;
+
+    Vector3 center() const { return 0.5f * ( lo + hi ); }
+
+    // the smallest bounds holding both
+    static LightBounds merge(const LightBounds& a, const LightBounds& b) {
+        LightBounds m;
+        m.lo = minPerElem(a.lo, b.lo);
+        m.hi = maxPerElem(a.hi, b.hi);
+        m.power = a.power + b.power;
+        m.thetaE = std::max(a.thetaE, b.thetaE);
+
+        // cone around both cones: the wider one, turned towards the other just enough
+        const LightBounds& w = a.thetaO >= b.thetaO ? a : b;
+        const LightBounds& n = a.thetaO >= b.thetaO ? b : a;
+        float thetaD = acosf(clamp(dot(w.axis, n.axis), -1.0f, 1.0f));
+        m.axis = w.axis;
+        m.thetaO = w.thetaO;
+        if ( std::min(thetaD + n.thetaO, PI) <= w.thetaO ) {
+            return m;
+        }
+        m.thetaO = 0.5f * ( w.thetaO + thetaD + n.thetaO );
+        Vector3 c = cross(w.axis, n.axis);
+        if ( m.thetaO >= PI || lengthSqr(c) < 1e-12f ) {
+            m.thetaO = PI;
+            return m;
+        }
+        m.axis = normalize(rotate(Quat::rotation(m.thetaO - w.thetaO, normalize(c)), w.axis));
+        return m;
+    }
+
+    // Estimated contribution to point p: power over squared distance, times the cosine of
+    // the smallest angle any emitted direction can make with the direction to p. Distances
+    // are clamped to the bounds' radius so nearby groups do not blow up.
+    float importance(const Vector3& p) const {
+        Vector3 d = p - center();
+        float dd = lengthSqr(d);
+        float rr = 0.25f * lengthSqr(hi - lo);
+        float thetaB = dd > rr ? asinf(sqrtf(rr / dd)) : PI; // half-angle the bounds subtend
+        float thetaW = dd > 0 ? acosf(clamp(dot(axis, d) / sqrtf(dd), -1.0f, 1.0f)) : 0.0f;
+        float theta = std::max(0.0f, thetaW - thetaO - thetaB);
+        if ( theta >= thetaE ) {
+            return 0;
+        }
+        return power * cosf(theta) / std::max(dd, rr);
+    }
+
+    // whether the ray enters the box for some t in [t0, t1]
+    bool hit(const Ray& r, float t0, float t1) const {
+        for ( int i = 0; i < 3; ++i ) {
+            float o = r.origin()[i];
+            float d = r.direction()[i];
+            float pad = 1e-4f * ( 1.0f + fabsf(lo[i]) + fabsf(hi[i]) ); // rects are flat
+            float a = lo[i] - pad;
+            float b = hi[i] + pad;
+            if ( d == 0 ) {
+                if ( o < a || o > b ) return false;
+                continue;
+            }
+            float ta = ( a - o ) / d;
+            float tb = ( b - o ) / d;
+            if ( ta > tb ) std::swap(ta, tb);
+            t0 = std::max(t0, ta);
+            t1 = std::min(t1, tb);
+            if ( t1 < t0 ) return false;
+        }
+        return true;
+    }
+};
@@ -0,0 +1,40 @@
+#pragma once
+
+// Weighted reservoir over light samples (ReSTIR): streams any number of candidates and
+// keeps one, chosen with probability proportional to its weight, in constant memory.
+struct LightReservoir {
+    Vector3 point;   // the chosen sample on an emitter
+    Vector3 normal;  // emitter normal there
+    Vector3 emitted; // its radiance towards the side the normal faces
+    float wSum;      // sum of candidate weights
+    float M;         // number of candidates seen
+    float W;         // contribution weight of the chosen sample: wSum / (M * target)
+
+    void reset() {
+        wSum = 0;
+        M = 0;
+        W = 0;
+    }
+
+    // adds one candidate; u is uniform in [0, 1)
+    bool update(const Vector3& p, const Vector3& n, const Vector3& le, float weight, float u) {
+        wSum += weight;
+        M += 1;
+        if ( weight > 0 && u * wSum < weight ) {
+            point = p;
+            normal = n;
+            emitted = le;
+            return true;
+        }
+        return false;
+    }
+
+    // adds another reservoir whose chosen sample has target value target here; count caps
+    // how many candidates it stands for
+    bool merge(const LightReservoir& other, float target, float count, float u) {
+        float M0 = M;
+        bool taken = update(other.point, other.normal, other.emitted, target * other.W * count, u);
+        M = M0 + count;
+        return taken;
+    }
+};
@@ -0,0 +1,123 @@
+#include "LightTree.h"
+
+#include "Ray.h"
+#include "HitRec.h"
+
+#include <algorithm>
+
+LightTree::LightTree(const std::vector<ShapePtr>& emitters) {
+    std::vector<Node> leaves;
+    for ( auto& e : emitters ) {
+        Node leaf;
+        if ( !e->light_bounds(leaf.bounds) ) continue;
+        leaf.bounds.power = e->power();
+        if ( leaf.bounds.power <= 0 ) continue;
+
+        leaf.light = int(m_lights.size());
+        leaf.second = -1;
+        m_lights.push_back(e);
+        leaves.push_back(leaf);
+    }
+    if ( !leaves.empty() ) {
+        m_nodes.reserve(2 * leaves.size() - 1);
+        build(leaves, 0, int(leaves.size()));
+    }
+}
+
+int LightTree::build(std::vector<Node>& leaves, int begin, int end) {
+    int index = int(m_nodes.size());
+    if ( end - begin == 1 ) {
+        m_nodes.push_back(leaves[begin]);
+        return index;
+    }
+    m_nodes.push_back(Node());
+
+    // split at the median along the longest side of the centres' bounds
+    Vector3 lo = leaves[begin].bounds.center();
+    Vector3 hi = lo;
+    for ( int i = begin + 1; i < end; ++i ) {
+        lo = minPerElem(lo, leaves[i].bounds.center());
+        hi = maxPerElem(hi, leaves[i].bounds.center());
+    }
+    Vector3 extent = hi - lo;
+    int axis = extent.getX() > extent.getY() ? ( extent.getX() > extent.getZ() ? 0 : 2 ) : ( extent.getY() > extent.getZ() ? 1 : 2 );
+    int mid = ( begin + end ) / 2;
+    std::nth_element(leaves.begin() + begin, leaves.begin() + mid, leaves.begin() + end,
+        [axis](const Node& a, const Node& b) { return a.bounds.center()[axis] < b.bounds.center()[axis]; });
+
+    build(leaves, begin, mid);
+    int second = build(leaves, mid, end);
+    Node& node = m_nodes[index];
+    node.bounds = LightBounds::merge(m_nodes[index + 1].bounds, m_nodes[second].bounds);
+    node.light = -1;
+    node.second = second;
+    return index;
+}
+
+float LightTree::first_probability(int node, const Vector3& o) const {
+    float i0 = m_nodes[node + 1].bounds.importance(o);
+    float i1 = m_nodes[m_nodes[node].second].bounds.importance(o);
+    // neither can light o: any consistent choice will do
+    return i0 + i1 > 0 ? i0 / ( i0 + i1 ) : 0.5f;
+}
+
+bool LightTree::hit(const Ray& r, float t0, float t1, HitRec& hrec) const {
+    if ( m_nodes.empty() ) return false;
+    int stack[STACK_SIZE];
+    int top = 0;
+    stack[top++] = 0;
+    bool hit_anything = false;
+    while ( top > 0 ) {
+        int index = stack[--top];
+        const Node& node = m_nodes[index];
+        if ( !node.bounds.hit(r, t0, t1) ) continue;
+        if ( node.light >= 0 ) {
+            if ( m_lights[node.light]->hit(r, t0, t1, hrec) ) {
+                hit_anything = true;
+                t1 = hrec.t;
+            }
+            continue;
+        }
+        stack[top++] = node.second;
+        stack[top++] = index + 1;
+    }
+    return hit_anything;
+}
+
+float LightTree::pdf_value(const Vector3& o, const Vector3& v) const {
+    if ( m_nodes.empty() ) return 0;
+    Ray r(o, v);
+    int stack[STACK_SIZE];
+    float probability[STACK_SIZE];
+    int top = 0;
+    stack[top] = 0;
+    probability[top++] = 1;
+    float sum = 0;
+    while ( top > 0 ) {
+        --top;
+        int index = stack[top];
+        float p = probability[top];
+        const Node& node = m_nodes[index];
+        if ( p <= 0 || !node.bounds.hit(r, 0.001f, FLT_MAX) ) continue;
+        if ( node.light >= 0 ) {
+            sum += p * m_lights[node.light]->pdf_value(o, v);
+            continue;
+        }
+        float p0 = first_probability(index, o);
+        stack[top] = node.second;
+        probability[top++] = p * ( 1.0f - p0 );
+        stack[top] = index + 1;
+        probability[top++] = p * p0;
+    }
+    return sum;
+}
+
+Vector3 LightTree::random(const Vector3& o) const {
+    if ( m_nodes.empty() ) return Vector3(1, 0, 0);
+    int index = 0;
+    while ( m_nodes[index].light < 0 ) {
+        float p0 = first_probability(index, o);
+        index = drand48() < p0 ? index + 1 : m_nodes[index].second;
+    }
+    return m_lights[m_nodes[index].light]->random(o);
+}
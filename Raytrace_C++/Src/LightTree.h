@@ -0,0 +1,47 @@
+#pragma once
+
+#include "Shape.h"
+#include "LightBounds.h"
+
+#include <vector>
+
+// Bounding hierarchy over the emitters for light sampling (Conty Estevez and Kulla 2018).
+// random() walks down from the root, at every node picking a child in proportion to its
+// estimated contribution to the shading point (LightBounds::importance), so a point is
+// lit mostly by the lights that are bright, close and facing it, in O(log N). pdf_value()
+// walks down the same way, but only into the nodes the direction passes through, and sums
+// the probability of reaching each light it hits times that light's own pdf.
+class LightTree : public Shape {
+public:
+    // emitters: shapes with an emissive material; those without light_bounds(), or whose
+    // power() is 0, are left out
+    explicit LightTree(const std::vector<ShapePtr>& emitters);
+
+    size_t size() const { return m_lights.size(); }
+
+    // the closest emitter hit
+    virtual bool hit(const Ray& r, float t0, float t1, HitRec& hrec) const override;
+
+    virtual float pdf_value(const Vector3& o, const Vector3& v) const override;
+
+    virtual Vector3 random(const Vector3& o) const override;
+
+    // of every light in the tree, for picking between the tree and other lights
+    virtual float power() const override { return m_nodes.empty() ? 0.0f : m_nodes[0].bounds.power; }
+
+private:
+    struct Node {
+        LightBounds bounds;
+        int light;  // index into m_lights for a leaf, -1 for an inner node
+        int second; // an inner node's second child; the first follows the node
+    };
+
+    static const int STACK_SIZE = 64;
+
+    int build(std::vector<Node>& leaves, int begin, int end);
+    // probability of going from inner node to its first child, seen from o
+    float first_probability(int node, const Vector3& o) const;
+
+    std::vector<ShapePtr> m_lights;
+    std::vector<Node> m_nodes; // depth first, root at 0
+};
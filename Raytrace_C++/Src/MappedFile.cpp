@@ -0,0 +1,180 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <string>
+
+MappedFile::MappedFile()
+    : m_data(nullptr)
+    , m_size(0)
+    , m_reused(false)
+#ifdef _WIN32
+    , m_file(INVALID_HANDLE_VALUE)
+    , m_mapping(nullptr)
+#else
+    , m_fd(-1)
+#endif
+{
+}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const char* path, size_t size) {
+    close();
+    HANDLE file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+        OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if ( file == INVALID_HANDLE_VALUE ) return false;
+    m_file = file;
+
+    LARGE_INTEGER current;
+    m_reused = GetFileSizeEx(file, &current) && size_t(current.QuadPart) == size;
+
+    m_mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE,
+        DWORD(uint64_t(size) >> 32), DWORD(size & 0xffffffffu), nullptr);
+    if ( !m_mapping ) {
+        close();
+        return false;
+    }
+    m_data = MapViewOfFile(m_mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+    if ( !m_data ) {
+        close();
+        return false;
+    }
+    m_size = size;
+    return true;
+}
+
+bool MappedFile::open_shared(const char* name, size_t size) {
+    close();
+    if ( size > 0 ) {
+        m_mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+            DWORD(uint64_t(size) >> 32), DWORD(size & 0xffffffffu), name);
+        m_reused = m_mapping && GetLastError() == ERROR_ALREADY_EXISTS;
+    }
+    else {
+        m_mapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, name);
+        m_reused = true;
+    }
+    if ( !m_mapping ) return false;
+    m_data = MapViewOfFile(m_mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+    if ( !m_data ) {
+        close();
+        return false;
+    }
+    if ( size == 0 ) {
+        MEMORY_BASIC_INFORMATION info;
+        VirtualQuery(m_data, &info, sizeof(info));
+        size = info.RegionSize;
+    }
+    m_size = size;
+    return true;
+}
+
+void MappedFile::unlink_shared(const char* name) {
+    // the mapping goes away with its last handle
+}
+
+void MappedFile::close() {
+    if ( m_data ) UnmapViewOfFile(m_data);
+    if ( m_mapping ) CloseHandle(m_mapping);
+    if ( m_file != INVALID_HANDLE_VALUE ) CloseHandle(m_file);
+    m_data = nullptr;
+    m_mapping = nullptr;
+    m_file = INVALID_HANDLE_VALUE;
+    m_size = 0;
+}
+
+void MappedFile::flush(size_t offset, size_t bytes) {
+    if ( !m_data ) return;
+    FlushViewOfFile(static_cast<char*>( m_data ) + offset, bytes);
+    FlushFileBuffers(m_file);
+}
+
+#else
+
+bool MappedFile::open(const char* path, size_t size) {
+    close();
+    int fd = ::open(path, O_RDWR | O_CREAT, 0644);
+    if ( fd < 0 ) return false;
+    m_fd = fd;
+
+    struct stat st;
+    m_reused = fstat(fd, &st) == 0 && size_t(st.st_size) == size;
+    if ( !m_reused && ftruncate(fd, off_t(size)) != 0 ) {
+        close();
+        return false;
+    }
+    void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if ( data == MAP_FAILED ) {
+        close();
+        return false;
+    }
+    m_data = data;
+    m_size = size;
+    return true;
+}
+
+bool MappedFile::open_shared(const char* name, size_t size) {
+    close();
+    std::string path = name[0] == '/' ? name : std::string("/") + name;
+    int fd = shm_open(path.c_str(), size > 0 ? O_RDWR | O_CREAT : O_RDWR, 0644);
+    if ( fd < 0 ) return false;
+    m_fd = fd;
+
+    struct stat st;
+    if ( fstat(fd, &st) != 0 ) {
+        close();
+        return false;
+    }
+    m_reused = size == 0 || size_t(st.st_size) == size;
+    if ( size == 0 ) {
+        size = size_t(st.st_size);
+    }
+    else if ( !m_reused && ftruncate(fd, off_t(size)) != 0 ) {
+        close();
+        return false;
+    }
+    void* data = size > 0 ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    if ( data == MAP_FAILED ) {
+        close();
+        return false;
+    }
+    m_data = data;
+    m_size = size;
+    return true;
+}
+
+void MappedFile::unlink_shared(const char* name) {
+    std::string path = name[0] == '/' ? name : std::string("/") + name;
+    shm_unlink(path.c_str());
+}
+
+void MappedFile::close() {
+    if ( m_data ) munmap(m_data, m_size);
+    if ( m_fd >= 0 ) ::close(m_fd);
+    m_data = nullptr;
+    m_fd = -1;
+    m_size = 0;
+}
+
+void MappedFile::flush(size_t offset, size_t bytes) {
+    if ( !m_data ) return;
+    // msync wants a page-aligned start
+    size_t page = size_t(sysconf(_SC_PAGESIZE));
+    size_t begin = offset / page * page;
+    msync(static_cast<char*>( m_data ) + begin, offset + bytes - begin, MS_SYNC);
+}
+
+#endif
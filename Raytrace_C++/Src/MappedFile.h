@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+
+// Read/write memory mapping of a file on disk, or of a named shared-memory segment.
+class MappedFile {
+public:
+    MappedFile();
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Maps path with exactly size bytes, creating or resizing the file as needed.
+    // Existing contents are kept when the file already had that size (see reused()).
+    bool open(const char* path, size_t size);
+
+    // Named shared memory visible to other processes ("name" becomes /name on POSIX).
+    // size > 0 creates or resizes the segment; size 0 maps an existing one whole.
+    bool open_shared(const char* name, size_t size);
+    // removes the name; processes that mapped the segment keep their view (POSIX only)
+    static void unlink_shared(const char* name);
+
+    void close();
+
+    void* data() const { return m_data; }
+    size_t size() const { return m_size; }
+    bool reused() const { return m_reused; }
+
+    // writes the given range back to disk and waits for it
+    void flush(size_t offset, size_t bytes);
+
+private:
+    void* m_data;
+    size_t m_size;
+    bool m_reused;
+#ifdef _WIN32
+    void* m_file;
+    void* m_mapping;
+#else
+    int m_fd;
+#endif
+};
@@ -0,0 +1,254 @@
+#include "Mesh.h"
+
+#include "Ray.h"
+#include "HitRec.h"
+
+#include <cstdlib>
+#include <cfloat>
+
+#define BVH_LEAF_SIZE 4
+
+namespace {
+    const char* skip_space(const char* p, const char* end) {
+        while ( p < end && ( *p == ' ' || *p == '\t' ) ) ++p;
+        return p;
+    }
+
+    const char* next_line(const char* p, const char* end) {
+        while ( p < end && *p != '\n' ) ++p;
+        return p < end ? p + 1 : end;
+    }
+
+    // returns the 0-based position index of an OBJ face vertex ("i", "i/t", "i//n", "i/t/n")
+    bool parse_index(const char*& p, const char* end, int numPositions, int& index) {
+        char* q;
+        long i = strtol(p, &q, 10);
+        if ( q == p ) return false;
+        p = q;
+        while ( p < end && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n' ) ++p;
+        index = i > 0 ? int(i - 1) : numPositions + int(i);
+        return index >= 0 && index < numPositions;
+    }
+}
+
+bool Mesh::load_obj(const char* text, size_t size) {
+    const char* p = text;
+    const char* end = text + size;
+    std::vector<int> face;
+    while ( p < end ) {
+        p = skip_space(p, end);
+        if ( end - p > 2 && p[0] == 'v' && ( p[1] == ' ' || p[1] == '\t' ) ) {
+            char* q;
+            float x = strtof(p + 2, &q);
+            float y = strtof(q, &q);
+            float z = strtof(q, &q);
+            m_positions.push_back(Vector3(x, y, z));
+        }
+        else if ( end - p > 2 && p[0] == 'f' && ( p[1] == ' ' || p[1] == '\t' ) ) {
+            face.clear();
+            const char* q = skip_space(p + 1, end);
+            int index;
+            while ( q < end && *q != '\r' && *q != '\n' ) {
+                if ( !parse_index(q, end, int(m_positions.size()), index) ) return false;
+                face.push_back(index);
+                q = skip_space(q, end);
+            }
+            // triangulate as a fan
+            for ( size_t k = 2; k < face.size(); ++k ) {
+                m_indices.push_back(face[0]);
+                m_indices.push_back(face[k - 1]);
+                m_indices.push_back(face[k]);
+            }
+        }
+        p = next_line(p, end);
+    }
+    return !m_indices.empty();
+}
+
+void Mesh::build_bvh() {
+    int n = triangle_count();
+    std::vector<Vector3> centroids(n);
+    for ( int i = 0; i < n; ++i ) {
+        centroids[i] = ( vertex(i, 0) + vertex(i, 1) + vertex(i, 2) ) / 3.0f;
+    }
+    m_nodes.clear();
+    m_nodes.reserve(2 * n);
+    if ( n > 0 ) {
+        build_node(0, n, centroids);
+    }
+
+    // areas in the triangles' final order
+    std::vector<float> areas(n);
+    m_area = 0;
+    for ( int i = 0; i < n; ++i ) {
+        areas[i] = 0.5f * length(cross(vertex(i, 1) - vertex(i, 0), vertex(i, 2) - vertex(i, 0)));
+        m_area += areas[i];
+    }
+    m_triangles = AliasTable(areas);
+}
+
+int Mesh::build_node(int first, int count, std::vector<Vector3>& centroids) {
+    int index = int(m_nodes.size());
+    m_nodes.push_back(Node());
+
+    Vector3 bmin(FLT_MAX), bmax(-FLT_MAX);
+    Vector3 cmin(FLT_MAX), cmax(-FLT_MAX);
+    for ( int i = first; i < first + count; ++i ) {
+        for ( int k = 0; k < 3; ++k ) {
+            bmin = minPerElem(bmin, vertex(i, k));
+            bmax = maxPerElem(bmax, vertex(i, k));
+        }
+        cmin = minPerElem(cmin, centroids[i]);
+        cmax = maxPerElem(cmax, centroids[i]);
+    }
+    m_nodes[index].bmin = bmin;
+    m_nodes[index].bmax = bmax;
+
+    Vector3 extent = cmax - cmin;
+    int axis = extent[0] > extent[1] ? ( extent[0] > extent[2] ? 0 : 2 ) : ( extent[1] > extent[2] ? 1 : 2 );
+    if ( count <= BVH_LEAF_SIZE || extent[axis] <= 0.0f ) {
+        m_nodes[index].first = first;
+        m_nodes[index].count = count;
+        return index;
+    }
+
+    // median split on the longest centroid axis, swapping triangles and centroids together
+    int mid = first + count / 2;
+    std::vector<int> order(count);
+    for ( int i = 0; i < count; ++i ) order[i] = first + i;
+    std::nth_element(order.begin(), order.begin() + ( mid - first ), order.end(),
+        [&](int a, int b) { return centroids[a][axis] < centroids[b][axis]; });
+    std::vector<unsigned int> indices(3 * count);
+    std::vector<Vector3> cents(count);
+    for ( int i = 0; i < count; ++i ) {
+        for ( int k = 0; k < 3; ++k ) indices[3 * i + k] = m_indices[3 * order[i] + k];
+        cents[i] = centroids[order[i]];
+    }
+    std::copy(indices.begin(), indices.end(), m_indices.begin() + 3 * first);
+    std::copy(cents.begin(), cents.end(), centroids.begin() + first);
+
+    build_node(first, mid - first, centroids);
+    int right = build_node(mid, first + count - mid, centroids);
+    m_nodes[index].first = right;
+    m_nodes[index].count = 0;
+    return index;
+}
+
+bool Mesh::hit_triangle(int tri, const Ray& r, float t0, float t1, HitRec& hrec) const {
+    const Vector3& p0 = vertex(tri, 0);
+    Vector3 e1 = vertex(tri, 1) - p0;
+    Vector3 e2 = vertex(tri, 2) - p0;
+    Vector3 pv = cross(r.direction(), e2);
+    float det = dot(e1, pv);
+    if ( fabs(det) < 1e-12f ) return false;
+    float invDet = recip(det);
+    Vector3 tv = r.origin() - p0;
+    float b1 = dot(tv, pv) * invDet;
+    if ( b1 < 0.0f || b1 > 1.0f ) return false;
+    Vector3 qv = cross(tv, e1);
+    float b2 = dot(r.direction(), qv) * invDet;
+    if ( b2 < 0.0f || b1 + b2 > 1.0f ) return false;
+    float t = dot(e2, qv) * invDet;
+    if ( t < t0 || t > t1 ) return false;
+    hrec.t = t;
+    hrec.u = b1;
+    hrec.v = b2;
+    hrec.p = r.at(t);
+    hrec.n = normalize(cross(e1, e2));
+    return true;
+}
+
+void Mesh::sample_area(HitRec& hrec) const {
+    if ( m_triangles.empty() ) return;
+    int tri = m_triangles.sample(drand48());
+    // uniform barycentrics
+    float s = sqrtf(drand48());
+    float b1 = drand48() * s;
+    float b2 = 1.0f - s;
+    const Vector3& p0 = vertex(tri, 0);
+    Vector3 e1 = vertex(tri, 1) - p0;
+    Vector3 e2 = vertex(tri, 2) - p0;
+    hrec.p = p0 + b1 * e1 + b2 * e2;
+    hrec.n = normalize(cross(e1, e2));
+    hrec.t = 0;
+    hrec.u = b1;
+    hrec.v = b2;
+}
+
+float Mesh::area_to_solid_angle(const Ray& r, float t0) const {
+    if ( m_nodes.empty() ) return 0;
+
+    Vector3 invDir = recipPerElem(r.direction());
+    float dd = lengthSqr(r.direction());
+    float d = sqrtf(dd);
+    int stack[64];
+    int sp = 0;
+    stack[sp++] = 0;
+    float sum = 0;
+    HitRec hrec;
+    while ( sp > 0 ) {
+        const Node& node = m_nodes[stack[--sp]];
+        Vector3 ta = mulPerElem(node.bmin - r.origin(), invDir);
+        Vector3 tb = mulPerElem(node.bmax - r.origin(), invDir);
+        float tmin = std::max(t0, maxElem(minPerElem(ta, tb)));
+        float tmax = minElem(maxPerElem(ta, tb));
+        if ( tmin > tmax ) continue;
+
+        if ( node.count > 0 ) {
+            for ( int i = node.first; i < node.first + node.count; ++i ) {
+                if ( hit_triangle(i, r, t0, FLT_MAX, hrec) ) {
+                    float cosine = fabs(dot(r.direction(), hrec.n)) / d;
+                    if ( cosine > 0 ) {
+                        sum += pow2(hrec.t) * dd / cosine;
+                    }
+                }
+            }
+        }
+        else {
+            int self = int(&node - &m_nodes[0]);
+            stack[sp++] = node.first;
+            stack[sp++] = self + 1;
+        }
+    }
+    return sum;
+}
+
+bool Mesh::bounds(Vector3& lo, Vector3& hi) const {
+    if ( m_nodes.empty() ) return false;
+    lo = m_nodes[0].bmin;
+    hi = m_nodes[0].bmax;
+    return true;
+}
+
+bool Mesh::hit(const Ray& r, float t0, float t1, HitRec& hrec) const {
+    if ( m_nodes.empty() ) return false;
+
+    Vector3 invDir = recipPerElem(r.direction());
+    int stack[64];
+    int sp = 0;
+    stack[sp++] = 0;
+    bool hit_anything = false;
+    while ( sp > 0 ) {
+        const Node& node = m_nodes[stack[--sp]];
+        Vector3 ta = mulPerElem(node.bmin - r.origin(), invDir);
+        Vector3 tb = mulPerElem(node.bmax - r.origin(), invDir);
+        float tmin = std::max(t0, maxElem(minPerElem(ta, tb)));
+        float tmax = std::min(t1, minElem(maxPerElem(ta, tb)));
+        if ( tmin > tmax ) continue;
+
+        if ( node.count > 0 ) {
+            for ( int i = node.first; i < node.first + node.count; ++i ) {
+                if ( hit_triangle(i, r, t0, t1, hrec) ) {
+                    hit_anything = true;
+                    t1 = hrec.t;
+                }
+            }
+        }
+        else {
+            int self = int(&node - &m_nodes[0]);
+            stack[sp++] = node.first;
+            stack[sp++] = self + 1;
+        }
+    }
+    return hit_anything;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "AliasTable.h"
+
+class Ray;
+struct HitRec;
+
+// Triangle soup with its own BVH, shared by every TriangleMesh that uses it
+class Mesh {
+public:
+    struct Node {
+        Vector3 bmin;
+        Vector3 bmax;
+        int first; // leaf: first triangle, inner: index of the right child (left child is this + 1)
+        int count; // number of triangles, 0 for inner nodes
+    };
+
+    Mesh() {}
+
+    bool load_obj(const char* text, size_t size);
+    void build_bvh();
+
+    bool hit(const Ray& r, float t0, float t1, HitRec& hrec) const;
+
+    int triangle_count() const { return int(m_indices.size() / 3); }
+    int vertex_count() const { return int(m_positions.size()); }
+    const Vector3& vertex(int tri, int k) const { return m_positions[m_indices[3 * tri + k]]; }
+
+    // for sampling the mesh as a light: the total area, a point drawn uniformly over it (p,
+    // n, u and v filled in), and the sum over every point where the ray crosses the mesh of
+    // distance squared over |cosine|, which turns the area density 1 / area into a density
+    // over directions from the ray's origin
+    float area() const { return m_area; }
+    void sample_area(HitRec& hrec) const;
+    float area_to_solid_angle(const Ray& r, float t0) const;
+
+    // bounds of every triangle; false for an empty mesh
+    bool bounds(Vector3& lo, Vector3& hi) const;
+
+private:
+    int build_node(int first, int count, std::vector<Vector3>& centroids);
+    bool hit_triangle(int tri, const Ray& r, float t0, float t1, HitRec& hrec) const;
+
+    std::vector<Vector3> m_positions;
+    std::vector<unsigned int> m_indices;
+    std::vector<Node> m_nodes;
+    AliasTable m_triangles; // picks triangles by area
+    float m_area = 0;
+};
+
+typedef std::shared_ptr<Mesh> MeshPtr;
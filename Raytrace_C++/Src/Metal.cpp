@@ -6,12 +6,32 @@
 
 #include "Texture.h"
 
+#define MIN_ROUGHNESS 0.02f // smoother metal is a perfect mirror
+
 bool Metal::scatter(const Ray& r, const HitRec& hrec, ScatterRec& srec) const {
-    Vector3 reflected = reflect(normalize(r.direction()), hrec.n);
-    reflected += m_fuzz * random_in_unit_sphere();
-    srec.ray = Ray(hrec.p, reflected);
     srec.albedo = m_albedo->value(hrec.u, hrec.v, hrec.p);
-    srec.pdf = nullptr;
-	srec.is_specular = true;
-    return dot(srec.ray.direction(), hrec.n) > 0;
+    if ( m_roughness < MIN_ROUGHNESS ) {
+        srec.ray = Ray(hrec.p, reflect(normalize(r.direction()), hrec.n));
+        srec.pdf = nullptr;
+        srec.is_specular = true;
+        srec.is_diffuse = false;
+        return dot(srec.ray.direction(), hrec.n) > 0;
+    }
+    srec.pdf = &m_pdf;
+    srec.is_specular = false;
+    srec.is_diffuse = false;
+    return dot(hrec.wo, hrec.n) > 0;
+}
+
+float Metal::scattering_pdf(const Ray& r, const HitRec& hrec) const {
+    // D * G2 / ( 4 * cos(theta_o) ): the BRDF times cos(theta_i), over the albedo
+    Vector3 wi = normalize(r.direction());
+    float cosO = dot(hrec.wo, hrec.n);
+    float cosI = dot(wi, hrec.n);
+    if ( m_roughness < MIN_ROUGHNESS || cosO <= 0 || cosI <= 0 ) {
+        return 0;
+    }
+    float alpha = m_roughness * m_roughness;
+    float g2 = 1 / ( 1 + GgxPdf::lambda(cosO, alpha) + GgxPdf::lambda(cosI, alpha) );
+    return GgxPdf::distribution(dot(normalize(hrec.wo + wi), hrec.n), alpha) * g2 / ( 4 * cosO );
 }
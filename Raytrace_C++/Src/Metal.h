@@ -1,24 +1,36 @@
 #pragma once
 
 #include "Material.h"
+#include "GgxPdf.h"
 
+// A conductor: GGX microfacets with Smith's height-correlated masking and shadowing, whose
+// reflectance is the albedo texture, taken as the same at every angle. Directions are sampled
+// from the visible normals (GgxPdf) and scattering_pdf() evaluates the lobe, so rough metal
+// is lit by light sampling and MIS like the diffuse materials. Below MIN_ROUGHNESS the lobe
+// is too narrow to evaluate and the metal is a perfect mirror.
 class Metal : public Material {
 public:
-    Metal(const TexturePtr& a, float fuzz)
+    // roughness: 0 (mirror) to 1; the distribution's alpha is its square
+    Metal(const TexturePtr& a, float roughness)
         : m_albedo(a)
-        , m_fuzz(fuzz){}
+        , m_roughness(roughness)
+        , m_pdf(roughness * roughness) {}
 
     virtual bool scatter(const Ray& r, const HitRec& hrec, ScatterRec& srec) const override;
 
+    virtual float scattering_pdf(const Ray& r, const HitRec& hrec) const override;
+
 	virtual void set_texture(const TexturePtr& a) override {
 		m_albedo = a;
 	}
 
-	void set_fuzz(float fuzz) {
-		m_fuzz = fuzz;
+	void set_roughness(float roughness) {
+		m_roughness = roughness;
+		m_pdf = GgxPdf(roughness * roughness);
 	}
 
 private:
     TexturePtr m_albedo;
-	float m_fuzz;
-};
\ No newline at end of file
+	float m_roughness;
+	GgxPdf m_pdf;
+};
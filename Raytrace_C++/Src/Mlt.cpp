@@ -0,0 +1,233 @@
+#include "Mlt.h"
+
+#include "Film.h"
+#include "Random.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+// The numbers of one path, drawn as the integrator asks for them so a path can use as many
+// as it needs. A small step moves the numbers the current path used by a little Gaussian
+// noise and draws the rest afresh; a large step draws them all afresh. Numbers the current
+// path left unused are uniform and independent of it, so redrawing them is exact, where
+// moving them on from wherever an older path left them (pbrt's lazy catch-up) measurably
+// biases chains towards dimmer paths in scenes lit through a gap. What a proposal changed is
+// put back if it is rejected.
+class Mlt::Sampler : public RandomSource {
+public:
+    Sampler(const Settings& settings, uint64_t seed)
+        : m_rng(3ull << 32, seed)
+        , m_largeStepProbability(settings.largeStepProbability)
+        , m_sigma(settings.sigma)
+        , m_iteration(0)
+        , m_largeStep(true)
+        , m_index(0) {}
+
+    float next_float() override {
+        size_t i = m_index++;
+        if ( i >= m_numbers.size() ) {
+            m_numbers.resize(i + 1);
+        }
+        Number& x = m_numbers[i];
+        x.backup = x.value;
+        x.modifiedBackup = x.modified;
+        if ( m_largeStep || x.modified < m_iteration - 1 ) {
+            x.value = m_rng.next_float();
+        }
+        else {
+            // the current path used it: a Gaussian step, wrapped around
+            float u1 = 1.0f - m_rng.next_float();
+            float u2 = m_rng.next_float();
+            x.value += sqrtf(-2.0f * logf(u1)) * cosf(PI2 * u2) * m_sigma;
+            x.value -= floorf(x.value);
+            if ( x.value >= 1.0f ) {
+                x.value = 0.0f;
+            }
+        }
+        x.modified = m_iteration;
+        return x.value;
+    }
+
+    // propose the next path
+    void start_iteration() {
+        ++m_iteration;
+        m_largeStep = m_rng.next_float() < m_largeStepProbability;
+        m_index = 0;
+    }
+
+    // go back to the current path, which the last accepted iteration proposed
+    void reject() {
+        for ( auto& x : m_numbers ) {
+            if ( x.modified == m_iteration ) {
+                x.value = x.backup;
+                x.modified = x.modifiedBackup;
+            }
+        }
+        --m_iteration;
+    }
+
+    // a number of the chain's own, not one of the path's
+    float uniform() { return m_rng.next_float(); }
+
+private:
+    struct Number {
+        float value;
+        float backup;
+        long long modified; // iteration whose path last used it; -1 never
+        long long modifiedBackup;
+
+        Number() : value(0), backup(0), modified(-1), modifiedBackup(-1) {}
+    };
+
+    Random m_rng;
+    float m_largeStepProbability;
+    float m_sigma;
+    std::vector<Number> m_numbers;
+    long long m_iteration;
+    bool m_largeStep;
+    size_t m_index;
+};
+
+struct Mlt::Chain {
+    Sampler sampler;
+    std::vector<Splat> current;
+    std::vector<Splat> proposed;
+    float f; // luminance of current
+    long long proposals;
+    long long accepted;
+
+    Chain(const Settings& settings, uint64_t seed)
+        : sampler(settings, seed), f(0), proposals(0), accepted(0) {}
+};
+
+Mlt::Mlt(const Settings& settings, const Integrator& integrator, int chains)
+    : m_settings(settings)
+    , m_integrator(integrator)
+    , m_chains(std::max(chains, 1))
+    , m_bootstrapped(false)
+    , m_brightness(0) {
+}
+
+Mlt::~Mlt() {
+}
+
+ThreadPool& Mlt::pool() {
+    if ( !m_pool ) {
+        m_pool = std::make_unique<ThreadPool>(int(m_chains.size()));
+    }
+    return *m_pool;
+}
+
+float Mlt::evaluate(Sampler& sampler, int chain, std::vector<Splat>& splats) const {
+    Random& rng = Random::local();
+    rng.set_source(&sampler);
+    splats.clear();
+    m_integrator(chain, splats);
+    rng.set_source(nullptr);
+    float f = 0;
+    for ( auto& s : splats ) {
+        f += luminance(s.c);
+    }
+    return std::isfinite(f) && f > 0 ? f : 0.0f;
+}
+
+void Mlt::bootstrap() {
+    // independent paths, each from numbers seeded by its index, split over the chains'
+    // threads; their mean luminance is the brightness
+    int paths = std::max(m_settings.bootstrap, 1);
+    int chains = int(m_chains.size());
+    std::vector<float> weights(paths);
+    std::vector< std::future<void> > tasks;
+    for ( int c = 0; c < chains; ++c ) {
+        tasks.push_back(pool().enqueue([this, &weights, paths, chains, c] {
+            std::vector<Splat> splats;
+            for ( int i = c; i < paths; i += chains ) {
+                Sampler sampler(m_settings, uint64_t(i));
+                weights[i] = evaluate(sampler, c, splats);
+            }
+        }));
+    }
+    for ( auto& t : tasks ) {
+        t.get();
+    }
+    double sum = 0;
+    for ( float w : weights ) {
+        sum += w;
+    }
+    m_brightness = float(sum / paths);
+
+    // Every chain starts from a bootstrap path picked by luminance, whose numbers its sampler
+    // replays from the same seed; a scene no path found light in gets no chains.
+    AliasTable pick(weights);
+    for ( int c = 0; c < chains && !pick.empty(); ++c ) {
+        Random rng(4ull << 32, uint64_t(c));
+        int i = pick.sample(rng.next_float());
+        m_chains[c] = std::make_unique<Chain>(m_settings, uint64_t(i));
+        m_chains[c]->f = evaluate(m_chains[c]->sampler, c, m_chains[c]->current);
+    }
+}
+
+void Mlt::run(Chain& chain, int index, long long mutations, SplatBuffer& splats) {
+    float b = m_brightness;
+    for ( long long m = 0; m < mutations; ++m ) {
+        chain.sampler.start_iteration();
+        float f = evaluate(chain.sampler, index, chain.proposed);
+        float a = chain.f > 0 ? std::min(1.0f, f / chain.f) : 1.0f;
+
+        // both paths, each by its chance of being the next state
+        if ( a > 0 ) {
+            for ( auto& s : chain.proposed ) {
+                Splat w = { s.x, s.y, s.c * ( a * b / f ) };
+                splats.add(index, w);
+            }
+        }
+        if ( a < 1 ) {
+            for ( auto& s : chain.current ) {
+                Splat w = { s.x, s.y, s.c * ( ( 1.0f - a ) * b / chain.f ) };
+                splats.add(index, w);
+            }
+        }
+
+        ++chain.proposals;
+        if ( chain.sampler.uniform() < a ) {
+            chain.current.swap(chain.proposed);
+            chain.f = f;
+            ++chain.accepted;
+        }
+        else {
+            chain.sampler.reject();
+        }
+    }
+}
+
+void Mlt::render(long long mutations, SplatBuffer& splats) {
+    if ( !m_bootstrapped ) {
+        bootstrap();
+        m_bootstrapped = true;
+    }
+    if ( !( m_brightness > 0 ) ) return;
+
+    long long chains = (long long)m_chains.size();
+    std::vector< std::future<void> > tasks;
+    for ( int c = 0; c < int(chains); ++c ) {
+        long long share = mutations * ( c + 1 ) / chains - mutations * c / chains;
+        tasks.push_back(pool().enqueue([this, &splats, c, share] {
+            run(*m_chains[c], c, share, splats);
+        }));
+    }
+    for ( auto& t : tasks ) {
+        t.get();
+    }
+}
+
+double Mlt::acceptance() const {
+    long long proposals = 0;
+    long long accepted = 0;
+    for ( auto& c : m_chains ) {
+        if ( c ) {
+            proposals += c->proposals;
+            accepted += c->accepted;
+        }
+    }
+    return proposals > 0 ? double(accepted) / double(proposals) : 0.0;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "AliasTable.h"
+#include "SplatBuffer.h"
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+class ThreadPool;
+
+// Primary-sample-space Metropolis light transport (Kelemen et al. 2002, laid out as in
+// pbrt). A path is a function of the numbers drand48() hands its integrator; a Markov chain
+// over those numbers visits paths in proportion to their luminance, so it keeps returning
+// to the few that carry light once it has found them. A mutation is either a large step,
+// all numbers drawn afresh, which keeps the chain from getting stuck, or a small step, each
+// number moved by a little Gaussian noise, which explores around the current path.
+//
+// How bright the image is overall comes from a bootstrap of independent paths before the
+// first pass. Chains start from paths picked among those by luminance, so none of them
+// spends its first mutations getting to where the light is. Both the current and the
+// proposed path are splatted each mutation, weighted by the chance of accepting, so
+// rejected proposals still count.
+//
+// There is one chain per render thread, each with its own numbers, so the image depends on
+// the thread count. A chain writes to the pixels of its paths wherever they are, through its
+// thread's splat buffer.
+class Mlt {
+public:
+    struct Settings {
+        bool enabled;
+        int bootstrap;              // paths sampled to estimate the brightness
+        float largeStepProbability; // the rest are small steps
+        float sigma;                // standard deviation of a small step, per number
+
+        Settings(bool e = true, int b = 100000, float p = 0.3f, float s = 0.01f)
+            : enabled(e), bootstrap(b), largeStepProbability(p), sigma(s) {}
+    };
+
+    // Sample one path from the numbers drand48() returns, and append what it contributes,
+    // and to which pixels, to splats. chain: which chain, and render thread, is asking.
+    typedef std::function<void(int chain, std::vector<Splat>& splats)> Integrator;
+
+    Mlt(const Settings& settings, const Integrator& integrator, int chains);
+    ~Mlt();
+
+    Mlt(const Mlt&) = delete;
+    Mlt& operator=(const Mlt&) = delete;
+
+    // Run the chains for mutations in all, bootstrapping first if it has not yet, and add
+    // what they splat to splats, chain i to its thread i. Must not overlap rendering.
+    void render(long long mutations, SplatBuffer& splats);
+
+    // the bootstrap's estimate of the mean luminance of a path
+    float brightness() const { return m_brightness; }
+    // share of the proposals accepted so far
+    double acceptance() const;
+
+private:
+    class Sampler;
+    struct Chain;
+
+    // Replay sampler's numbers through the integrator of the given chain into splats, and
+    // return the path's luminance summed over every pixel it reaches: what chains sample by.
+    float evaluate(Sampler& sampler, int chain, std::vector<Splat>& splats) const;
+    void bootstrap();
+    void run(Chain& chain, int index, long long mutations, SplatBuffer& splats);
+    ThreadPool& pool();
+
+    Settings m_settings;
+    Integrator m_integrator;
+    std::vector< std::unique_ptr<Chain> > m_chains;
+    bool m_bootstrapped;
+    float m_brightness;
+    std::unique_ptr<ThreadPool> m_pool;
+};
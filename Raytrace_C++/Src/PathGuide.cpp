@@ -0,0 +1,168 @@
+#include "PathGuide.h"
+
+#include <cfloat>
+#include <cmath>
+
+#define MIN_FRACTION_RECORDS 64 // fewer keep the region's mixing weight as it was
+
+namespace {
+    const float FRACTION[PathGuide::FRACTIONS] = { 0.1f, 0.3f, 0.5f, 0.7f, 0.9f };
+}
+
+PathGuide::Region::Region()
+    : bsdfFraction(0.5f)
+    , records(0) {
+    for ( int k = 0; k < FRACTIONS; ++k ) {
+        moments[k].store(0, std::memory_order_relaxed);
+    }
+}
+
+PathGuide::PathGuide(const Settings& settings)
+    : m_settings(settings)
+    , m_trainedSpp(0)
+    , m_iteration(0)
+    , m_iterationSpp(0)
+    , m_origin(0)
+    , m_size(0) {
+    for ( int i = 0; i < 3; ++i ) {
+        m_lo[i].store(FLT_MAX, std::memory_order_relaxed);
+        m_hi[i].store(-FLT_MAX, std::memory_order_relaxed);
+    }
+}
+
+PathGuide::Region* PathGuide::region(const Vector3& p) const {
+    if ( m_nodes.empty() ) return nullptr;
+    // position in the root cube, rescaled to the child's half at every level
+    Vector3 u = ( p - m_origin ) / m_size;
+    float x[3] = { clamp(u.getX(), 0.0f, 1.0f), clamp(u.getY(), 0.0f, 1.0f), clamp(u.getZ(), 0.0f, 1.0f) };
+    int node = 0;
+    for ( int depth = 0; m_nodes[node].child != 0; ++depth ) {
+        float& c = x[depth % 3];
+        c *= 2.0f;
+        if ( c < 1.0f ) {
+            node = m_nodes[node].child;
+        }
+        else {
+            c -= 1.0f;
+            node = m_nodes[node].child + 1;
+        }
+    }
+    return m_regions[m_nodes[node].region].get();
+}
+
+void PathGuide::grow_bounds(const Vector3& p) const {
+    // reads only, once the bounds stop growing
+    for ( int i = 0; i < 3; ++i ) {
+        float v = p[i];
+        float lo = m_lo[i].load(std::memory_order_relaxed);
+        while ( v < lo && !m_lo[i].compare_exchange_weak(lo, v, std::memory_order_relaxed) ) {}
+        float hi = m_hi[i].load(std::memory_order_relaxed);
+        while ( v > hi && !m_hi[i].compare_exchange_weak(hi, v, std::memory_order_relaxed) ) {}
+    }
+}
+
+void PathGuide::record(Region* region, const Vector3& p, const Vector3& direction, const Record& r) const {
+    if ( !region ) {
+        grow_bounds(p);
+        return;
+    }
+    if ( !( r.pdf > 0 ) ) return;
+    region->learning.record(direction, r.radiance / r.pdf);
+    region->records.fetch_add(1, std::memory_order_relaxed);
+
+    // The second moment of product / q under mixture q, estimated from a sample drawn
+    // from the pdf actually used: product^2 / ( q * pdf ).
+    if ( !( r.product > 0 ) || !std::isfinite(r.product) ) return;
+    for ( int k = 0; k < FRACTIONS; ++k ) {
+        float q = FRACTION[k] * r.bsdfPdf + ( 1.0f - FRACTION[k] ) * r.guidePdf;
+        if ( q > 0 ) {
+            atomic_add(region->moments[k], pow2(r.product) / ( q * r.pdf ));
+        }
+    }
+}
+
+void PathGuide::build_root() {
+    // a cube around everything the first pass hit, a little larger so nothing sits on a face
+    Vector3 lo(m_lo[0].load(), m_lo[1].load(), m_lo[2].load());
+    Vector3 hi(m_hi[0].load(), m_hi[1].load(), m_hi[2].load());
+    if ( !( lo.getX() <= hi.getX() ) ) {
+        lo = Vector3(-1);
+        hi = Vector3(1);
+    }
+    m_size = std::max(maxElem(hi - lo), 1e-3f) * 1.01f;
+    m_origin = 0.5f * ( lo + hi ) - Vector3(0.5f * m_size);
+    m_nodes.push_back({ 0, 0 });
+    m_regions.emplace_back(new Region());
+}
+
+void PathGuide::split(int node, float records, float threshold) {
+    if ( records <= threshold ) return;
+    // the first half keeps the region, the second starts from a copy of its trees; each is
+    // taken to have had half the records
+    int region = m_nodes[node].region;
+    std::unique_ptr<Region> copy(new Region());
+    copy->guide = m_regions[region]->guide;
+    copy->learning = m_regions[region]->learning;
+    copy->bsdfFraction = m_regions[region]->bsdfFraction;
+    int child = int(m_nodes.size());
+    m_nodes[node].child = child;
+    m_nodes.push_back({ 0, region });
+    m_nodes.push_back({ 0, int(m_regions.size()) });
+    m_regions.push_back(std::move(copy));
+    split(child, 0.5f * records, threshold);
+    split(child + 1, 0.5f * records, threshold);
+}
+
+void PathGuide::end_pass(int spp) {
+    if ( !training() ) return;
+    m_trainedSpp += spp;
+    m_iterationSpp += spp;
+    if ( m_iterationSpp >= ( 1 << std::min(m_iteration, 30) ) || !training() ) {
+        end_iteration(m_iterationSpp);
+        m_iterationSpp = 0;
+        ++m_iteration;
+    }
+}
+
+void PathGuide::end_iteration(int spp) {
+    if ( m_iteration == 0 ) {
+        build_root();
+        return;
+    }
+
+    // the mixing weight with the lowest estimated second moment
+    for ( auto& r : m_regions ) {
+        if ( r->records.load(std::memory_order_relaxed) < MIN_FRACTION_RECORDS ) continue;
+        float best = FLT_MAX;
+        for ( int k = 0; k < FRACTIONS; ++k ) {
+            float m = r->moments[k].load(std::memory_order_relaxed);
+            if ( m > 0 && m < best ) {
+                best = m;
+                r->bsdfFraction = FRACTION[k];
+            }
+        }
+    }
+
+    float threshold = m_settings.spatialThreshold * sqrtf(float(spp));
+    int leaves = int(m_nodes.size());
+    for ( int i = 0; i < leaves; ++i ) {
+        if ( m_nodes[i].child == 0 ) {
+            split(i, float(m_regions[m_nodes[i].region]->records.load(std::memory_order_relaxed)), threshold);
+        }
+    }
+
+    // what was learned guides the next pass; regions no path reached keep their old guide
+    for ( auto& r : m_regions ) {
+        if ( r->learning.total() > 0 ) {
+            r->guide = r->learning;
+        }
+        if ( training() ) {
+            r->learning = r->guide;
+            r->learning.refine(m_settings.directionalThreshold);
+        }
+        r->records.store(0, std::memory_order_relaxed);
+        for ( int k = 0; k < FRACTIONS; ++k ) {
+            r->moments[k].store(0, std::memory_order_relaxed);
+        }
+    }
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "DirectionalTree.h"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+// Online path guiding with an SD-tree ("Practical Path Guiding", Muller et al. 2017). A
+// binary tree splits space, alternating x, y and z, and every leaf (a region) holds two
+// directional trees of incident radiance: one learned in the previous training iteration,
+// which guides sampling now, and one being learned from the paths of this iteration.
+// Iterations span as many progressive passes as it takes to reach 1, 2, 4, 8... samples per
+// pixel, so each guide learns from twice the samples of the one before. After each iteration
+// regions that received many records are split, the new tree becomes the guide and a
+// refined, empty copy starts learning. Once the training budget is spent the guide is kept
+// as it is and recording stops.
+//
+// Guided directions are mixed with the material's own pdf (GuidedPdf). Instead of the
+// paper's follow-up gradient descent on the mixing weight, every region estimates the
+// second moment its paths would have had under a few fixed weights, and takes the best one
+// for the next pass; that needs no lock on the render threads.
+class PathGuide {
+public:
+    struct Settings {
+        bool enabled;
+        int trainingSpp;            // samples per pixel spent learning; the first only finds the bounds
+        float spatialThreshold;     // records a region takes before splitting, times sqrt(iteration spp)
+        float directionalThreshold; // share of a region's energy above which a quarter is subdivided
+
+        Settings(bool e = true, int t = 64, float s = 12000, float d = 0.01f)
+            : enabled(e), trainingSpp(t), spatialThreshold(s), directionalThreshold(d) {}
+    };
+
+    // candidate probabilities of sampling the material instead of the guide
+    static const int FRACTIONS = 5;
+
+    struct Region {
+        DirectionalTree guide;    // learned in the previous training pass
+        DirectionalTree learning; // recorded into in this one
+        float bsdfFraction;       // probability of sampling the material
+        std::atomic<int> records;
+        std::atomic<float> moments[FRACTIONS]; // second moment estimates, one per candidate
+
+        Region();
+    };
+
+    // one direction sampled at a path vertex, with what arrived along it
+    struct Record {
+        float radiance; // luminance of the incident radiance
+        float product;  // luminance of the incident radiance times the material's f * cos
+        float bsdfPdf;  // the material's pdf for the direction
+        float guidePdf; // the guide's
+        float pdf;      // of the sample as it was taken, Russian roulette included
+    };
+
+    explicit PathGuide(const Settings& settings);
+
+    const Settings& settings() const { return m_settings; }
+
+    // whether passes still record
+    bool training() const { return m_trainedSpp < m_settings.trainingSpp; }
+
+    // region holding p, or null before the first training pass has ended
+    Region* region(const Vector3& p) const;
+
+    // called from render threads; region is what region(p) returned
+    void record(Region* region, const Vector3& p, const Vector3& direction, const Record& r) const;
+
+    // Called after every progressive pass, which took spp samples per pixel; ends the
+    // training iteration once it has its samples. Must not overlap rendering.
+    void end_pass(int spp);
+
+private:
+    struct Node {
+        int child;  // first of two children, 0 for a leaf
+        int region; // index into m_regions for a leaf
+    };
+
+    void build_root();
+    void end_iteration(int spp);
+    // split a leaf in halves until each is taken to have at most threshold records
+    void split(int node, float records, float threshold);
+    void grow_bounds(const Vector3& p) const;
+
+    Settings m_settings;
+    int m_trainedSpp;
+    int m_iteration;    // 0 only finds the bounds
+    int m_iterationSpp; // taken in the current iteration
+    std::vector<Node> m_nodes; // root at 0, split on axis depth % 3
+    std::vector<std::unique_ptr<Region>> m_regions;
+    Vector3 m_origin;
+    float m_size; // the root is a cube
+    mutable std::atomic<float> m_lo[3], m_hi[3]; // path vertices seen in the first pass
+};
@@ -0,0 +1,203 @@
+#include "PhotonMap.h"
+
+#include "Shape.h"
+#include "Material.h"
+#include "HitRec.h"
+#include "ScatterRec.h"
+#include "ONB.h"
+#include "Random.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cfloat>
+
+#define DISC_THICKNESS 0.1f // of the radius: photons farther off the surface's plane are left out
+
+PhotonMap::PhotonMap(const Settings& settings, const Shape* world, const std::vector<ShapePtr>& emitters)
+    : m_settings(settings)
+    , m_world(world)
+    , m_emitters(emitters)
+    , m_emitted(0)
+    , m_radius(0)
+    , m_invCellSize(0) {
+    std::vector<float> power;
+    for ( auto& e : m_emitters ) {
+        m_areas.push_back(e->area());
+        power.push_back(e->power());
+    }
+    m_pick = AliasTable(power);
+}
+
+PhotonMap::~PhotonMap() {
+}
+
+ThreadPool& PhotonMap::pool() {
+    if ( !m_pool ) {
+        m_pool = std::make_unique<ThreadPool>();
+    }
+    return *m_pool;
+}
+
+void PhotonMap::shoot(std::vector<Photon>& photons) const {
+    for ( int i = 0; i < BATCH; ++i ) {
+        // a point by area on an emitter picked by power, a direction by cosine; the power
+        // is what the photon carries before dividing by the number emitted
+        int k = m_pick.sample(drand48());
+        HitRec lrec;
+        m_emitters[k]->sample_area(lrec);
+        ONB uvw;
+        uvw.build_from_w(lrec.n);
+        Ray ray(lrec.p, uvw.local(random_cosine_direction()));
+        Vector3 power = lrec.mat->emitted(Ray(lrec.p, -lrec.n), lrec) * ( m_areas[k] * PI / m_pick.pmf(k) );
+
+        bool specular = false;
+        for ( int bounce = 0; bounce < MAX_BOUNCES && maxElem(power) > 0; ++bounce ) {
+            HitRec hrec;
+            ScatterRec srec;
+            if ( !m_world->hit(ray, 0.001f, FLT_MAX, hrec) || !hrec.mat->scatter(ray, hrec, srec) ) break;
+            if ( !srec.is_specular ) {
+                if ( specular ) {
+                    Vector3 d = normalize(ray.direction());
+                    Photon p = {
+                        { hrec.p.getX(), hrec.p.getY(), hrec.p.getZ() },
+                        { power.getX(), power.getY(), power.getZ() },
+                        { d.getX(), d.getY(), d.getZ() }
+                    };
+                    photons.push_back(p);
+                }
+                break;
+            }
+            power = mulPerElem(power, srec.albedo);
+            specular = true;
+            ray = srec.ray;
+        }
+    }
+}
+
+void PhotonMap::trace(int pass) {
+    m_photons.clear();
+    m_emitted = 0;
+    if ( m_pick.empty() || m_settings.photons <= 0 ) {
+        build_grid();
+        return;
+    }
+
+    // Rounds of batches, each seeded by pass and batch; a round's batches are taken in order
+    // until the budget is full, so threads finishing early or late change nothing.
+    ThreadPool& threads = pool();
+    int perRound = 4 * threads.size();
+    std::vector< std::vector<Photon> > batches(perRound);
+    long long maxEmitted = (long long)MAX_EMITTED_FACTOR * m_settings.photons;
+    bool full = false;
+    for ( long long first = 0; !full && m_emitted < maxEmitted; first += perRound ) {
+        std::vector< std::future<void> > tasks;
+        for ( int b = 0; b < perRound; ++b ) {
+            tasks.push_back(threads.enqueue([this, &batches, pass, first, b] {
+                Random::local().seed(uint64_t(pass) | ( 2ull << 32 ), uint64_t(first + b));
+                batches[b].clear();
+                shoot(batches[b]);
+            }));
+        }
+        for ( auto& t : tasks ) {
+            t.get();
+        }
+        for ( int b = 0; b < perRound && !full; ++b ) {
+            if ( m_photons.size() + batches[b].size() > size_t(m_settings.photons) ) {
+                full = true;
+                break;
+            }
+            m_photons.insert(m_photons.end(), batches[b].begin(), batches[b].end());
+            m_emitted += BATCH;
+        }
+    }
+
+    float scale = m_emitted > 0 ? 1.0f / float(m_emitted) : 0.0f;
+    for ( auto& p : m_photons ) {
+        for ( int i = 0; i < 3; ++i ) {
+            p.power[i] *= scale;
+        }
+    }
+
+    // the radius of this pass, from the extent of what was stored
+    Vector3 lo(FLT_MAX);
+    Vector3 hi(-FLT_MAX);
+    for ( auto& p : m_photons ) {
+        Vector3 v(p.position[0], p.position[1], p.position[2]);
+        lo = minPerElem(lo, v);
+        hi = maxPerElem(hi, v);
+    }
+    float radius2 = m_photons.empty() ? 0.0f : lengthSqr(hi - lo) * pow2(m_settings.radius);
+    for ( int i = 1; i <= pass; ++i ) {
+        radius2 *= ( i + m_settings.alpha ) / ( i + 1 );
+    }
+    m_radius = sqrtf(radius2);
+    build_grid();
+}
+
+size_t PhotonMap::bucket(int x, int y, int z) const {
+    uint32_t h = uint32_t(x) * 73856093u ^ uint32_t(y) * 19349663u ^ uint32_t(z) * 83492791u;
+    return h & ( m_buckets.size() - 2 );
+}
+
+void PhotonMap::build_grid() {
+    // counting sort by bucket: count, prefix sum, scatter
+    size_t size = 1;
+    while ( size < m_photons.size() ) {
+        size <<= 1;
+    }
+    m_buckets.assign(size + 1, 0);
+    if ( m_photons.empty() || !( m_radius > 0 ) ) {
+        m_photons.clear();
+        return;
+    }
+    m_invCellSize = 0.5f / m_radius;
+
+    std::vector<size_t> keys(m_photons.size());
+    for ( size_t i = 0; i < m_photons.size(); ++i ) {
+        const float* p = m_photons[i].position;
+        keys[i] = bucket(cell(p[0]), cell(p[1]), cell(p[2]));
+        ++m_buckets[keys[i] + 1];
+    }
+    for ( size_t b = 1; b <= size; ++b ) {
+        m_buckets[b] += m_buckets[b - 1];
+    }
+    std::vector<Photon> sorted(m_photons.size());
+    std::vector<int> next(m_buckets.begin(), m_buckets.end() - 1);
+    for ( size_t i = 0; i < m_photons.size(); ++i ) {
+        sorted[next[keys[i]]++] = m_photons[i];
+    }
+    m_photons.swap(sorted);
+}
+
+Vector3 PhotonMap::gather(const HitRec& hrec, const ScatterRec& srec) const {
+    if ( m_photons.empty() ) return Vector3(0);
+
+    // The cells are as wide as the disc, so it touches two along each axis. Two cells can
+    // share a bucket, which is then scanned once.
+    float x[3] = { hrec.p.getX(), hrec.p.getY(), hrec.p.getZ() };
+    int lo[3];
+    for ( int i = 0; i < 3; ++i ) {
+        lo[i] = cell(x[i] - m_radius);
+    }
+    size_t seen[8];
+    int count = 0;
+    float radius2 = pow2(m_radius);
+    Vector3 sum(0);
+    for ( int c = 0; c < 8; ++c ) {
+        size_t b = bucket(lo[0] + ( c & 1 ), lo[1] + ( ( c >> 1 ) & 1 ), lo[2] + ( c >> 2 ));
+        if ( std::find(seen, seen + count, b) != seen + count ) continue;
+        seen[count++] = b;
+        for ( int i = m_buckets[b]; i < m_buckets[b + 1]; ++i ) {
+            const Photon& p = m_photons[i];
+            Vector3 d(p.position[0] - x[0], p.position[1] - x[1], p.position[2] - x[2]);
+            if ( lengthSqr(d) > radius2 || fabsf(dot(d, hrec.n)) > DISC_THICKNESS * m_radius ) continue;
+            // the material's f * cos for the photon's direction, over the cosine
+            Vector3 in(-p.direction[0], -p.direction[1], -p.direction[2]);
+            float cosine = dot(in, hrec.n);
+            if ( cosine <= 0 ) continue;
+            float f = hrec.mat->scattering_pdf(Ray(hrec.p, in), hrec) / cosine;
+            sum += Vector3(p.power[0], p.power[1], p.power[2]) * f;
+        }
+    }
+    return mulPerElem(srec.albedo, sum) / ( PI * radius2 );
+}
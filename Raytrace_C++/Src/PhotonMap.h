@@ -0,0 +1,83 @@
+#pragma once
+
+#include "AliasTable.h"
+
+#include <memory>
+#include <vector>
+
+class Shape;
+class ThreadPool;
+struct HitRec;
+struct ScatterRec;
+
+// Caustic photon map, made progressive (Hachisuka et al. 2008, in the probabilistic form of
+// Knaus and Zwicker 2011). Before every pass, photons leave the emitters and bounce off
+// mirrors and glass. A photon is kept where it first lands on a diffuse surface after at
+// least one such bounce: light focused by glass or reflected in a mirror, which paths from
+// the camera hardly ever find. The pass gathers these photons at its diffuse hits instead.
+// The gather radius shrinks from pass to pass, r(i+1)^2 = r(i)^2 * (i + alpha) / (i + 1), so
+// the average over passes converges to the caustic.
+//
+// Photons are kept in a flat array sorted by the hash of their grid cell, whose side is the
+// gather diameter, so a lookup scans at most eight contiguous runs. The map is rebuilt
+// between passes and only read while a pass renders, so gathering takes no locks.
+class PhotonMap {
+public:
+    struct Settings {
+        bool enabled;
+        int photons;  // stored per pass: the memory budget; emission stops once it is reached
+        float radius; // first pass's gather radius, as a fraction of the extent of its photons
+        float alpha;  // share of the photons each pass's radius keeps from the pass before
+
+        Settings(bool e = true, int n = 20000, float r = 0.005f, float a = 0.7f)
+            : enabled(e), photons(n), radius(r), alpha(a) {}
+    };
+
+    // emitters: every shape whose material emits; they are picked by power and sampled by area
+    PhotonMap(const Settings& settings, const Shape* world, const std::vector<ShapePtr>& emitters);
+    ~PhotonMap();
+
+    PhotonMap(const PhotonMap&) = delete;
+    PhotonMap& operator=(const PhotonMap&) = delete;
+
+    // Trace the photons of the given pass (0 first) and rebuild the grid. The result only
+    // depends on the pass, not on the threads. Must not overlap rendering.
+    void trace(int pass);
+
+    // caustic radiance a diffuse hit reflects; srec is what its material scattered
+    Vector3 gather(const HitRec& hrec, const ScatterRec& srec) const;
+
+    size_t stored() const { return m_photons.size(); }
+    long long emitted() const { return m_emitted; }
+    float radius() const { return m_radius; }
+
+private:
+    struct Photon {
+        float position[3];
+        float power[3];
+        float direction[3]; // of travel, normalized
+    };
+
+    static const int BATCH = 1024;           // photons emitted per task
+    static const int MAX_EMITTED_FACTOR = 64; // emission also stops after this many per stored one
+    static const int MAX_BOUNCES = 16;
+
+    // emit BATCH photons, appending those that land on a diffuse surface to photons
+    void shoot(std::vector<Photon>& photons) const;
+    void build_grid();
+    int cell(float x) const { return int(floorf(x * m_invCellSize)); }
+    size_t bucket(int x, int y, int z) const;
+    ThreadPool& pool();
+
+    Settings m_settings;
+    const Shape* m_world;
+    std::vector<ShapePtr> m_emitters;
+    std::vector<float> m_areas;
+    AliasTable m_pick; // by power
+    std::vector<Photon> m_photons; // sorted by bucket
+    std::vector<int> m_buckets;    // first photon of every bucket, and one past the last
+    long long m_emitted;
+    float m_radius;
+    float m_invCellSize;
+    std::unique_ptr<ThreadPool> m_pool;
+};
@@ -0,0 +1,179 @@
+#include "PostProcess.h"
+
+#include "ThreadPool.h"
+
+#include <emmintrin.h>
+#include <algorithm>
+#include <cstring>
+#include <future>
+
+namespace {
+    const int BAND_ROWS = 16;
+
+    // ordered dither thresholds, centred in their 1/16 steps
+    const float BAYER[4][4] = {
+        {  0.5f / 16,  8.5f / 16,  2.5f / 16, 10.5f / 16 },
+        { 12.5f / 16,  4.5f / 16, 14.5f / 16,  6.5f / 16 },
+        {  3.5f / 16, 11.5f / 16,  1.5f / 16,  9.5f / 16 },
+        { 15.5f / 16,  7.5f / 16, 13.5f / 16,  5.5f / 16 }
+    };
+
+    // Hable's filmic curve
+    const float HA = 0.15f, HB = 0.50f, HC = 0.10f, HD = 0.20f, HE = 0.02f, HF = 0.30f;
+    const float FILMIC_BIAS = 2.0f;
+    const float FILMIC_WHITE = 11.2f;
+
+    float hable(float x) {
+        return ( ( x * ( HA * x + HC * HB ) + HD * HE ) / ( x * ( HA * x + HB ) + HD * HF ) ) - HE / HF;
+    }
+
+    inline __m128 hable(__m128 x) {
+        __m128 ax = _mm_mul_ps(_mm_set1_ps(HA), x);
+        __m128 num = _mm_add_ps(_mm_mul_ps(x, _mm_add_ps(ax, _mm_set1_ps(HC * HB))), _mm_set1_ps(HD * HE));
+        __m128 den = _mm_add_ps(_mm_mul_ps(x, _mm_add_ps(ax, _mm_set1_ps(HB))), _mm_set1_ps(HD * HF));
+        return _mm_sub_ps(_mm_div_ps(num, den), _mm_set1_ps(HE / HF));
+    }
+
+    inline __m128 tonemap(__m128 x, PostProcess::Tonemap curve) {
+        switch ( curve ) {
+            case PostProcess::kReinhard:
+                return _mm_div_ps(x, _mm_add_ps(x, _mm_set1_ps(1.0f)));
+            case PostProcess::kFilmic:
+                return _mm_mul_ps(hable(_mm_mul_ps(x, _mm_set1_ps(FILMIC_BIAS))), _mm_set1_ps(1.0f / hable(FILMIC_WHITE)));
+            case PostProcess::kAces: {
+                // the fit expects its input scaled by 0.6
+                x = _mm_mul_ps(x, _mm_set1_ps(0.6f));
+                __m128 num = _mm_mul_ps(x, _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(2.51f)), _mm_set1_ps(0.03f)));
+                __m128 den = _mm_add_ps(_mm_mul_ps(x, _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(2.43f)), _mm_set1_ps(0.59f))), _mm_set1_ps(0.14f));
+                return _mm_div_ps(num, den);
+            }
+            default:
+                return x;
+        }
+    }
+
+    float encode(float v, PostProcess::Encode curve) {
+        if ( curve == PostProcess::kSrgb ) {
+            return v <= 0.0031308f ? 12.92f * v : 1.055f * powf(v, 1.0f / 2.4f) - 0.055f;
+        }
+        return powf(v, 1.0f / GAMMA_FACTOR);
+    }
+}
+
+PostProcess::PostProcess(const Settings& settings)
+    : m_settings(settings) {
+    build_lut();
+}
+
+PostProcess::~PostProcess() {
+}
+
+void PostProcess::set_settings(const Settings& settings) {
+    m_settings = settings;
+    build_lut();
+}
+
+void PostProcess::build_lut() {
+    // indexed by sqrt(v): the steep dark end of the curve gets most of the entries
+    for ( int i = 0; i <= LUT_SIZE; ++i ) {
+        float s = float(i) / LUT_SIZE;
+        m_lut[i] = 255.0f * encode(s * s, m_settings.encode);
+    }
+    for ( int i = 0; i < LUT_SIZE; ++i ) {
+        m_slope[i] = m_lut[i + 1] - m_lut[i];
+    }
+    m_slope[LUT_SIZE] = 0;
+}
+
+ThreadPool& PostProcess::pool() {
+    if ( !m_pool ) {
+        m_pool = std::make_unique<ThreadPool>();
+    }
+    return *m_pool;
+}
+
+void PostProcess::run(const float* hdr, unsigned char* out, int width, int height) {
+    if ( height <= BAND_ROWS ) {
+        run_rows(hdr, out, width, 0, height);
+        return;
+    }
+    ThreadPool& threads = pool();
+    std::vector< std::future<void> > bands;
+    for ( int y = 0; y < height; y += BAND_ROWS ) {
+        int y1 = std::min(y + BAND_ROWS, height);
+        bands.push_back(threads.enqueue([=] { run_rows(hdr, out, width, y, y1); }));
+    }
+    for ( auto& b : bands ) {
+        b.get();
+    }
+}
+
+void PostProcess::run_rows(const float* hdr, unsigned char* out, int width, int y0, int y1) const {
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 top = _mm_set1_ps(255.0f);
+    const __m128 exposure = _mm_set1_ps(powf(2.0f, m_settings.exposure));
+    const __m128 lutScale = _mm_set1_ps(float(LUT_SIZE));
+    const Tonemap curve = m_settings.tonemap;
+
+    // Four pixels are three vectors with lanes R G B R | G B R G | B R G B.
+    // NaNs turn magenta so they stand out, as they always have.
+    const __m128 nanColor[3] = {
+        _mm_setr_ps(1, 0, 1, 1), _mm_setr_ps(0, 1, 1, 0), _mm_setr_ps(1, 1, 0, 1)
+    };
+
+    auto shade = [&](__m128 v, int k, const __m128* dither) {
+        __m128 nan = _mm_cmpunord_ps(v, v);
+        v = _mm_or_ps(_mm_and_ps(nan, nanColor[k]), _mm_andnot_ps(nan, v));
+        v = _mm_max_ps(_mm_mul_ps(v, exposure), zero);
+        v = _mm_min_ps(tonemap(v, curve), one);
+
+        __m128 s = _mm_mul_ps(_mm_sqrt_ps(v), lutScale);
+        __m128i i = _mm_cvttps_epi32(s);
+        __m128 t = _mm_sub_ps(s, _mm_cvtepi32_ps(i));
+        alignas(16) int idx[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>( idx ), i);
+        __m128 base = _mm_setr_ps(m_lut[idx[0]], m_lut[idx[1]], m_lut[idx[2]], m_lut[idx[3]]);
+        __m128 slope = _mm_setr_ps(m_slope[idx[0]], m_slope[idx[1]], m_slope[idx[2]], m_slope[idx[3]]);
+        __m128 e = _mm_add_ps(_mm_add_ps(base, _mm_mul_ps(t, slope)), dither[k]);
+        return _mm_cvttps_epi32(_mm_min_ps(e, top));
+    };
+
+    auto pixels4 = [&](const float* src, unsigned char* dst, const __m128* dither) {
+        __m128i a = shade(_mm_loadu_ps(src), 0, dither);
+        __m128i b = shade(_mm_loadu_ps(src + 4), 1, dither);
+        __m128i c = shade(_mm_loadu_ps(src + 8), 2, dither);
+        __m128i bytes = _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, c));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>( dst ), bytes);
+        int last = _mm_cvtsi128_si32(_mm_srli_si128(bytes, 8));
+        memcpy(dst + 8, &last, 4);
+    };
+
+    for ( int y = y0; y < y1; ++y ) {
+        // a Bayer row spans exactly the four pixels of one step
+        __m128 dither[3];
+        if ( m_settings.dither ) {
+            const float* d = BAYER[y & 3];
+            dither[0] = _mm_setr_ps(d[0], d[0], d[0], d[1]);
+            dither[1] = _mm_setr_ps(d[1], d[1], d[2], d[2]);
+            dither[2] = _mm_setr_ps(d[2], d[3], d[3], d[3]);
+        }
+        else {
+            dither[0] = dither[1] = dither[2] = _mm_set1_ps(0.5f);
+        }
+
+        const float* src = hdr + 3 * size_t(width) * y;
+        unsigned char* dst = out + 3 * size_t(width) * y;
+        int x = 0;
+        for ( ; x + 4 <= width; x += 4 ) {
+            pixels4(src + 3 * x, dst + 3 * x, dither);
+        }
+        if ( x < width ) {
+            float tail[12] = {};
+            unsigned char bytes[12];
+            memcpy(tail, src + 3 * x, 3 * ( width - x ) * sizeof(float));
+            pixels4(tail, bytes, dither);
+            memcpy(dst + 3 * x, bytes, 3 * ( width - x ));
+        }
+    }
+}
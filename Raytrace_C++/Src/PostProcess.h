@@ -0,0 +1,60 @@
+#pragma once
+
+#include <memory>
+
+class ThreadPool;
+
+// Turns the linear float framebuffer into 8-bit RGB in one fused pass:
+// NaN fix, exposure, tone curve, clamp, gamma or sRGB encode and (dithered) quantization.
+// Rows are split across a thread pool and each row runs 4 pixels at a time in SSE2.
+class PostProcess {
+public:
+    enum Tonemap {
+        kClamp,
+        kReinhard,
+        kFilmic, // Hable's Uncharted 2 curve
+        kAces    // Narkowicz's fit of the ACES reference transform
+    };
+
+    enum Encode {
+        kGamma, // pow(1 / GAMMA_FACTOR)
+        kSrgb
+    };
+
+    struct Settings {
+        float exposure; // stops
+        Tonemap tonemap;
+        Encode encode;
+        bool dither;    // 4x4 ordered dither instead of rounding
+
+        Settings(float ev = 0, Tonemap t = kClamp, Encode e = kGamma, bool d = true)
+            : exposure(ev), tonemap(t), encode(e), dither(d) {}
+    };
+
+    explicit PostProcess(const Settings& settings = Settings());
+    ~PostProcess();
+
+    PostProcess(const PostProcess&) = delete;
+    PostProcess& operator=(const PostProcess&) = delete;
+
+    const Settings& settings() const { return m_settings; }
+    void set_settings(const Settings& settings);
+
+    // hdr: width * height RGB floats, out: width * height RGB bytes
+    void run(const float* hdr, unsigned char* out, int width, int height);
+
+    // rows [y0, y1) on the calling thread
+    void run_rows(const float* hdr, unsigned char* out, int width, int y0, int y1) const;
+
+private:
+    static const int LUT_SIZE = 1024;
+
+    void build_lut();
+    ThreadPool& pool();
+
+    Settings m_settings;
+    // encode curve over sqrt(v), pre-scaled to [0, 255]: value and slope per step
+    float m_lut[LUT_SIZE + 1];
+    float m_slope[LUT_SIZE + 1];
+    std::unique_ptr<ThreadPool> m_pool;
+};
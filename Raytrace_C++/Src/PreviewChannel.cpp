@@ -0,0 +1,97 @@
+#include "PreviewChannel.h"
+
+#include <cstring>
+
+namespace {
+    const char MAGIC[8] = "RTPREV1";
+
+    size_t align64(size_t n) {
+        return ( n + 63 ) & ~size_t(63);
+    }
+}
+
+PreviewChannel::~PreviewChannel() {
+    if ( !m_name.empty() ) {
+        m_memory.close();
+        MappedFile::unlink_shared(m_name.c_str());
+    }
+}
+
+size_t PreviewChannel::pixel_bytes() const {
+    const Header* h = header();
+    return size_t(h->width) * h->height * 3 * ( h->format == kRgbFloat ? sizeof(float) : 1 );
+}
+
+PreviewChannel::SlotHeader* PreviewChannel::slot(uint64_t frame) const {
+    const Header* h = header();
+    char* base = static_cast<char*>( m_memory.data() );
+    return reinterpret_cast<SlotHeader*>( base + h->slotOffset + ( frame % h->slots ) * h->slotBytes );
+}
+
+bool PreviewChannel::create(const char* name, int width, int height, Format format) {
+    size_t pixels = size_t(width) * height * 3 * ( format == kRgbFloat ? sizeof(float) : 1 );
+    size_t slotBytes = align64(sizeof(SlotHeader) + pixels);
+    size_t slotOffset = align64(sizeof(Header));
+    if ( !m_memory.open_shared(name, slotOffset + SLOTS * slotBytes) ) return false;
+    m_name = name;
+
+    // a stale segment from an earlier render is reset; readers see latest go back to 0
+    Header* h = static_cast<Header*>( m_memory.data() );
+    h->latest.store(0, std::memory_order_release);
+    memcpy(h->magic, MAGIC, sizeof(MAGIC));
+    h->width = uint32_t(width);
+    h->height = uint32_t(height);
+    h->format = uint32_t(format);
+    h->slots = SLOTS;
+    h->slotBytes = slotBytes;
+    h->slotOffset = slotOffset;
+    for ( int i = 0; i < SLOTS; ++i ) {
+        slot(i)->sequence.store(0, std::memory_order_relaxed);
+    }
+    m_frame = 0;
+    return true;
+}
+
+void PreviewChannel::publish(const void* pixels, int pass, int spp, double seconds) {
+    if ( !m_memory.data() ) return;
+    uint64_t n = ++m_frame;
+    SlotHeader* s = slot(n);
+    s->sequence.store(2 * n - 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    s->pass = uint32_t(pass);
+    s->spp = uint32_t(spp);
+    s->seconds = seconds;
+    memcpy(reinterpret_cast<char*>( s ) + sizeof(SlotHeader), pixels, pixel_bytes());
+    s->sequence.store(2 * n, std::memory_order_release);
+    static_cast<Header*>( m_memory.data() )->latest.store(n, std::memory_order_release);
+}
+
+bool PreviewChannel::attach(const char* name) {
+    if ( !m_memory.open_shared(name, 0) || m_memory.size() < sizeof(Header) ) return false;
+    const Header* h = header();
+    if ( memcmp(h->magic, MAGIC, sizeof(MAGIC)) != 0 ||
+        m_memory.size() < h->slotOffset + h->slots * h->slotBytes ) {
+        m_memory.close();
+        return false;
+    }
+    return true;
+}
+
+bool PreviewChannel::read(Frame& frame, std::vector<unsigned char>& pixels, uint64_t newerThan) const {
+    if ( !m_memory.data() ) return false;
+    for ( int attempt = 0; attempt < 16; ++attempt ) {
+        uint64_t n = header()->latest.load(std::memory_order_acquire);
+        if ( n == 0 || n <= newerThan ) return false;
+        const SlotHeader* s = slot(n);
+        if ( s->sequence.load(std::memory_order_acquire) != 2 * n ) continue;
+        frame.number = n;
+        frame.pass = s->pass;
+        frame.spp = s->spp;
+        frame.seconds = s->seconds;
+        pixels.resize(pixel_bytes());
+        memcpy(pixels.data(), reinterpret_cast<const char*>( s ) + sizeof(SlotHeader), pixels.size());
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if ( s->sequence.load(std::memory_order_relaxed) == 2 * n ) return true;
+    }
+    return false;
+}
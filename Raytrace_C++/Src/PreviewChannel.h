@@ -0,0 +1,73 @@
+#pragma once
+
+#include "MappedFile.h"
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// Progressive frames published to named shared memory for an external viewer.
+//
+// Layout: a Header, then SLOTS slots, each a SlotHeader followed by the pixels
+// (rows top to bottom, RGB, 8-bit or float). Frame n goes to slot n % SLOTS under a
+// seqlock: the slot's sequence is 2n - 1 while it is written and 2n once complete, and
+// Header::latest then becomes n. A reader copies slot latest % SLOTS and keeps the copy
+// only if the sequence read 2n both before and after. The writer never waits for
+// readers; a reader more than SLOTS - 1 frames behind simply retries on the newest.
+class PreviewChannel {
+public:
+    enum Format {
+        kRgb8 = 0,
+        kRgbFloat = 1
+    };
+
+    static const int SLOTS = 3;
+
+    struct Header {
+        char magic[8]; // "RTPREV1"
+        uint32_t width;
+        uint32_t height;
+        uint32_t format;
+        uint32_t slots;
+        uint64_t slotBytes;  // SlotHeader plus pixels, 64-byte aligned
+        uint64_t slotOffset; // of slot 0 from the start of the segment
+        std::atomic<uint64_t> latest; // newest complete frame, 0 before the first
+    };
+
+    struct SlotHeader {
+        std::atomic<uint64_t> sequence;
+        uint32_t pass; // 0 for the preview frame
+        uint32_t spp;
+        double seconds;
+    };
+
+    struct Frame {
+        uint64_t number;
+        uint32_t pass;
+        uint32_t spp;
+        double seconds;
+    };
+
+    PreviewChannel() : m_frame(0) {}
+    ~PreviewChannel();
+
+    // writer side
+    bool create(const char* name, int width, int height, Format format);
+    // rows top to bottom, 3 values per pixel of the channel's format
+    void publish(const void* pixels, int pass, int spp, double seconds);
+
+    // viewer side; false while there is no (new) complete frame
+    bool attach(const char* name);
+    bool read(Frame& frame, std::vector<unsigned char>& pixels, uint64_t newerThan = 0) const;
+
+    const Header* header() const { return static_cast<const Header*>( m_memory.data() ); }
+
+private:
+    SlotHeader* slot(uint64_t frame) const;
+    size_t pixel_bytes() const;
+
+    MappedFile m_memory;
+    std::string m_name;
+    uint64_t m_frame;
+};
@@ -0,0 +1,148 @@
+#include "RadianceCache.h"
+
+#include "HitRec.h"
+
+#include <algorithm>
+#include <vector>
+
+#define FIXED_SCALE 65536.0f // fixed-point steps per unit of radiance
+#define MAX_SAMPLE 1.0e6f    // samples are clamped here so the sums cannot overflow
+
+namespace {
+
+uint64_t mix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    return x ^ ( x >> 31 );
+}
+
+} // namespace
+
+RadianceCache::RadianceCache(const Settings& settings, const Vector3& eye, float pixelAngle)
+    : m_settings(settings)
+    , m_eye(eye)
+    , m_cellScale(pixelAngle * settings.cellPixels)
+    , m_cells(new Cell[size_t(1) << settings.bits])
+    , m_shards(new Shard[SHARDS])
+    , m_mask(( size_t(1) << settings.bits ) - 1)
+    , m_used(0) {
+    for ( size_t i = 0; i <= m_mask; ++i ) {
+        Cell& c = m_cells[i];
+        c.key = 0;
+        for ( int k = 0; k < 3; ++k ) {
+            c.sum[k].store(0, std::memory_order_relaxed);
+            c.mean[k] = 0;
+        }
+        c.count.store(0, std::memory_order_relaxed);
+        c.samples = 0;
+    }
+}
+
+RadianceCache::~RadianceCache() {
+}
+
+uint64_t RadianceCache::hash(const HitRec& hrec) const {
+    // the cell size for the distance, rounded down to a power of two
+    float size = std::max(length(hrec.p - m_eye) * m_cellScale, 1e-6f);
+    int level = int(floorf(log2f(size)));
+    float inv = ldexpf(1.0f, -level);
+    int64_t x = int64_t(floorf(hrec.p.getX() * inv));
+    int64_t y = int64_t(floorf(hrec.p.getY() * inv));
+    int64_t z = int64_t(floorf(hrec.p.getZ() * inv));
+    // four steps per normal component: faces at an angle, or back to back, get cells of their own
+    auto quantize = [](float n) { return uint64_t(std::min(std::max(int(( n + 1.0f ) * 2.0f), 0), 3)); };
+    uint64_t normal = quantize(hrec.n.getX()) | quantize(hrec.n.getY()) << 2 | quantize(hrec.n.getZ()) << 4;
+    uint64_t h = mix(uint64_t(x) + 0x9e3779b97f4a7c15ull);
+    h = mix(h ^ uint64_t(y));
+    h = mix(h ^ uint64_t(z));
+    return mix(h ^ ( uint64_t(level + 128) << 6 | normal ));
+}
+
+bool RadianceCache::lookup(const HitRec& hrec, Vector3& radiance) const {
+    uint64_t h = hash(hrec);
+    uint32_t key = std::max(uint32_t(h >> 32), 1u);
+    for ( int i = 0; i < MAX_PROBES; ++i ) {
+        const Cell& c = m_cells[( h + i ) & m_mask];
+        uint32_t k = c.key;
+        if ( k == key ) {
+            if ( c.samples < uint32_t(m_settings.minSamples) ) return false;
+            radiance = Vector3(c.mean[0], c.mean[1], c.mean[2]);
+            return true;
+        }
+        if ( k == 0 ) return false;
+    }
+    return false;
+}
+
+void RadianceCache::update(const HitRec& hrec, const Vector3& radiance) {
+    float value[3] = { radiance.getX(), radiance.getY(), radiance.getZ() };
+    if ( !std::isfinite(value[0] + value[1] + value[2]) ) return;
+    uint64_t fixed[3];
+    for ( int j = 0; j < 3; ++j ) {
+        fixed[j] = uint64_t(std::min(std::max(value[j], 0.0f), MAX_SAMPLE) * FIXED_SCALE + 0.5f);
+    }
+    uint64_t h = hash(hrec);
+    uint32_t key = std::max(uint32_t(h >> 32), 1u);
+    for ( int i = 0; i < MAX_PROBES; ++i ) {
+        Cell& c = m_cells[( h + i ) & m_mask];
+        if ( c.key == key ) {
+            for ( int j = 0; j < 3; ++j ) {
+                c.sum[j].fetch_add(fixed[j], std::memory_order_relaxed);
+            }
+            c.count.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        if ( c.key == 0 ) break;
+    }
+
+    // not in the table yet: set aside for end_pass() to place
+    Shard& shard = m_shards[( h >> 16 ) % SHARDS];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    Pending& p = shard.cells[h];
+    for ( int j = 0; j < 3; ++j ) {
+        p.sum[j] += fixed[j];
+    }
+    ++p.count;
+}
+
+void RadianceCache::end_pass() {
+    // the new cells in hash order, so the slots they take do not depend on which thread saw
+    // them first
+    std::vector< std::pair<uint64_t, Pending> > added;
+    for ( int s = 0; s < SHARDS; ++s ) {
+        added.insert(added.end(), m_shards[s].cells.begin(), m_shards[s].cells.end());
+        m_shards[s].cells.clear();
+    }
+    std::sort(added.begin(), added.end(),
+        [](const std::pair<uint64_t, Pending>& a, const std::pair<uint64_t, Pending>& b) { return a.first < b.first; });
+    for ( auto& a : added ) {
+        uint64_t h = a.first;
+        uint32_t key = std::max(uint32_t(h >> 32), 1u);
+        for ( int i = 0; i < MAX_PROBES; ++i ) {
+            Cell& c = m_cells[( h + i ) & m_mask];
+            if ( c.key == 0 ) {
+                c.key = key;
+            }
+            if ( c.key != key ) continue;
+            for ( int j = 0; j < 3; ++j ) {
+                c.sum[j].fetch_add(a.second.sum[j], std::memory_order_relaxed);
+            }
+            c.count.fetch_add(a.second.count, std::memory_order_relaxed);
+            break;
+        }
+    }
+
+    m_used = 0;
+    for ( size_t i = 0; i <= m_mask; ++i ) {
+        Cell& c = m_cells[i];
+        uint32_t count = c.count.load(std::memory_order_relaxed);
+        if ( count == 0 ) continue;
+        ++m_used;
+        for ( int k = 0; k < 3; ++k ) {
+            c.mean[k] = float(double(c.sum[k].load(std::memory_order_relaxed)) / ( FIXED_SCALE * double(count) ));
+        }
+        c.samples = count;
+    }
+}
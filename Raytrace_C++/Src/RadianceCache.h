@@ -0,0 +1,94 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+struct HitRec;
+
+// World-space radiance cache in a fixed-size hash table ("Fast Path Space Filtering by
+// Jittered Spatial Hashing", Binder et al. 2018, without the jitter). A cell is keyed on the
+// quantized position and normal of a diffuse hit, and holds the mean radiance such hits
+// reflected, learned from every path the renderer completes. Cells grow with the distance
+// from the camera, in powers of two, so each covers about the same number of pixels on the
+// frame. Paths that reach their cache depth end in a cell's mean instead of bouncing on,
+// once the cell has enough samples; that trades the variance of the deep bounces, and most
+// of their time, for some blur and light leaking across cell edges.
+//
+// Render threads add to the cells already in the table with atomic fixed-point sums, so no
+// locks are taken and the result does not depend on the order of the additions. Samples of
+// a cell the table does not hold yet are summed aside, under one of a few locks, and
+// end_pass() places the new cells by linear probing in the order of their hashes: where a
+// cell lands, and which cells are dropped for want of a free slot among their probes once
+// the table fills, does not depend on thread timing either. Lookups read the means of the
+// passes before the current one, which end_pass() publishes. Memory is fixed by the table
+// size, plus the cells first seen in the current pass.
+class RadianceCache {
+public:
+    struct Settings {
+        bool enabled;
+        int depth;        // bounces before a path may end in the cache
+        int bits;         // log2 of the cells in the table
+        float cellPixels; // cell size, in pixels covered at its distance from the camera
+        int minSamples;   // a cell is only used once it has learned from this many hits
+
+        Settings(bool e = true, int d = 2, int b = 20, float c = 8, int m = 32)
+            : enabled(e), depth(d), bits(b), cellPixels(c), minSamples(m) {}
+    };
+
+    // eye: camera position; pixelAngle: angle one pixel subtends there
+    RadianceCache(const Settings& settings, const Vector3& eye, float pixelAngle);
+    ~RadianceCache();
+
+    RadianceCache(const RadianceCache&) = delete;
+    RadianceCache& operator=(const RadianceCache&) = delete;
+
+    int depth() const { return m_settings.depth; }
+
+    // mean radiance reflected at a diffuse hit as of the last pass; false while the cell has
+    // too few samples
+    bool lookup(const HitRec& hrec, Vector3& radiance) const;
+
+    // from the render threads: radiance a diffuse hit was found to reflect
+    void update(const HitRec& hrec, const Vector3& radiance);
+
+    // publish the means learned so far to lookup(); must not overlap rendering
+    void end_pass();
+
+    size_t size() const { return m_mask + 1; }
+    size_t used() const { return m_used; }
+
+private:
+    struct Cell {
+        uint32_t key; // 0 free; only set by end_pass()
+        std::atomic<uint64_t> sum[3];
+        std::atomic<uint32_t> count;
+        float mean[3];    // as of the last end_pass()
+        uint32_t samples; // the same
+    };
+
+    // sums for cells first seen in this pass, by hash
+    struct Pending {
+        uint64_t sum[3];
+        uint32_t count;
+    };
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_map<uint64_t, Pending> cells;
+    };
+
+    static const int MAX_PROBES = 8;
+    static const int SHARDS = 64;
+
+    // table index and nonzero check key of the cell holding hrec
+    uint64_t hash(const HitRec& hrec) const;
+
+    Settings m_settings;
+    Vector3 m_eye;
+    float m_cellScale; // cell size per unit of distance
+    std::unique_ptr<Cell[]> m_cells;
+    std::unique_ptr<Shard[]> m_shards;
+    size_t m_mask;
+    size_t m_used;
+};
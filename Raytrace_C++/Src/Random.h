@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+
+// Numbers a thread's Random hands out in place of its own while set (see Random::set_source)
+class RandomSource {
+public:
+    virtual float next_float() = 0;
+};
+
+// PCG32 generator. Every render thread has its own instance (Random::local()), and the
+// renderer reseeds it per pixel so the image does not depend on how tiles land on threads.
+class Random {
+public:
+    Random() : m_source(nullptr) { seed(0, 0); }
+    Random(uint64_t a, uint64_t b) : m_source(nullptr) { seed(a, b); }
+
+    void seed(uint64_t a, uint64_t b) {
+        m_state = 0;
+        m_inc = ( splitmix(b) << 1u ) | 1u;
+        next();
+        m_state += splitmix(a);
+        next();
+    }
+
+    uint32_t next() {
+        uint64_t old = m_state;
+        m_state = old * 6364136223846793005ull + m_inc;
+        uint32_t xorshifted = uint32_t(( ( old >> 18u ) ^ old ) >> 27u);
+        uint32_t rot = uint32_t(old >> 59u);
+        return ( xorshifted >> rot ) | ( xorshifted << ( ( 0u - rot ) & 31u ) );
+    }
+
+    // [0, 1)
+    float next_float() {
+        if ( m_source ) return m_source->next_float();
+        return float(next() >> 8) * ( 1.0f / 16777216.0f );
+    }
+
+    // Take next_float(), and so drand48(), from source until it is reset to null; Metropolis
+    // sampling replays and perturbs the numbers a path was built from this way.
+    void set_source(RandomSource* source) { m_source = source; }
+
+    static Random& local() {
+        static thread_local Random rng;
+        return rng;
+    }
+
+private:
+    static uint64_t splitmix(uint64_t x) {
+        x += 0x9e3779b97f4a7c15ull;
+        x = ( x ^ ( x >> 30 ) ) * 0xbf58476d1ce4e5b9ull;
+        x = ( x ^ ( x >> 27 ) ) * 0x94d049bb133111ebull;
+        return x ^ ( x >> 31 );
+    }
+
+    uint64_t m_state;
+    uint64_t m_inc;
+    RandomSource* m_source;
+};
@@ -2,6 +2,89 @@
 
 #include "Ray.h"
 #include "HitRec.h"
+#include "LightBounds.h"
+
+// Rects that look smaller than this (estimated from the centre) are sampled by area, which
+// is already close to uniform in solid angle there and much cheaper; so are those close to
+// a hemisphere, where the parametrization loses precision.
+#define MIN_SOLID_ANGLE 0.5f
+#define MAX_SOLID_ANGLE 6.22f
+
+namespace {
+    // angle between unit vectors, accurate for nearly (anti)parallel ones
+    float angle_between(const Vector3& a, const Vector3& b) {
+        if ( dot(a, b) < 0 ) {
+            return PI - 2.0f * asinf(std::min(1.0f, length(a + b) * 0.5f));
+        }
+        return 2.0f * asinf(std::min(1.0f, length(b - a) * 0.5f));
+    }
+
+    // A rectangle as seen from a point, sampled uniformly by solid angle (Urena et al. 2013,
+    // "An Area-Preserving Parametrization for Spherical Rectangles"). The local frame has x
+    // and y along the edges and z facing away from the point.
+    struct SphericalRect {
+        Vector3 o, x, y, z;
+        float x0, x1, y0, y1, z0;
+        float b0, b1, k;
+        float solidAngle;
+
+        SphericalRect(const Vector3& corner, const Vector3& ex, const Vector3& ey, const Vector3& p) {
+            solidAngle = 0;
+            Vector3 d = corner - p;
+            Vector3 c = d + 0.5f * ( ex + ey );
+            float cc = lengthSqr(c);
+            if ( fabsf(dot(c, cross(ex, ey))) <= MIN_SOLID_ANGLE * cc * sqrtf(cc) ) return;
+
+            float exl = length(ex);
+            float eyl = length(ey);
+            o = p;
+            x = ex / exl;
+            y = ey / eyl;
+            z = cross(x, y);
+            x0 = dot(d, x);
+            y0 = dot(d, y);
+            z0 = dot(d, z);
+            if ( z0 > 0 ) {
+                z0 = -z0;
+                z = -z;
+            }
+            x1 = x0 + exl;
+            y1 = y0 + eyl;
+
+            Vector3 v00(x0, y0, z0), v01(x0, y1, z0), v10(x1, y0, z0), v11(x1, y1, z0);
+            Vector3 n0 = normalize(cross(v00, v10));
+            Vector3 n1 = normalize(cross(v10, v11));
+            Vector3 n2 = normalize(cross(v11, v01));
+            Vector3 n3 = normalize(cross(v01, v00));
+            float g0 = angle_between(-n0, n1);
+            float g1 = angle_between(-n1, n2);
+            float g2 = angle_between(-n2, n3);
+            float g3 = angle_between(-n3, n0);
+            b0 = n0.getZ();
+            b1 = n2.getZ();
+            k = PI2 - g2 - g3;
+            solidAngle = g0 + g1 - k;
+        }
+
+        bool usable() const {
+            return solidAngle > 0 && solidAngle < MAX_SOLID_ANGLE;
+        }
+
+        // point on the rect for u, v uniform in [0, 1)
+        Vector3 sample(float u, float v) const {
+            float au = u * solidAngle + k;
+            float fu = ( cosf(au) * b0 - b1 ) / sinf(au);
+            float cu = clamp(copysignf(1.0f, fu) / sqrtf(fu * fu + b0 * b0), -1.0f, 1.0f);
+            float xu = clamp(-( cu * z0 ) / sqrtf(std::max(0.0f, 1.0f - cu * cu)), x0, x1);
+            float d = sqrtf(xu * xu + z0 * z0);
+            float h0 = y0 / sqrtf(d * d + y0 * y0);
+            float h1 = y1 / sqrtf(d * d + y1 * y1);
+            float hv = h0 + v * ( h1 - h0 );
+            float yv = hv * hv < 1.0f - 1e-6f ? hv * d / sqrtf(1.0f - hv * hv) : y1;
+            return o + xu * x + yv * y + z0 * z;
+        }
+    };
+}
 
 bool Rect::hit(const Ray& r, float t0, float t1, HitRec& hrec) const {
 
@@ -30,13 +113,39 @@ bool Rect::hit(const Ray& r, float t0, float t1, HitRec& hrec) const {
     hrec.mat = m_material;
     hrec.p = r.at(t);
     hrec.n = axis;
+    hrec.wo = -normalize(r.direction());
     return true;
 }
 
+void Rect::frame(Vector3& corner, Vector3& ex, Vector3& ey) const {
+    switch ( m_axis ) {
+        case kXY:
+            corner = Vector3(m_x0, m_y0, m_k);
+            ex = Vector3(m_x1 - m_x0, 0, 0);
+            ey = Vector3(0, m_y1 - m_y0, 0);
+            break;
+        case kXZ:
+            corner = Vector3(m_x0, m_k, m_y0);
+            ex = Vector3(m_x1 - m_x0, 0, 0);
+            ey = Vector3(0, 0, m_y1 - m_y0);
+            break;
+        case kYZ:
+            corner = Vector3(m_k, m_x0, m_y0);
+            ex = Vector3(0, m_x1 - m_x0, 0);
+            ey = Vector3(0, 0, m_y1 - m_y0);
+            break;
+    }
+}
+
 float Rect::pdf_value(const Vector3& o, const Vector3& v) const {
-    if ( m_axis != kXZ ) return 0;
     HitRec hrec;
     if ( this->hit(Ray(o, v), 0.001f, FLT_MAX, hrec) ) {
+        Vector3 corner, ex, ey;
+        frame(corner, ex, ey);
+        SphericalRect sr(corner, ex, ey, o);
+        if ( sr.usable() ) {
+            return recip(sr.solidAngle);
+        }
         float area = ( m_x1 - m_x0 ) * ( m_y1 - m_y0 );
         float distance_squared = pow2(hrec.t) * lengthSqr(v);
         float cosine = fabs(dot(v, hrec.n)) / length(v);
@@ -48,21 +157,65 @@ float Rect::pdf_value(const Vector3& o, const Vector3& v) const {
 }
 
 Vector3 Rect::random(const Vector3& o) const {
-    if ( m_axis != kXZ ) return Vector3(1, 0, 0);
-    float x = m_x0 + drand48() * ( m_x1 - m_x0 );
-    float y = m_y0 + drand48() * ( m_y1 - m_y0 );
-    Vector3 random_point;
+    // uniform in the solid angle the rect subtends when it is near, otherwise by area
+    Vector3 corner, ex, ey;
+    frame(corner, ex, ey);
+    SphericalRect sr(corner, ex, ey, o);
+    float u = drand48();
+    float v = drand48();
+    if ( sr.usable() ) {
+        return sr.sample(u, v) - o;
+    }
+    return corner + u * ex + v * ey - o;
+}
+
+float Rect::area() const {
+    return ( m_x1 - m_x0 ) * ( m_y1 - m_y0 );
+}
+
+void Rect::sample_area(HitRec& hrec) const {
+    hrec.u = drand48();
+    hrec.v = drand48();
+    float x = m_x0 + hrec.u * ( m_x1 - m_x0 );
+    float y = m_y0 + hrec.v * ( m_y1 - m_y0 );
+    switch ( m_axis ) {
+        case kXY:
+            hrec.p = Vector3(x, y, m_k);
+            hrec.n = Vector3::zAxis();
+            break;
+        case kXZ:
+            hrec.p = Vector3(x, m_k, y);
+            hrec.n = Vector3::yAxis();
+            break;
+        case kYZ:
+            hrec.p = Vector3(m_k, x, y);
+            hrec.n = Vector3::xAxis();
+            break;
+    }
+    hrec.t = 0;
+    hrec.mat = m_material;
+}
+
+bool Rect::light_bounds(LightBounds& b) const {
     switch ( m_axis ) {
         case kXY:
-            random_point = Vector3(x, y, m_k);
+            b.lo = Vector3(m_x0, m_y0, m_k);
+            b.hi = Vector3(m_x1, m_y1, m_k);
+            b.axis = Vector3::zAxis();
             break;
         case kXZ:
-            random_point = Vector3(x, m_k, y);
+            b.lo = Vector3(m_x0, m_k, m_y0);
+            b.hi = Vector3(m_x1, m_k, m_y1);
+            b.axis = Vector3::yAxis();
             break;
         case kYZ:
-            random_point = Vector3(m_k, x, y);
+            b.lo = Vector3(m_k, m_x0, m_y0);
+            b.hi = Vector3(m_k, m_x1, m_y1);
+            b.axis = Vector3::xAxis();
             break;
     }
-    Vector3 v = random_point - o;
-    return v;
+    b.thetaO = 0;
+    b.thetaE = 0.5f * PI;
+    b.power = 0;
+    return true;
 }
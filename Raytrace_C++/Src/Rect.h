@@ -26,7 +26,16 @@ public:
 
     virtual Vector3 random(const Vector3& o) const override;
 
+    virtual float area() const override;
+
+    virtual void sample_area(HitRec& hrec) const override;
+
+    virtual bool light_bounds(LightBounds& b) const override;
+
 private:
+    // a corner and the two edges from it, in world space
+    void frame(Vector3& corner, Vector3& ex, Vector3& ey) const;
+
     float m_x0, m_x1, m_y0, m_y1, m_k;
     AxisType m_axis;
     MaterialPtr m_material;
@@ -0,0 +1,144 @@
+#include "RestirDI.h"
+
+#include "Shape.h"
+#include "Material.h"
+#include "Film.h"
+
+RestirDI::RestirDI(const Settings& settings, const Shape* world, const std::vector<ShapePtr>& emitters, int width, int height)
+    : m_settings(settings)
+    , m_world(world)
+    , m_emitters(emitters)
+    , m_width(width)
+    , m_height(height)
+    , m_vertices(size_t(width) * height)
+    , m_initial(size_t(width) * height)
+    , m_final(size_t(width) * height) {
+    m_settings.neighbours = std::min(m_settings.neighbours, MAX_NEIGHBOURS);
+    std::vector<float> power;
+    for ( auto& e : m_emitters ) {
+        m_areas.push_back(e->area());
+        power.push_back(e->power());
+    }
+    m_pick = AliasTable(power);
+    for ( auto& v : m_vertices ) {
+        v.valid = false;
+    }
+}
+
+Vector3 RestirDI::contribution(const Vertex& v, const LightReservoir& r) const {
+    Vector3 d = r.point - v.hrec.p;
+    float dd = lengthSqr(d);
+    float cosine = -dot(r.normal, d);
+    if ( dd <= 0 || cosine <= 0 ) {
+        return Vector3(0);
+    }
+    float brdf = v.hrec.mat->scattering_pdf(Ray(v.hrec.p, d), v.hrec);
+    return mulPerElem(v.srec.albedo, r.emitted) * ( brdf * cosine / ( dd * sqrtf(dd) ) );
+}
+
+float RestirDI::target(const Vertex& v, const LightReservoir& r) const {
+    return luminance(contribution(v, r));
+}
+
+bool RestirDI::visible(const Vector3& from, const Vector3& to) const {
+    HitRec hrec;
+    return !m_world->hit(Ray(from, to - from), 0.001f, 0.999f, hrec);
+}
+
+bool RestirDI::similar(const Vertex& a, const Vertex& b) {
+    return a.valid && b.valid && dot(a.hrec.n, b.hrec.n) >= 0.9f && fabsf(a.depth - b.depth) <= 0.1f * b.depth;
+}
+
+void RestirDI::resample_initial(int x, int y, const Vertex& vertex) {
+    size_t index = size_t(m_width) * y + x;
+    Vertex& v = m_vertices[index];
+    bool history = m_settings.history > 0 && similar(v, vertex);
+    v = vertex;
+
+    LightReservoir& r = m_initial[index];
+    r.reset();
+    if ( !v.valid || m_pick.empty() ) return;
+
+    // RIS from emitters picked by power, uniform points on them
+    for ( int c = 0; c < m_settings.candidates; ++c ) {
+        int k = m_pick.sample(drand48());
+        HitRec lrec;
+        m_emitters[k]->sample_area(lrec);
+        LightReservoir candidate;
+        candidate.point = lrec.p;
+        candidate.normal = lrec.n;
+        candidate.emitted = lrec.mat->emitted(Ray(v.hrec.p, lrec.p - v.hrec.p), lrec);
+        float pdf = m_pick.pmf(k) / m_areas[k];
+        r.update(candidate.point, candidate.normal, candidate.emitted, target(v, candidate) / pdf, drand48());
+    }
+    float t = r.wSum > 0 ? target(v, r) : 0.0f;
+    r.W = t > 0 ? r.wSum / ( r.M * t ) : 0.0f;
+
+    // an occluded pick would only spread its shadow to the next frame and the neighbours
+    if ( r.W > 0 && !visible(v.hrec.p, r.point) ) {
+        r.wSum = 0;
+        r.W = 0;
+    }
+
+    if ( history ) {
+        const LightReservoir& prev = m_final[index];
+        float count = std::min(prev.M, float(m_settings.history * m_settings.candidates));
+        r.merge(prev, prev.W > 0 ? target(v, prev) : 0.0f, count, drand48());
+        t = r.wSum > 0 ? target(v, r) : 0.0f;
+        r.W = t > 0 ? r.wSum / ( r.M * t ) : 0.0f;
+    }
+}
+
+void RestirDI::resample_spatial(int x, int y) {
+    size_t index = size_t(m_width) * y + x;
+    const Vertex& v = m_vertices[index];
+    LightReservoir& r = m_final[index];
+    r = m_initial[index];
+    if ( !v.valid || m_settings.neighbours <= 0 ) return;
+
+    size_t merged[MAX_NEIGHBOURS];
+    int count = 0;
+    for ( int k = 0; k < m_settings.neighbours; ++k ) {
+        float angle = PI2 * drand48();
+        float radius = m_settings.radius * sqrtf(drand48());
+        int nx = x + int(floorf(radius * cosf(angle) + 0.5f));
+        int ny = y + int(floorf(radius * sinf(angle) + 0.5f));
+        if ( nx < 0 || ny < 0 || nx >= m_width || ny >= m_height || ( nx == x && ny == y ) ) continue;
+        size_t ni = size_t(m_width) * ny + nx;
+        if ( !similar(m_vertices[ni], v) ) continue;
+
+        const LightReservoir& q = m_initial[ni];
+        float t = q.W > 0 ? target(v, q) : 0.0f;
+        if ( t > 0 && !visible(v.hrec.p, q.point) ) {
+            t = 0;
+        }
+        r.merge(q, t, q.M, drand48());
+        merged[count++] = ni;
+    }
+
+    // 1/Z: count only the pixels that could have produced the pick, or shadow and light
+    // boundaries bleed into each other
+    if ( r.wSum <= 0 ) {
+        r.W = 0;
+        return;
+    }
+    float Z = m_initial[index].M;
+    for ( int k = 0; k < count; ++k ) {
+        const Vertex& nv = m_vertices[merged[k]];
+        if ( target(nv, r) > 0 && visible(nv.hrec.p, r.point) ) {
+            Z += m_initial[merged[k]].M;
+        }
+    }
+    float t = target(v, r);
+    r.W = t > 0 ? r.wSum / ( Z * t ) : 0.0f;
+}
+
+Vector3 RestirDI::shade(int x, int y) const {
+    size_t index = size_t(m_width) * y + x;
+    const Vertex& v = m_vertices[index];
+    const LightReservoir& r = m_final[index];
+    if ( !v.valid || r.W <= 0 || !visible(v.hrec.p, r.point) ) {
+        return Vector3(0);
+    }
+    return mulPerElem(v.throughput, contribution(v, r) * r.W);
+}
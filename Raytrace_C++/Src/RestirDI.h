@@ -0,0 +1,84 @@
+#pragma once
+
+#include "HitRec.h"
+#include "ScatterRec.h"
+#include "LightReservoir.h"
+#include "AliasTable.h"
+
+#include <vector>
+
+class Shape;
+
+// Reservoir-based spatiotemporal importance resampling of direct light (Bitterli et al.
+// 2020), the CPU counterpart of DXRTest's ReSTIR_DI.hlsli. Each frame (one sample per pixel)
+// every pixel resamples a few light candidates, merges its reservoir from the previous frame
+// and then, in a separate pass, the reservoirs of random neighbours, so one shadow ray ends
+// up carrying the best of hundreds of light samples. Reservoirs persist across frames.
+//
+// Spatial merges test visibility from the receiving pixel and normalize by the neighbours
+// that could have produced (and see) the sample, the paper's 1/Z, which keeps shadow edges
+// from darkening. Temporal reuse is capped at history * candidates samples; unlike a
+// real-time frame, the film averages every frame anyway, so a long history mostly adds
+// correlation between them.
+class RestirDI {
+public:
+    struct Settings {
+        int candidates; // light samples per pixel and frame (0: off)
+        int history;    // temporal reuse, in multiples of candidates (0: off)
+        int neighbours; // reservoirs merged in the spatial pass (0: off)
+        float radius;   // spatial search radius in pixels
+
+        Settings(int c = 8, int h = 1, int n = 4, float r = 16)
+            : candidates(c), history(h), neighbours(n), radius(r) {}
+    };
+
+    // a pixel's first diffuse hit, reached through mirrors and glass
+    struct Vertex {
+        HitRec hrec;
+        ScatterRec srec;
+        Vector3 throughput; // of the specular bounces in front of it
+        Vector3 radiance;   // emission and background picked up on the way, weighted
+        float depth;        // path length from the camera
+        int bounces;
+        bool valid;         // false when the path ended before a diffuse hit
+    };
+
+    // emitters: every shape whose material emits; they are picked by power and sampled by area
+    RestirDI(const Settings& settings, const Shape* world, const std::vector<ShapePtr>& emitters, int width, int height);
+
+    const Settings& settings() const { return m_settings; }
+
+    // First pass of a frame, for every pixel: resample light candidates for the pixel's new
+    // vertex, keep the pick only if it is visible and merge the previous frame's reservoir.
+    void resample_initial(int x, int y, const Vertex& vertex);
+
+    // Second pass, after the first has finished for the whole frame: merge neighbours.
+    void resample_spatial(int x, int y);
+
+    // direct light at the pixel's vertex from its final reservoir, with one shadow ray
+    Vector3 shade(int x, int y) const;
+
+    const Vertex& vertex(int x, int y) const { return m_vertices[size_t(m_width) * y + x]; }
+
+    // whether two pixels' vertices are close enough in depth and orientation to share samples
+    static bool similar(const Vertex& a, const Vertex& b);
+
+private:
+    static const int MAX_NEIGHBOURS = 16;
+
+    // unshadowed brdf * emitted * geometry term of a light sample at the vertex
+    Vector3 contribution(const Vertex& v, const LightReservoir& r) const;
+    float target(const Vertex& v, const LightReservoir& r) const;
+    bool visible(const Vector3& from, const Vector3& to) const;
+
+    Settings m_settings;
+    const Shape* m_world;
+    std::vector<ShapePtr> m_emitters;
+    std::vector<float> m_areas;
+    AliasTable m_pick; // by power
+    int m_width;
+    int m_height;
+    std::vector<Vertex> m_vertices;
+    std::vector<LightReservoir> m_initial; // after the first pass
+    std::vector<LightReservoir> m_final;   // after the spatial pass; the next frame's history
+};
@@ -0,0 +1,165 @@
+#include "RestirGI.h"
+
+#include "Shape.h"
+#include "Material.h"
+#include "Film.h"
+
+#define MAX_JACOBIAN 10.0f // reconnections that stretch or squeeze solid angle more are not reused
+
+RestirGI::RestirGI(const Settings& settings, const Shape* world, int width, int height)
+    : m_settings(settings)
+    , m_world(world)
+    , m_width(width)
+    , m_height(height)
+    , m_vertices(size_t(width) * height)
+    , m_initial(size_t(width) * height)
+    , m_final(size_t(width) * height) {
+    m_settings.neighbours = std::min(m_settings.neighbours, MAX_NEIGHBOURS);
+    for ( auto& v : m_vertices ) {
+        v.valid = false;
+    }
+}
+
+Vector3 RestirGI::contribution(const Vertex& v, const GIReservoir& r) const {
+    Ray ray(v.hrec.p, r.point - v.hrec.p);
+    float brdf = v.hrec.mat->scattering_pdf(ray, v.hrec);
+    return mulPerElem(v.srec.albedo, r.radiance) * brdf;
+}
+
+float RestirGI::target(const Vertex& v, const GIReservoir& r) const {
+    return luminance(contribution(v, r));
+}
+
+float RestirGI::jacobian(const Vector3& from, const Vector3& to, const GIReservoir& r) {
+    Vector3 dq = from - r.point;
+    Vector3 dr = to - r.point;
+    float lq = lengthSqr(dq);
+    float lr = lengthSqr(dr);
+    if ( lq <= 0 || lr <= 0 ) {
+        return 0;
+    }
+    // cosines at the sample point, towards either vertex
+    float cq = fabsf(dot(r.normal, dq)) / sqrtf(lq);
+    float cr = fabsf(dot(r.normal, dr)) / sqrtf(lr);
+    if ( cq <= 0 ) {
+        return 0;
+    }
+    float j = ( cr * lq ) / ( cq * lr );
+    return j <= MAX_JACOBIAN && j >= 1.0f / MAX_JACOBIAN ? j : 0.0f;
+}
+
+bool RestirGI::visible(const Vector3& from, const Vector3& to) const {
+    // a unit direction keeps the epsilon absolute: sky samples lie GI_SKY_DISTANCE away, where
+    // a fraction of the segment would skip every occluder near the vertex
+    Vector3 d = to - from;
+    float dist = length(d);
+    HitRec hrec;
+    return !m_world->hit(Ray(from, d / dist), 0.001f, dist - 0.001f, hrec);
+}
+
+float RestirGI::reuse_target(const Vector3& from, const Vertex& to, const GIReservoir& r, float& j) const {
+    j = 0;
+    if ( !r.diffuse ) {
+        return 0;
+    }
+    j = jacobian(from, to.hrec.p, r);
+    if ( j <= 0 ) {
+        return 0;
+    }
+    float t = target(to, r);
+    if ( t > 0 && m_settings.unbiased && !visible(to.hrec.p, r.point) ) {
+        t = 0;
+    }
+    return t;
+}
+
+bool RestirGI::shiftable(const Vertex& from, const Vertex& to, const GIReservoir& r) const {
+    return r.diffuse && jacobian(from.hrec.p, to.hrec.p, r) > 0 && target(from, r) > 0 &&
+        ( !m_settings.unbiased || visible(from.hrec.p, r.point) );
+}
+
+void RestirGI::resample_initial(int x, int y, const Vertex& vertex, const Sample& sample) {
+    size_t index = size_t(m_width) * y + x;
+    Vertex& v = m_vertices[index];
+    bool history = m_settings.history > 0 && RestirDI::similar(v, vertex);
+    Vertex previous = v;
+    v = vertex;
+
+    GIReservoir& r = m_initial[index];
+    r.reset();
+    if ( !v.valid ) return;
+
+    // the new path, weighted by target / source pdf
+    GIReservoir candidate;
+    candidate.point = sample.point;
+    candidate.radiance = sample.radiance;
+    float weight = sample.pdf > 0 ? target(v, candidate) / sample.pdf : 0.0f;
+    r.update(sample.point, sample.normal, sample.radiance, sample.diffuse, weight, drand48());
+    float t = r.wSum > 0 ? target(v, r) : 0.0f;
+    r.W = t > 0 ? r.wSum / ( r.M * t ) : 0.0f;
+
+    if ( history ) {
+        const GIReservoir& prev = m_final[index];
+        float count = std::min(prev.M, float(m_settings.history));
+        float j;
+        float tp = prev.W > 0 ? reuse_target(previous.hrec.p, v, prev, j) : 0.0f;
+        r.merge(prev, tp, j, count, drand48());
+        if ( r.wSum > 0 && !shiftable(previous, v, r) ) {
+            // the new path, which the previous vertex could not have handed on: 1/Z, and the
+            // reservoir stands for that one path when neighbours count it in turn
+            r.M -= count;
+        }
+        t = r.wSum > 0 ? target(v, r) : 0.0f;
+        r.W = t > 0 ? r.wSum / ( r.M * t ) : 0.0f;
+    }
+}
+
+void RestirGI::resample_spatial(int x, int y) {
+    size_t index = size_t(m_width) * y + x;
+    const Vertex& v = m_vertices[index];
+    GIReservoir& r = m_final[index];
+    r = m_initial[index];
+    if ( !v.valid || m_settings.neighbours <= 0 ) return;
+
+    size_t merged[MAX_NEIGHBOURS];
+    int count = 0;
+    for ( int k = 0; k < m_settings.neighbours; ++k ) {
+        float angle = PI2 * drand48();
+        float radius = m_settings.radius * sqrtf(drand48());
+        int nx = x + int(floorf(radius * cosf(angle) + 0.5f));
+        int ny = y + int(floorf(radius * sinf(angle) + 0.5f));
+        if ( nx < 0 || ny < 0 || nx >= m_width || ny >= m_height || ( nx == x && ny == y ) ) continue;
+        size_t ni = size_t(m_width) * ny + nx;
+        if ( !RestirDI::similar(m_vertices[ni], v) ) continue;
+
+        const GIReservoir& q = m_initial[ni];
+        float j;
+        float t = q.W > 0 ? reuse_target(m_vertices[ni].hrec.p, v, q, j) : 0.0f;
+        r.merge(q, t, j, q.M, drand48());
+        merged[count++] = ni;
+    }
+
+    if ( r.wSum <= 0 ) {
+        r.W = 0;
+        return;
+    }
+    // 1/Z: count only the pixels that could have produced the pick and handed it on
+    float Z = m_initial[index].M;
+    for ( int k = 0; k < count; ++k ) {
+        if ( shiftable(m_vertices[merged[k]], v, r) ) {
+            Z += m_initial[merged[k]].M;
+        }
+    }
+    float t = target(v, r);
+    r.W = t > 0 ? r.wSum / ( Z * t ) : 0.0f;
+}
+
+Vector3 RestirGI::shade(int x, int y) const {
+    size_t index = size_t(m_width) * y + x;
+    const Vertex& v = m_vertices[index];
+    const GIReservoir& r = m_final[index];
+    if ( !v.valid || r.W <= 0 ) {
+        return Vector3(0);
+    }
+    return mulPerElem(v.throughput, contribution(v, r) * r.W);
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "RestirDI.h"
+#include "GIReservoir.h"
+
+#include <vector>
+
+// Reservoir-based resampling of indirect light (Ouyang et al. 2021), the CPU counterpart of
+// DXRTest's ReSTIR_GI.hlsli. Each frame every pixel traces one path from its first diffuse
+// hit and keeps the secondary hit and the radiance leaving it as a sample. Reservoirs of
+// such samples are merged with the pixel's previous frame and with random neighbours, each
+// reconnecting its first hit straight to the other's secondary hit; the Jacobian of that
+// reconnection converts the other pixel's solid-angle weights to this one's.
+//
+// Merges normalize by the pixels that could have produced the chosen sample and handed it
+// on, the paper's 1/Z. The radiance of a reused sample is only valid if it does not depend
+// on the direction, so samples on mirrors and glass stay with the pixel that traced them.
+// Unbiased mode traces a visibility ray for every reused sample and every pixel counted in
+// Z; biased mode skips those rays, which is cheaper but lets light leak past occluders.
+class RestirGI {
+public:
+    struct Settings {
+        bool enabled;
+        int history;    // temporal reuse cap, in frames (0: off); the film averages frames anyway
+        int neighbours; // reservoirs merged in the spatial pass (0: off)
+        float radius;   // spatial search radius in pixels
+        bool unbiased;
+
+        Settings(bool e = true, int h = 2, int n = 4, float r = 16, bool u = true)
+            : enabled(e), history(h), neighbours(n), radius(r), unbiased(u) {}
+    };
+
+    typedef RestirDI::Vertex Vertex;
+
+    // one path traced from a vertex
+    struct Sample {
+        Vector3 point;    // secondary hit, or a far point in the direction of an escaped ray
+        Vector3 normal;
+        Vector3 radiance; // outgoing radiance there, without its emission (left to direct light)
+        float pdf;        // solid-angle pdf of the direction the path left the vertex in
+        bool diffuse;     // Lambertian (or black, or sky), so the radiance holds towards any vertex
+    };
+
+    RestirGI(const Settings& settings, const Shape* world, int width, int height);
+
+    const Settings& settings() const { return m_settings; }
+
+    // First pass of a frame, for every pixel: start the reservoir with the new vertex's
+    // sample and merge the previous frame's reservoir.
+    void resample_initial(int x, int y, const Vertex& vertex, const Sample& sample);
+
+    // Second pass, after the first has finished for the whole frame: merge neighbours.
+    void resample_spatial(int x, int y);
+
+    // indirect light at the pixel's vertex from its final reservoir
+    Vector3 shade(int x, int y) const;
+
+private:
+    static const int MAX_NEIGHBOURS = 16;
+
+    // brdf * radiance * cosine of the sample at the vertex
+    Vector3 contribution(const Vertex& v, const GIReservoir& r) const;
+    float target(const Vertex& v, const GIReservoir& r) const;
+    // d(solid angle at to) / d(solid angle at from) of the direction to the sample point;
+    // 0 when the reconnection is too distorted to be worth reusing
+    static float jacobian(const Vector3& from, const Vector3& to, const GIReservoir& r);
+    bool visible(const Vector3& from, const Vector3& to) const;
+    // target at vertex to of r's sample, traced from the vertex at from, and the jacobian of
+    // that reconnection; 0 if the sample may not be reused there
+    float reuse_target(const Vector3& from, const Vertex& to, const GIReservoir& r, float& j) const;
+    // whether vertex from could have produced r's sample and handed it on to vertex to;
+    // 1/Z counts the candidates of the vertices for which this holds
+    bool shiftable(const Vertex& from, const Vertex& to, const GIReservoir& r) const;
+
+    Settings m_settings;
+    const Shape* m_world;
+    int m_width;
+    int m_height;
+    std::vector<Vertex> m_vertices;
+    std::vector<GIReservoir> m_initial; // after the first pass
+    std::vector<GIReservoir> m_final;   // after the spatial pass; the next frame's history
+};
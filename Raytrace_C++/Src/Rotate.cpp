@@ -2,6 +2,7 @@
 
 #include "Ray.h"
 #include "HitRec.h"
+#include "LightBounds.h"
 
 bool Rotate::hit(const Ray& r, float t0, float t1, HitRec& hrec) const {
     Quat revq = conj(m_quat);
@@ -11,9 +12,43 @@ bool Rotate::hit(const Ray& r, float t0, float t1, HitRec& hrec) const {
     if ( m_shape->hit(rot_r, t0, t1, hrec) ) {
         hrec.p = rotate(m_quat, hrec.p);
         hrec.n = rotate(m_quat, hrec.n);
+        hrec.wo = rotate(m_quat, hrec.wo);
         return true;
     }
     else {
         return false;
     }
 }
+
+float Rotate::pdf_value(const Vector3& o, const Vector3& v) const {
+    // directions keep their solid angle under rotation
+    Quat revq = conj(m_quat);
+    return m_shape->pdf_value(rotate(revq, o), rotate(revq, v));
+}
+
+Vector3 Rotate::random(const Vector3& o) const {
+    Quat revq = conj(m_quat);
+    return rotate(m_quat, m_shape->random(rotate(revq, o)));
+}
+
+void Rotate::sample_area(HitRec& hrec) const {
+    m_shape->sample_area(hrec);
+    hrec.p = rotate(m_quat, hrec.p);
+    hrec.n = rotate(m_quat, hrec.n);
+}
+
+bool Rotate::light_bounds(LightBounds& b) const {
+    if ( !m_shape->light_bounds(b) ) {
+        return false;
+    }
+    Vector3 lo = b.lo;
+    Vector3 hi = b.hi;
+    for ( int i = 0; i < 8; ++i ) {
+        Vector3 corner(i & 1 ? hi.getX() : lo.getX(), i & 2 ? hi.getY() : lo.getY(), i & 4 ? hi.getZ() : lo.getZ());
+        corner = rotate(m_quat, corner);
+        b.lo = i == 0 ? corner : minPerElem(b.lo, corner);
+        b.hi = i == 0 ? corner : maxPerElem(b.hi, corner);
+    }
+    b.axis = rotate(m_quat, b.axis);
+    return true;
+}
@@ -11,6 +11,18 @@ public:
 
     virtual bool hit(const Ray& r, float t0, float t1, HitRec& hrec) const override;
 
+    virtual float pdf_value(const Vector3& o, const Vector3& v) const override;
+
+    virtual Vector3 random(const Vector3& o) const override;
+
+    virtual float area() const override {
+        return m_shape->area();
+    }
+
+    virtual void sample_area(HitRec& hrec) const override;
+
+    virtual bool light_bounds(LightBounds& b) const override;
+
 private:
     ShapePtr m_shape;
     Quat m_quat;
@@ -9,4 +9,5 @@ struct ScatterRec {
     Vector3 albedo;
     const Pdf* pdf; // for importance sampling
     bool is_specular;
+    bool is_diffuse; // Lambertian: the same radiance leaves in every direction
 };
\ No newline at end of file
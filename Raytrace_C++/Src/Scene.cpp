@@ -5,11 +5,29 @@
 #include <stb_image.h>
 #include <stb_image_write.h>
 
-#define NUM_THREAD 6
+#define TILE_SIZE 32
+#define PREVIEW_BLOCK 8
+#define MAX_PASS_SPP 16
 #define MAX_DEPTH 50 // max reflection count
+#define ROULETTE_DEPTH 3 // diffuse bounces from here on may end the path by Russian roulette
+#define GBUFFER_SPP 4
+#define GBUFFER_SPECULAR_DEPTH 4 // mirror and glass bounces followed for the G-buffer
+#define GI_SKY_DISTANCE 1e5f // where ReSTIR GI places the secondary hit of an escaped path
+
+#include "TileScheduler.h"
+#include "Checkpoint.h"
+#include "StripWriter.h"
+
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <fstream>
+#include <map>
+#include <mutex>
 
 // Objects
 #include "ShapeList.h"
+#include "LightTree.h"
 //#include "Sphere.h"
 //#include "Rect.h"
 //#include "FlipNormals.h"
@@ -21,7 +39,7 @@
 #include "ScatterRec.h"
 #include "CosinePdf.h"
 #include "ShapePdf.h"
-#include "MixturePdf.h"
+#include "GuidedPdf.h"
 
 // Materials
 #include "Lambertian.h"
@@ -37,13 +55,14 @@
 void Scene::build() {
 
     m_backColor = Vector3(0);
+    HdrImageAssetPtr environment = m_envSettings.path.empty() ? nullptr : m_assets.hdr_image(m_envSettings.path);
 
     // Camera
 
     Vector3 lookfrom(278, 278, -800);
     Vector3 lookat(278, 278, 0);
     Vector3 vup(0, 1, 0);
-    float aspect = float(m_image->width()) / float(m_image->height());
+    float aspect = float(m_width) / float(m_height);
     m_camera = std::make_unique<Camera>(lookfrom, lookat, vup, 40, aspect);
 
     // Materials
@@ -67,6 +86,7 @@ void Scene::build() {
     world->add(builder.rectYZ(0, 555, 0, 555, 555, green).flip().get());
     world->add(builder.rectYZ(0, 555, 0, 555, 0, red).get());
     world->add(builder.rectXZ(213, 343, 227, 332, 554, light).flip().get());
+    m_emitters.push_back(builder.get());
     world->add(builder.rectXZ(0, 555, 0, 555, 555, white).flip().get());
     world->add(builder.rectXZ(0, 555, 0, 555, 0, white).get());
     world->add(builder.rectXY(0, 555, 0, 555, 555, white).flip().get());
@@ -78,12 +98,41 @@ void Scene::build() {
         .get());
     m_world.reset(world);
 
+    // Files requested above (the environment image; image textures and meshes go through
+    // m_assets.image() and ShapeBuilder::mesh(m_assets.mesh()) the same way) have been
+    // loading in the background; mesh emitters need theirs for their area and bounds. The
+    // report lists them, and prints nothing when no file was requested.
+    m_assets.wait();
+    m_assets.report(std::cerr);
 
-    // Lights
-    ShapeList* l = new ShapeList();
-    l->add(builder.rectXZ(213, 343, 227, 332, 554, MaterialPtr()).get());
-    l->add(builder.sphere(Vector3(190, 90, 190), 90, MaterialPtr()).get());
-    m_light.reset(l);
+    // Lights: every emitter, and the environment; the tree cannot hold the environment, which
+    // has no bounds, so it is picked against the whole tree by power
+    if ( environment ) {
+        m_environment = std::make_shared<EnvironmentLight>(environment, m_envSettings);
+    }
+    if ( m_lightSelection == kLightTree && !m_environment ) {
+        m_light.reset(new LightTree(m_emitters));
+    }
+    else if ( m_lightSelection == kLightTree ) {
+        ShapeList* l = new ShapeList();
+        l->add(std::make_shared<LightTree>(m_emitters));
+        l->add(m_environment);
+        l->weight_by_power();
+        m_light.reset(l);
+    }
+    else {
+        ShapeList* l = new ShapeList();
+        for ( auto& e : m_emitters ) {
+            l->add(e);
+        }
+        if ( m_environment ) {
+            l->add(m_environment);
+        }
+        if ( m_lightSelection == kLightPower ) {
+            l->weight_by_power();
+        }
+        m_light.reset(l);
+    }
 }
 
 float Scene::hit_sphere(const Vector3& center, float radius, const Ray& r) const {
@@ -100,57 +149,971 @@ float Scene::hit_sphere(const Vector3& center, float radius, const Ray& r) const
     }
 }
 
-Vector3 Scene::color(const Ray& r, const Shape* world, const Shape* light, int depth) const {
+Vector3 Scene::color(const Ray& r, const Shape* world, const Shape* light, int depth, bool caustic) const {
     HitRec hrec;
     if ( world->hit(r, 0.001f, FLT_MAX, hrec) ) {
-        Vector3 emitted = hrec.mat->emitted(r, hrec);
-        ScatterRec srec;
-        if ( depth < MAX_DEPTH && hrec.mat->scatter(r, hrec, srec) ) {
-            if ( srec.is_specular ) {
-                return emitted + mulPerElem(srec.albedo, color(srec.ray, world, light, depth + 1));
-            }
-            else {
-                ShapePdf shapePdf(light, hrec.p);
-                MixturePdf mixPdf(&shapePdf, srec.pdf);
-                srec.ray = Ray(hrec.p, mixPdf.generate(hrec));
-                float pdf_value = mixPdf.value(hrec, srec.ray.direction());
-                if ( pdf_value > 0 ) {
-                    float spdf_value = hrec.mat->scattering_pdf(srec.ray, hrec);
-                    Vector3 albedo = srec.albedo * spdf_value;
-                    return emitted + mulPerElem(albedo, color(srec.ray, world, light, depth + 1)) / pdf_value;
+        Vector3 reflection = reflected(r, hrec, world, light, depth, caustic);
+        return caustic ? reflection : hrec.mat->emitted(r, hrec) + reflection;
+    }
+    return background(r.direction());
+}
+
+Vector3 Scene::reflected(const Ray& r, const HitRec& hrec, const Shape* world, const Shape* light, int depth, bool caustic) const {
+    ScatterRec srec;
+    if ( depth < MAX_DEPTH && hrec.mat->scatter(r, hrec, srec) ) {
+        if ( srec.is_specular ) {
+            return mulPerElem(srec.albedo, color(srec.ray, world, light, depth + 1, caustic));
+        }
+        else {
+            // Next-event estimation: a shadow ray towards a light sample and a scattered ray
+            // from the material's pdf, both counting the emission they reach (or the
+            // environment, if they escape), weighted by the power heuristic against the other
+            // strategy's pdf for the same direction.
+            // With path guiding the scattered ray comes from the mixture of the material's
+            // pdf and the guide learned around the point. With caustic photons, light through
+            // mirrors and glass is gathered from the photon map, and the scattered path leaves
+            // out the emission it reaches that way. With a radiance cache, paths deep enough end
+            // on a Lambertian surface in the radiance cached for the point, and every other
+            // Lambertian hit teaches the cache what it reflected; glossy metal reflects
+            // differently in every direction and is left out.
+            Vector3 cached;
+            bool cacheable = m_cache && srec.is_diffuse;
+            if ( cacheable && depth >= m_cache->depth() && m_cache->lookup(hrec, cached) ) {
+                return cached;
+            }
+            PathGuide::Region* region = m_guide ? m_guide->region(hrec.p) : nullptr;
+            GuidedPdf pdf(srec.pdf, region);
+            Vector3 c = m_photons ? m_photons->gather(hrec, srec) : Vector3(0);
+            ShapePdf shapePdf(light, hrec.p);
+            Ray shadow(hrec.p, shapePdf.generate(hrec));
+            float light_pdf = shapePdf.value(hrec, shadow.direction());
+            HitRec lrec;
+            if ( light_pdf > 0 ) {
+                Vector3 le(0);
+                if ( world->hit(shadow, 0.001f, FLT_MAX, lrec) ) {
+                    le = lrec.mat->emitted(shadow, lrec);
+                }
+                else if ( m_environment ) {
+                    le = m_environment->radiance(shadow.direction());
+                }
+                if ( maxElem(le) > 0 ) {
+                    float weight = power_heuristic(light_pdf, pdf.value(hrec, shadow.direction()));
+                    Vector3 albedo = srec.albedo * hrec.mat->scattering_pdf(shadow, hrec);
+                    c += mulPerElem(albedo, le) * ( weight / light_pdf );
+                }
+            }
+
+            // Russian roulette: continue with a probability that follows the albedo
+            float survive = 1.0f;
+            if ( depth >= ROULETTE_DEPTH ) {
+                survive = std::min(maxElem(srec.albedo), 0.95f);
+                if ( drand48() >= survive ) {
+                    if ( cacheable ) {
+                        m_cache->update(hrec, c);
+                    }
+                    return c;
+                }
+            }
+
+            srec.ray = Ray(hrec.p, pdf.generate(hrec));
+            float pdf_value = pdf.value(hrec, srec.ray.direction()) * survive;
+            if ( pdf_value > 0 ) {
+                Vector3 albedo = srec.albedo * hrec.mat->scattering_pdf(srec.ray, hrec);
+                HitRec next;
+                Vector3 li;
+                Vector3 incident; // everything arriving along the ray, for the guide
+                if ( world->hit(srec.ray, 0.001f, FLT_MAX, next) ) {
+                    li = reflected(srec.ray, next, world, light, depth + 1, m_photons != nullptr);
+                    incident = li;
+                    Vector3 le = next.mat->emitted(srec.ray, next);
+                    if ( maxElem(le) > 0 ) {
+                        li += le * power_heuristic(pdf_value / survive, shapePdf.value(hrec, srec.ray.direction()));
+                        incident += le;
+                    }
                 }
                 else {
-                    return emitted;
+                    li = background(srec.ray.direction());
+                    incident = li;
+                    if ( m_environment ) {
+                        li *= power_heuristic(pdf_value / survive, shapePdf.value(hrec, srec.ray.direction()));
+                    }
+                }
+                c += mulPerElem(albedo, li) / pdf_value;
+
+                if ( m_guide && m_guide->training() ) {
+                    PathGuide::Record record;
+                    record.radiance = luminance(incident);
+                    record.product = luminance(mulPerElem(albedo, incident));
+                    record.bsdfPdf = pdf.bsdf_value(hrec, srec.ray.direction());
+                    record.guidePdf = pdf.guide_value(hrec, srec.ray.direction());
+                    record.pdf = pdf_value;
+                    m_guide->record(region, hrec.p, srec.ray.direction(), record);
                 }
             }
+            if ( cacheable ) {
+                m_cache->update(hrec, c);
+            }
+            return c;
         }
-        else {
-            return emitted;
+    }
+    return Vector3(0);
+}
+
+void Scene::renderPreview(TileScheduler& scheduler, int blockSize) {
+    // one sample per block, stretched over the block; shown once and never accumulated
+    int nx = m_width;
+    int ny = m_height;
+    scheduler.run([&](const Tile& tile, int thread) {
+        Random& rng = Random::local();
+        for ( int by = tile.y0 - tile.y0 % blockSize; by < tile.y1; by += blockSize ) {
+            for ( int bx = tile.x0 - tile.x0 % blockSize; bx < tile.x1; bx += blockSize ) {
+                rng.seed(~0ull, uint64_t(by) * nx + bx);
+                float u = ( float(bx) + 0.5f * blockSize ) / float(nx);
+                float v = ( float(by) + 0.5f * blockSize ) / float(ny);
+                Vector3 c = color(m_camera->getRay(u, v), m_world.get(), m_light.get(), 0);
+                for ( int j = std::max(by, tile.y0); j < std::min(by + blockSize, tile.y1); ++j ) {
+                    for ( int i = std::max(bx, tile.x0); i < std::min(bx + blockSize, tile.x1); ++i ) {
+                        m_image->write(i, ( ny - j - 1 ), c.getX(), c.getY(), c.getZ());
+                    }
+                }
+            }
         }
+    }, "Preview");
+}
+
+Vector3 Scene::samplePixel(int i, int j, int firstSample, int spp, float& lumSq) const {
+    // seeded by pixel and sample index, so the result does not depend on which thread
+    // ran the tile, or on whether the frame was rendered whole or in streamed tiles
+    Random::local().seed(firstSample, uint64_t(j) * m_width + i);
+    Vector3 c(0);
+    for ( int s = 0; s < spp; ++s ) {
+        float u = ( float(i) + drand48() ) / float(m_width);
+        float v = ( float(j) + drand48() ) / float(m_height);
+        Ray r = m_camera->getRay(u, v);
+        Vector3 sample = color(r, m_world.get(), m_light.get(), 0);
+        c += sample;
+        lumSq += pow2(luminance(sample));
     }
-    return background(r.direction());
+    return c;
+}
+
+void Scene::renderPass(TileScheduler& scheduler, int firstSample, int spp, const char* label) {
+    if ( m_restir ) {
+        renderRestirPass(scheduler, firstSample, spp, label);
+        return;
+    }
+    if ( m_mlt ) {
+        renderMltPass(spp, label);
+        return;
+    }
+    if ( m_bdpt ) {
+        renderBdptPass(scheduler, firstSample, spp, label);
+        return;
+    }
+    scheduler.run([&](const Tile& tile, int thread) {
+        for ( int j = tile.y0; j < tile.y1; ++j ) {
+            for ( int i = tile.x0; i < tile.x1; ++i ) {
+                if ( !m_film->active(i, j) ) continue;
+                float lumSq = 0;
+                Vector3 c = samplePixel(i, j, firstSample, spp, lumSq);
+                m_film->add(i, j, c, lumSq, spp);
+            }
+        }
+    }, label);
+}
+
+void Scene::renderBdptPass(TileScheduler& scheduler, int firstSample, int spp, const char* label) {
+    // pixels as in renderPass(), each camera sample with its own light subpath; light
+    // tracing splats into the thread's buffer, added to the film once the pass is done
+    scheduler.run([&](const Tile& tile, int thread) {
+        std::vector<Splat> splats;
+        for ( int j = tile.y0; j < tile.y1; ++j ) {
+            for ( int i = tile.x0; i < tile.x1; ++i ) {
+                Random::local().seed(firstSample, uint64_t(j) * m_width + i);
+                Vector3 c(0);
+                float lumSq = 0;
+                for ( int s = 0; s < spp; ++s ) {
+                    float u = ( float(i) + drand48() ) / float(m_width);
+                    float v = ( float(j) + drand48() ) / float(m_height);
+                    Vector3 sample = m_bdpt->sample(m_camera->getRay(u, v), thread, splats);
+                    c += sample;
+                    lumSq += pow2(luminance(sample));
+                }
+                m_film->add(i, j, c, lumSq, spp);
+            }
+        }
+        for ( auto& s : splats ) {
+            m_splats->add(thread, s);
+        }
+    }, label);
+    m_splats->flush(*m_film);
+}
+
+void Scene::renderMltPass(int spp, const char* label) {
+    // spp mutations per pixel, landing wherever the chains take them; every pixel counts
+    // them as spp samples
+    std::cerr << label << " (Metropolis)..." << std::flush;
+    m_mlt->render((long long)spp * m_width * m_height, *m_splats);
+    m_splats->flush(*m_film);
+    for ( int j = 0; j < m_height; ++j ) {
+        for ( int i = 0; i < m_width; ++i ) {
+            m_film->add(i, j, Vector3(0), 0, spp);
+        }
+    }
+    std::cerr << " done, " << 100.0 * m_mlt->acceptance() << "% of proposals accepted" << std::endl;
+}
+
+RestirDI::Vertex Scene::primaryVertex(int i, int j) const {
+    // camera ray to the first diffuse surface, through mirrors and glass; whatever it
+    // picked up on the way (emission, background) is left in radiance
+    RestirDI::Vertex v;
+    v.throughput = Vector3(1);
+    v.radiance = Vector3(0);
+    v.depth = 0;
+    v.valid = false;
+    float u = ( float(i) + drand48() ) / float(m_width);
+    float w = ( float(j) + drand48() ) / float(m_height);
+    Ray r = m_camera->getRay(u, w);
+    for ( v.bounces = 0; v.bounces < MAX_DEPTH; ++v.bounces ) {
+        HitRec& hrec = v.hrec;
+        if ( !m_world->hit(r, 0.001f, FLT_MAX, hrec) ) {
+            v.radiance += mulPerElem(v.throughput, background(r.direction()));
+            return v;
+        }
+        v.depth += hrec.t * length(r.direction());
+        v.radiance += mulPerElem(v.throughput, hrec.mat->emitted(r, hrec));
+        if ( !hrec.mat->scatter(r, hrec, v.srec) ) {
+            return v;
+        }
+        if ( !v.srec.is_specular ) {
+            v.valid = true;
+            return v;
+        }
+        v.throughput = mulPerElem(v.throughput, v.srec.albedo);
+        r = v.srec.ray;
+    }
+    return v;
+}
+
+RestirGI::Sample Scene::secondarySample(const RestirDI::Vertex& v) const {
+    // one path on from the vertex; the emission of its first hit is direct light, which
+    // the caller accounts for separately
+    RestirGI::Sample s;
+    s.pdf = 0;
+    if ( !v.valid ) return s;
+    Ray r(v.hrec.p, v.srec.pdf->generate(v.hrec));
+    s.pdf = v.srec.pdf->value(v.hrec, r.direction());
+    if ( s.pdf <= 0 ) return s;
+    HitRec hrec;
+    if ( m_world->hit(r, 0.001f, FLT_MAX, hrec) ) {
+        s.point = hrec.p;
+        s.normal = hrec.n;
+        s.radiance = reflected(r, hrec, m_world.get(), m_light.get(), v.bounces + 1);
+        ScatterRec srec;
+        s.diffuse = !hrec.mat->scatter(r, hrec, srec) || srec.is_diffuse;
+    }
+    else {
+        Vector3 d = normalize(r.direction());
+        s.point = v.hrec.p + d * GI_SKY_DISTANCE;
+        s.normal = -d;
+        s.radiance = background(d);
+        s.diffuse = true;
+    }
+    return s;
+}
+
+void Scene::renderRestirPass(TileScheduler& scheduler, int firstSample, int spp, const char* label) {
+    // Every sample is a frame: trace first hits and resample the initial and temporal
+    // reservoirs, then merge neighbours and shade in a second pass over the whole image.
+    // Direct light at the first hit comes from the light reservoir only, so the indirect
+    // bounce from it, path traced or resampled by ReSTIR GI, skips the emission of whatever
+    // it hits next.
+    for ( int s = firstSample; s < firstSample + spp; ++s ) {
+        scheduler.run([&](const Tile& tile, int thread) {
+            for ( int j = tile.y0; j < tile.y1; ++j ) {
+                for ( int i = tile.x0; i < tile.x1; ++i ) {
+                    Random::local().seed(s, uint64_t(j) * m_width + i);
+                    RestirDI::Vertex v = primaryVertex(i, j);
+                    m_restir->resample_initial(i, j, v);
+                    if ( m_restirGI ) {
+                        m_restirGI->resample_initial(i, j, v, secondarySample(v));
+                    }
+                }
+            }
+        }, label);
+        scheduler.run([&](const Tile& tile, int thread) {
+            for ( int j = tile.y0; j < tile.y1; ++j ) {
+                for ( int i = tile.x0; i < tile.x1; ++i ) {
+                    Random::local().seed(uint64_t(s) | ( 1ull << 32 ), uint64_t(j) * m_width + i);
+                    m_restir->resample_spatial(i, j);
+                    if ( m_restirGI ) {
+                        m_restirGI->resample_spatial(i, j);
+                    }
+                    if ( !m_film->active(i, j) ) continue;
+
+                    const RestirDI::Vertex& v = m_restir->vertex(i, j);
+                    Vector3 c = v.radiance;
+                    if ( v.valid ) {
+                        c += m_restir->shade(i, j);
+                    }
+                    if ( m_restirGI ) {
+                        c += m_restirGI->shade(i, j);
+                    }
+                    else if ( v.valid ) {
+                        RestirGI::Sample gi = secondarySample(v);
+                        if ( gi.pdf > 0 ) {
+                            Ray r(v.hrec.p, gi.point - v.hrec.p);
+                            Vector3 albedo = v.srec.albedo * v.hrec.mat->scattering_pdf(r, v.hrec);
+                            c += mulPerElem(v.throughput, mulPerElem(albedo, gi.radiance)) / gi.pdf;
+                        }
+                    }
+                    m_film->add(i, j, c, pow2(luminance(c)), 1);
+                }
+            }
+        }, label);
+    }
+}
+
+void Scene::renderGBuffer(TileScheduler& scheduler) {
+    // First hits of a few jittered rays per pixel. Mirrors and glass are followed, so what
+    // they reflect or refract keeps its own edges; the depth is then the length of the path.
+    m_gbuffer = std::make_unique<GBuffer>(m_width, m_height);
+    scheduler.run([&](const Tile& tile, int thread) {
+        for ( int j = tile.y0; j < tile.y1; ++j ) {
+            for ( int i = tile.x0; i < tile.x1; ++i ) {
+                Random::local().seed(~1ull, uint64_t(j) * m_width + i);
+                Vector3 albedo(0);
+                Vector3 normal(0);
+                float depth = 0;
+                int hits = 0;
+                for ( int s = 0; s < GBUFFER_SPP; ++s ) {
+                    float u = ( float(i) + drand48() ) / float(m_width);
+                    float v = ( float(j) + drand48() ) / float(m_height);
+                    Ray r = m_camera->getRay(u, v);
+                    Vector3 throughput(1);
+                    float distance = 0;
+                    for ( int bounce = 0; bounce <= GBUFFER_SPECULAR_DEPTH; ++bounce ) {
+                        HitRec hrec;
+                        if ( !m_world->hit(r, 0.001f, FLT_MAX, hrec) ) break;
+                        distance += hrec.t * length(r.direction());
+                        ScatterRec srec;
+                        bool scattered = hrec.mat->scatter(r, hrec, srec);
+                        if ( scattered && srec.is_specular && bounce < GBUFFER_SPECULAR_DEPTH ) {
+                            throughput = mulPerElem(throughput, srec.albedo);
+                            r = srec.ray;
+                            continue;
+                        }
+                        if ( scattered ) {
+                            albedo += mulPerElem(throughput, srec.albedo);
+                        }
+                        normal += dot(hrec.n, r.direction()) > 0 ? -hrec.n : hrec.n;
+                        depth += distance;
+                        ++hits;
+                        break;
+                    }
+                }
+                m_gbuffer->write(i, ( m_height - j - 1 ), albedo / GBUFFER_SPP, normal / GBUFFER_SPP,
+                    hits > 0 ? depth / hits : 0.0f);
+            }
+        }
+    }, "G-buffer");
+}
+
+void Scene::resolveImage() {
+    m_film->resolve(*m_image);
+    if ( m_gbuffer ) {
+        auto start = std::chrono::steady_clock::now();
+        m_denoiser.run(m_image->hdr(), *m_gbuffer);
+        m_stats.denoiseSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+void Scene::renderStreamed() {
+    int size = m_streamTile;
+    if ( m_timeBudget > 0 || m_errorTarget > 0 || !m_checkpointName.empty() || ( m_hdrFormats & kHdrPfm ) ||
+        m_denoiser.settings().iterations > 0 || m_restirSettings.candidates > 0 || m_restirGISettings.enabled ||
+        m_guideSettings.enabled || m_photonSettings.enabled || m_cacheSettings.enabled || m_bidirectional ||
+        m_mltSettings.enabled ) {
+        std::cerr << "Streamed render: time budget, error target, checkpoint, PFM, denoising, ReSTIR, path guiding, "
+            "caustic photons, radiance cache, bidirectional path tracing and Metropolis sampling are ignored" << std::endl;
+    }
+
+    std::unique_ptr<ExrWriter> exr;
+    if ( m_hdrFormats & kHdrExr ) {
+        ExrWriter::Options options = m_exrOptions;
+        options.tileSize = size;
+        exr = std::make_unique<ExrWriter>(options);
+        exr->set_attribute("owner", "Raytrace_C++");
+        if ( !exr->open(outputName("", ".exr").c_str(), m_width, m_height) ) {
+            std::cerr << "Failed to open " << outputName("", ".exr") << std::endl;
+            exr.reset();
+        }
+    }
+
+    PostProcess post(m_postSettings);
+    StripWriter strips;
+    if ( !strips.open(m_filename, m_width, m_height) ) {
+        std::cerr << "Failed to open " << m_filename << std::endl;
+    }
+
+    // 8-bit rows of a tile row, held until all its tiles and all strips above it are done
+    struct Strip {
+        std::vector<unsigned char> rgb;
+        int tilesLeft;
+    };
+    int tilesPerStrip = ( m_width + size - 1 ) / size;
+    std::map<int, Strip> pending;
+    std::mutex pendingMutex;
+    std::condition_variable stripWritten;
+    std::mutex writeMutex;
+    int nextStrip = 0; // changed under pendingMutex by the thread holding writeMutex
+
+    long long totalSamples = 0;
+    int maxSpp = 0;
+    double errorSum = 0;
+    bool errorValid = true;
+
+    TileScheduler scheduler(m_width, m_height, size, 0, TileScheduler::kScanline);
+    int window = scheduler.thread_count() + 1;
+    scheduler.run_in_order([&](const Tile& tile, int thread) {
+        {
+            // backpressure: a tile more than a thread count of strips below the next one to
+            // write waits, so at most that many strips are ever held however slow a tile is
+            std::unique_lock<std::mutex> lock(pendingMutex);
+            stripWritten.wait(lock, [&] { return tile.y0 / size < nextStrip + window; });
+        }
+
+        int w = tile.x1 - tile.x0;
+        int h = tile.y1 - tile.y0;
+
+        // the same pass schedule as a full-frame render, so adaptive sampling and the pixel
+        // seeds match it; film rows run bottom-up like the camera's v axis
+        Film film(w, h);
+        int spp = 1;
+        for ( int done = 0; done < m_samples; done += spp, spp *= 2 ) {
+            spp = std::min(std::min(spp, MAX_PASS_SPP), m_samples - done);
+            for ( int y = 0; y < h; ++y ) {
+                int j = m_height - 1 - ( tile.y0 + y );
+                for ( int x = 0; x < w; ++x ) {
+                    if ( !film.active(x, h - 1 - y) ) continue;
+                    float lumSq = 0;
+                    Vector3 c = samplePixel(tile.x0 + x, j, done, spp, lumSq);
+                    film.add(x, h - 1 - y, c, lumSq, spp);
+                }
+            }
+            if ( m_adaptiveThreshold > 0 && done + spp >= m_adaptiveMinSamples &&
+                film.update_convergence(m_adaptiveThreshold, m_adaptiveMinSamples) == 0 ) {
+                break;
+            }
+        }
+
+        std::vector<float> hdr(3 * size_t(w) * h);
+        for ( int y = 0; y < h; ++y ) {
+            for ( int x = 0; x < w; ++x ) {
+                Vector3 c = film.average(x, h - 1 - y);
+                float* p = &hdr[3 * ( size_t(w) * y + x )];
+                p[0] = c.getX();
+                p[1] = c.getY();
+                p[2] = c.getZ();
+            }
+        }
+        if ( exr ) {
+            exr->write_tile(tile.x0 / size, tile.y0 / size, hdr.data(), 3 * size_t(w));
+        }
+
+        std::vector<unsigned char> rgb(3 * size_t(w) * h);
+        post.run_rows(hdr.data(), rgb.data(), w, 0, h);
+        float rmse = film.relative_rmse();
+        {
+            std::lock_guard<std::mutex> lock(pendingMutex);
+            totalSamples += film.total_samples();
+            maxSpp = std::max(maxSpp, film.max_samples());
+            errorValid = errorValid && rmse != FLT_MAX;
+            errorSum += double(rmse) * rmse * w * h;
+
+            Strip& strip = pending[tile.y0 / size];
+            if ( strip.rgb.empty() ) {
+                strip.rgb.resize(3 * size_t(m_width) * h);
+                strip.tilesLeft = tilesPerStrip;
+            }
+            for ( int y = 0; y < h; ++y ) {
+                memcpy(&strip.rgb[3 * ( size_t(m_width) * y + tile.x0 )], &rgb[3 * size_t(w) * y], 3 * size_t(w));
+            }
+            --strip.tilesLeft;
+        }
+
+        // whoever gets the writer flushes every finished strip that is next in line
+        std::lock_guard<std::mutex> writing(writeMutex);
+        for ( ;;) {
+            std::vector<unsigned char> ready;
+            {
+                std::lock_guard<std::mutex> lock(pendingMutex);
+                auto it = pending.find(nextStrip);
+                if ( it == pending.end() || it->second.tilesLeft > 0 ) break;
+                ready.swap(it->second.rgb);
+                pending.erase(it);
+            }
+            strips.write(ready.data(), int(ready.size() / ( 3 * size_t(m_width) )));
+            {
+                std::lock_guard<std::mutex> lock(pendingMutex);
+                ++nextStrip;
+            }
+            stripWritten.notify_all();
+        }
+    }, "Streaming");
+
+    if ( !strips.close() ) {
+        std::cerr << "Failed to write " << m_filename << std::endl;
+    }
+    if ( exr && !exr->close() ) {
+        std::cerr << "Failed to write " << outputName("", ".exr") << std::endl;
+    }
+
+    double pixels = double(m_width) * m_height;
+    m_stats.passes = 0;
+    m_stats.maxSpp = maxSpp;
+    m_stats.averageSpp = totalSamples / pixels;
+    m_stats.relativeRmse = errorValid ? float(sqrt(errorSum / pixels)) : FLT_MAX;
+    m_stats.encodeSeconds = 0;
+    m_stats.encodedFrames = 0;
+}
+
+void Scene::publishPreview(int pass, int spp, double seconds) {
+    // a copy into shared memory; viewers never hold the render up
+    const void* pixels = m_previewFormat == PreviewChannel::kRgbFloat
+        ? static_cast<const void*>( m_image->hdr() ) : m_image->pixels();
+    m_preview->publish(pixels, pass, spp, seconds);
+}
+
+void Scene::writeImage() {
+    // post-process here, encode and write on the encoder thread while the next pass renders
+    const unsigned char* pixels = static_cast<const unsigned char*>( m_image->pixels() );
+    std::vector<unsigned char> rgb(pixels, pixels + 3 * size_t(m_image->width()) * m_image->height());
+    m_encoder.submit(m_filename, m_image->width(), m_image->height(), std::move(rgb));
+}
+
+void Scene::writeHdr() const {
+    // the frame, then the denoiser's guide buffers
+    std::vector< std::pair<const Image*, const char*> > images(1, std::make_pair(m_image.get(), ""));
+    const GBuffer::Channel channels[] = { GBuffer::kAlbedoR, GBuffer::kNormalX, GBuffer::kDepth };
+    const char* suffixes[] = { "_albedo", "_normal", "_depth" };
+    std::unique_ptr<Image> aovs[3];
+    for ( int k = 0; k < 3 && m_gbuffer; ++k ) {
+        aovs[k] = std::make_unique<Image>(m_width, m_height);
+        m_gbuffer->resolve(channels[k], *aovs[k]);
+        images.push_back(std::make_pair(aovs[k].get(), suffixes[k]));
+    }
+
+    for ( auto& image : images ) {
+        if ( m_hdrFormats & kHdrExr ) {
+            ExrWriter exr(m_exrOptions);
+            exr.set_attribute("owner", "Raytrace_C++");
+            exr.set_attribute("spp", std::to_string(m_stats.maxSpp));
+            exr.set_attribute("passes", std::to_string(m_stats.passes));
+            exr.set_attribute("relativeRmse", std::to_string(m_stats.relativeRmse));
+            exr.set_attribute("renderSeconds", std::to_string(m_stats.seconds));
+            std::string name = outputName(image.second, ".exr");
+            if ( !image.first->write_exr(name.c_str(), exr) ) {
+                std::cerr << "Failed to write " << name << std::endl;
+            }
+        }
+        if ( m_hdrFormats & kHdrPfm ) {
+            std::string name = outputName(image.second, ".pfm");
+            if ( !image.first->write_pfm(name.c_str()) ) {
+                std::cerr << "Failed to write " << name << std::endl;
+            }
+        }
+    }
+}
+
+std::string Scene::outputName(const char* suffix, const char* extension) const {
+    // "Output/name.bmp" -> "Output/name<suffix><extension>"
+    std::string name = m_filename;
+    size_t dot = name.find_last_of('.');
+    if ( dot != std::string::npos && name.find_first_of("/\\", dot) == std::string::npos ) {
+        name.erase(dot);
+    }
+    return name + suffix + extension;
+}
+
+void Scene::reportAdaptive() const {
+    long long pixels = (long long)m_width * m_height;
+    long long total = m_film->total_samples();
+    long long uniform = pixels * m_stats.maxSpp;
+    std::cerr << "Adaptive sampling: " << total << " samples (" << m_stats.averageSpp
+        << " spp average, " << m_stats.maxSpp << " max), "
+        << 100.0 * ( uniform - total ) / uniform << "% fewer than " << m_stats.maxSpp << " spp everywhere";
+    // the fair comparison: what uniform sampling needs for the relative RMSE reached
+    long long equalError = m_film->equal_error_samples();
+    if ( equalError > 0 ) {
+        std::cerr << ", " << 100.0 * ( equalError - total ) / equalError << "% fewer than the "
+            << double(equalError) / pixels << " spp uniform sampling needs for the same error";
+    }
+    std::cerr << std::endl;
+
+    m_film->write_spp_heatmap(outputName("_spp", ".bmp").c_str(), m_stats.maxSpp);
+}
+
+void Scene::writeMetadata() const {
+    const char* mode = m_timeBudget > 0 ? ( m_errorTarget > 0 ? "time+error" : "time" )
+        : m_errorTarget > 0 ? "error" : "samples";
+    std::ofstream file(outputName("", ".json"));
+    file << "{\n"
+        << "  \"image\": \"" << m_filename << "\",\n"
+        << "  \"width\": " << m_width << ",\n"
+        << "  \"height\": " << m_height << ",\n"
+        << "  \"mode\": \"" << mode << "\",\n"
+        << "  \"stream_tile\": " << m_streamTile << ",\n"
+        << "  \"restir_candidates\": " << ( m_restir ? m_restirSettings.candidates : 0 ) << ",\n"
+        << "  \"restir_gi\": \"" << ( !m_restirGI ? "off" : m_restirGISettings.unbiased ? "unbiased" : "biased" ) << "\",\n"
+        << "  \"guide_training_spp\": " << ( m_guide ? m_guideSettings.trainingSpp : 0 ) << ",\n"
+        << "  \"environment\": \"" << ( m_environment ? m_envSettings.path : "" ) << "\",\n"
+        << "  \"caustic_photons\": " << ( m_photons ? m_photonSettings.photons : 0 ) << ",\n"
+        << "  \"radiance_cache_depth\": " << ( m_cache ? m_cacheSettings.depth : 0 ) << ",\n"
+        << "  \"integrator\": \"" << ( m_bdpt ? "bidirectional" : "path" ) << "\",\n"
+        << "  \"metropolis\": " << ( m_mlt ? "true" : "false" ) << ",\n"
+        << "  \"metropolis_acceptance\": " << ( m_mlt ? m_mlt->acceptance() : 0.0 ) << ",\n"
+        << "  \"time_budget\": " << m_timeBudget << ",\n"
+        << "  \"error_target\": " << m_errorTarget << ",\n"
+        << "  \"adaptive_threshold\": " << m_adaptiveThreshold << ",\n"
+        << "  \"passes\": " << m_stats.passes << ",\n"
+        << "  \"spp_max\": " << m_stats.maxSpp << ",\n"
+        << "  \"spp_average\": " << m_stats.averageSpp << ",\n"
+        << "  \"relative_rmse\": " << m_stats.relativeRmse << ",\n"
+        << "  \"seconds\": " << m_stats.seconds << ",\n"
+        << "  \"encode_seconds\": " << m_stats.encodeSeconds << ",\n"
+        << "  \"encoded_frames\": " << m_stats.encodedFrames << ",\n"
+        << "  \"denoise_iterations\": " << ( m_gbuffer ? m_denoiser.settings().iterations : 0 ) << ",\n"
+        << "  \"denoise_seconds\": " << m_stats.denoiseSeconds << "\n"
+        << "}\n";
+}
+
+uint64_t Scene::settingsHash() const {
+    // everything that changes which samples a resumed render would take
+    float values[] = {
+        float(m_width), float(m_height), float(m_samples),
+        m_adaptiveThreshold, float(m_adaptiveMinSamples), m_timeBudget, m_errorTarget,
+        float(MAX_PASS_SPP), float(MAX_DEPTH), float(m_lightSelection),
+        float(m_envSettings.path.size()), m_envSettings.scale, m_envSettings.rotation, m_envSettings.radius,
+        float(m_restirSettings.candidates), float(m_restirSettings.history),
+        float(m_restirSettings.neighbours), m_restirSettings.radius,
+        float(m_restirGISettings.enabled), float(m_restirGISettings.history),
+        float(m_restirGISettings.neighbours), m_restirGISettings.radius, float(m_restirGISettings.unbiased),
+        float(m_guideSettings.enabled), float(m_guideSettings.trainingSpp),
+        m_guideSettings.spatialThreshold, m_guideSettings.directionalThreshold,
+        float(m_photonSettings.enabled), float(m_photonSettings.photons), m_photonSettings.radius, m_photonSettings.alpha,
+        float(m_cacheSettings.enabled), float(m_cacheSettings.depth), float(m_cacheSettings.bits),
+        m_cacheSettings.cellPixels, float(m_cacheSettings.minSamples),
+        float(m_bidirectional),
+        float(m_mltSettings.enabled), float(m_mltSettings.bootstrap), m_mltSettings.largeStepProbability, m_mltSettings.sigma
+    };
+    uint64_t h = 14695981039346656037ull;
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>( values );
+    for ( size_t i = 0; i < sizeof(values); ++i ) {
+        h = ( h ^ bytes[i] ) * 1099511628211ull;
+    }
+    return h;
 }
 
 void Scene::render() {
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point start = Clock::now();
+    auto seconds = [](Clock::time_point from) {
+        return std::chrono::duration<double>(Clock::now() - from).count();
+    };
+
     build();
+    m_stats.denoiseSeconds = 0;
+
+    if ( m_streamTile > 0 ) {
+        renderStreamed();
+        m_stats.seconds = seconds(start);
+        std::cerr << "Rendered " << m_stats.maxSpp << " spp, relative RMSE " << m_stats.relativeRmse
+            << " in " << m_stats.seconds << " s (streamed)" << std::endl;
+        writeMetadata();
+        return;
+    }
+
+    m_image = std::make_unique<Image>(m_width, m_height);
+    m_image->post_process().set_settings(m_postSettings);
+    m_ownedFilm = std::make_unique<Film>(m_width, m_height);
+    m_film = m_ownedFilm.get();
 
-    int nx = m_image->width();
-    int ny = m_image->height();
-#pragma omp parallel for collapse(3) schedule(dynamic, 1) num_threads(NUM_THREAD)
-    for ( int j = 0; j < ny; ++j ) {
-        std::cerr << "Rendering (y = " << j << ") " << ( 100.0 * j / ( ny - 1 ) ) << "%" << std::endl;
-        for ( int i = 0; i < nx; ++i ) {
-            Vector3 c(0);
-            for ( int s = 0; s < m_samples; ++s ) {
-                float u = ( float(i) + drand48() ) / float(nx);
-                float v = ( float(j) + drand48() ) / float(ny);
+    TileScheduler scheduler(m_width, m_height, TILE_SIZE);
+    if ( m_bidirectional || m_mltSettings.enabled ) {
+        // both write to any pixel, through the splat buffer, which leaves no room for the
+        // per-pixel features
+        if ( m_restirSettings.candidates > 0 || m_restirGISettings.enabled || m_guideSettings.enabled ||
+            m_photonSettings.enabled || m_cacheSettings.enabled || m_adaptiveThreshold > 0 ) {
+            std::cerr << ( m_mltSettings.enabled ? "Metropolis sampling" : "Bidirectional path tracing" )
+                << ": ReSTIR, path guiding, caustic photons, the radiance cache and adaptive sampling are ignored" << std::endl;
+        }
+        if ( m_mltSettings.enabled && m_errorTarget > 0 ) {
+            std::cerr << "Metropolis sampling: the error target is ignored" << std::endl;
+        }
+        m_splats = std::make_unique<SplatBuffer>(m_width, m_height, scheduler.thread_count());
+        if ( m_bidirectional ) {
+            m_bdpt = std::make_unique<Bdpt>(m_world.get(), m_emitters, m_camera.get(), m_backColor, m_environment.get(),
+                MAX_DEPTH, m_width, m_height, scheduler.thread_count());
+        }
+        if ( m_mltSettings.enabled ) {
+            // a chain per render thread, each path from the camera through a point
+            // anywhere on the frame
+            m_mlt = std::make_unique<Mlt>(m_mltSettings, [this](int chain, std::vector<Splat>& splats) {
+                float u = drand48();
+                float v = drand48();
                 Ray r = m_camera->getRay(u, v);
-                c += color(r, m_world.get(), m_light.get(), 0);
+                Splat s = { std::min(int(u * m_width), m_width - 1), std::min(int(v * m_height), m_height - 1), Vector3(0) };
+                s.c = m_bdpt ? m_bdpt->sample(r, chain, splats) : color(r, m_world.get(), m_light.get(), 0);
+                splats.push_back(s);
+            }, scheduler.thread_count());
+        }
+    }
+    else if ( m_restirSettings.candidates > 0 ) {
+        m_restir = std::make_unique<RestirDI>(m_restirSettings, m_world.get(), m_emitters, m_width, m_height);
+    }
+    if ( m_restirGISettings.enabled && !m_splats ) {
+        m_restirGI = std::make_unique<RestirGI>(m_restirGISettings, m_world.get(), m_width, m_height);
+        if ( !m_restir ) {
+            // one light sample per pixel, no reuse, for the direct light GI leaves out
+            m_restir = std::make_unique<RestirDI>(RestirDI::Settings(1, 0, 0), m_world.get(), m_emitters, m_width, m_height);
+        }
+    }
+
+    if ( m_guideSettings.enabled && !m_splats ) {
+        m_guide = std::make_unique<PathGuide>(m_guideSettings);
+    }
+
+    Checkpoint::State state = { 0, 0, 1, 0.0 };
+    std::unique_ptr<Checkpoint> checkpoint;
+    bool resumed = false;
+    if ( !m_checkpointName.empty() && m_restir ) {
+        // the reservoirs and vertices reuse draws on are not in the checkpoint, so a resumed
+        // render would silently start them over
+        std::cerr << "Checkpoint: ignored with " << ( m_restirGI ? "ReSTIR GI" : "ReSTIR" )
+            << ", whose reservoirs are not checkpointed" << std::endl;
+    }
+    else if ( !m_checkpointName.empty() && m_guide ) {
+        // nor are the guide and the training film: a resumed render would train again into
+        // the restored film, then set it aside with the training samples
+        std::cerr << "Checkpoint: ignored with path guiding, whose guide is not checkpointed" << std::endl;
+    }
+    else if ( !m_checkpointName.empty() && m_mlt ) {
+        // the chains would start afresh, their burn-in landing in the restored splats
+        std::cerr << "Checkpoint: ignored with Metropolis sampling, whose chains are not checkpointed" << std::endl;
+    }
+    else if ( !m_checkpointName.empty() && m_cacheSettings.enabled && !m_splats && !m_photonSettings.enabled ) {
+        // the cache is made after the preview below, and a resumed render would fill it from
+        // the resumed passes alone
+        std::cerr << "Checkpoint: ignored with the radiance cache, which is not checkpointed" << std::endl;
+    }
+    else if ( !m_checkpointName.empty() ) {
+        checkpoint = std::make_unique<Checkpoint>();
+        resumed = checkpoint->open(m_checkpointName.c_str(), m_width, m_height, settingsHash(), state);
+        m_film = &checkpoint->film();
+        if ( resumed ) {
+            start -= std::chrono::duration_cast<Clock::duration>( std::chrono::duration<double>(state.seconds) );
+            std::cerr << "Resuming " << m_checkpointName << " at pass " << state.passes + 1
+                << " (" << state.nextSample << " spp)" << std::endl;
+        }
+    }
+    Clock::time_point lastCommit = Clock::now();
+
+    if ( !m_previewName.empty() ) {
+        m_preview = std::make_unique<PreviewChannel>();
+        if ( !m_preview->create(m_previewName.c_str(), m_width, m_height, m_previewFormat) ) {
+            std::cerr << "Failed to create preview channel " << m_previewName << std::endl;
+            m_preview.reset();
+        }
+    }
+
+    // coarse first frame within seconds, then passes of 1, 2, 4... spp
+    if ( m_snapshotEvery > 0 || m_preview ) {
+        if ( resumed ) {
+            resolveImage();
+        }
+        else {
+            renderPreview(scheduler, PREVIEW_BLOCK);
+        }
+        if ( m_preview ) {
+            publishPreview(state.passes, state.nextSample, seconds(start));
+        }
+        if ( m_snapshotEvery > 0 ) {
+            writeImage();
+        }
+    }
+
+    if ( m_denoiser.settings().iterations > 0 ) {
+        renderGBuffer(scheduler);
+    }
+
+    // after the preview, which path traces caustics as before
+    if ( m_photonSettings.enabled && !m_splats ) {
+        if ( m_restir ) {
+            std::cerr << "Caustic photons are ignored with ReSTIR" << std::endl;
+        }
+        else {
+            m_photons = std::make_unique<PhotonMap>(m_photonSettings, m_world.get(), m_emitters);
+        }
+    }
+    if ( m_cacheSettings.enabled && !m_splats ) {
+        if ( m_photons ) {
+            std::cerr << "The radiance cache is ignored with caustic photons" << std::endl;
+        }
+        else {
+            // cells sized by the angle a pixel subtends at the centre column of the frame
+            Vector3 bottom = normalize(m_camera->getRay(0.5f, 0.0f).direction());
+            Vector3 top = normalize(m_camera->getRay(0.5f, 1.0f).direction());
+            float pixelAngle = acosf(clamp(dot(bottom, top), -1.0f, 1.0f)) / m_height;
+            m_cache = std::make_unique<RadianceCache>(m_cacheSettings, m_camera->origin(), pixelAngle);
+        }
+    }
+
+    bool open = m_timeBudget > 0 || ( m_errorTarget > 0 && !m_mlt );
+    int maxSamples = open ? INT_MAX : m_samples;
+    double secondsPerSpp = 0;
+    int pass = state.passes;
+    int spp = state.nextSpp;
+    for ( int done = state.nextSample; done < maxSamples; done += spp, spp *= 2 ) {
+        spp = std::min(std::min(spp, MAX_PASS_SPP), maxSamples - done);
+        if ( m_timeBudget > 0 && secondsPerSpp > 0 ) {
+            // shrink the pass to what still fits; never start one that cannot finish
+            double remaining = m_timeBudget - seconds(start);
+            int fit = int(std::min(remaining / secondsPerSpp, double(INT_MAX)));
+            if ( fit < 1 ) {
+                break;
+            }
+            spp = std::min(spp, fit);
+        }
+
+        char label[64];
+        if ( open ) {
+            snprintf(label, sizeof(label), "Pass %d (%d spp)", pass + 1, done + spp);
+        }
+        else {
+            snprintf(label, sizeof(label), "Pass %d (%d/%d spp)", pass + 1, done + spp, m_samples);
+        }
+        Clock::time_point passStart = Clock::now();
+        if ( m_photons ) {
+            m_photons->trace(pass);
+        }
+        renderPass(scheduler, done, spp, label);
+        if ( m_guide ) {
+            bool training = m_guide->training();
+            m_guide->end_pass(spp);
+            if ( training && !m_guide->training() && done + spp < maxSamples ) {
+                m_trainingFilm = std::make_unique<Film>(m_width, m_height);
+                m_trainingFilm->copy_from(*m_film);
+                m_film->clear();
+            }
+        }
+        if ( m_cache ) {
+            m_cache->end_pass();
+        }
+        secondsPerSpp = seconds(passStart) / spp;
+
+        ++pass;
+        if ( m_adaptiveThreshold > 0 && !m_splats && done + spp >= m_adaptiveMinSamples ) {
+            int active = m_film->update_convergence(m_adaptiveThreshold, m_adaptiveMinSamples);
+            if ( active == 0 ) {
+                break;
+            }
+        }
+        if ( m_errorTarget > 0 && !m_mlt && m_film->relative_rmse() <= m_errorTarget ) {
+            break;
+        }
+        if ( checkpoint && seconds(lastCommit) >= m_checkpointInterval ) {
+            Checkpoint::State next = { pass, done + spp, spp * 2, seconds(start) };
+            checkpoint->commit(next);
+            lastCommit = Clock::now();
+        }
+        if ( done + spp < maxSamples ) {
+            bool snapshot = m_snapshotEvery > 0 && pass % m_snapshotEvery == 0;
+            if ( snapshot || m_preview ) {
+                resolveImage();
+            }
+            if ( m_preview ) {
+                publishPreview(pass, done + spp, seconds(start));
+            }
+            if ( snapshot ) {
+                writeImage();
             }
-            c /= m_samples;
-            m_image->write(i, ( ny - j - 1 ), c.getX(), c.getY(), c.getZ());
         }
     }
 
-    stbi_write_bmp(m_filename.c_str(), nx, ny, sizeof(Image::rgb), m_image->pixels());
+    long long trainingSamples = 0;
+    int trainingSpp = 0;
+    float relativeRmse = -1; // of the blended image, which the film's own estimate is not
+    if ( m_trainingFilm ) {
+        float trained = pow2(m_trainingFilm->relative_rmse());
+        float guided = pow2(m_film->relative_rmse());
+        if ( m_film->total_samples() == 0 ) {
+            // the time ran out as training ended
+            m_film->copy_from(*m_trainingFilm);
+        }
+        else if ( trained < FLT_MAX && guided < FLT_MAX && trained + guided > 0 ) {
+            // the training image and the rest weighted by the inverse of their variance, as
+            // the square of the relative error estimates each; the blend's variance is then
+            // their product over their sum
+            m_film->blend(*m_trainingFilm, guided / ( trained + guided ));
+            trainingSamples = m_trainingFilm->total_samples();
+            trainingSpp = m_trainingFilm->max_samples();
+            relativeRmse = sqrtf(trained * guided / ( trained + guided ));
+        }
+        else {
+            // a variance is unknown (pixels with fewer than two samples): every sample
+            // counts the same
+            m_film->merge(*m_trainingFilm);
+        }
+        m_trainingFilm.reset();
+    }
+
+    resolveImage();
+    writeImage();
+    if ( m_preview ) {
+        publishPreview(pass, m_film->max_samples() + trainingSpp, seconds(start));
+    }
+
+    m_stats.passes = pass;
+    m_stats.maxSpp = m_film->max_samples() + trainingSpp;
+    m_stats.averageSpp = double(m_film->total_samples() + trainingSamples) / ( double(m_width) * m_height );
+    m_stats.relativeRmse = relativeRmse >= 0 ? relativeRmse : m_film->relative_rmse();
+    m_stats.seconds = seconds(start);
+    std::cerr << "Rendered " << m_stats.passes << " passes, " << m_stats.maxSpp << " spp, relative RMSE "
+        << m_stats.relativeRmse << " in " << m_stats.seconds << " s" << std::endl;
+    if ( m_photons ) {
+        std::cerr << "Caustic photons: " << m_photons->stored() << " stored of " << m_photons->emitted()
+            << " emitted in the last pass, radius " << m_photons->radius() << std::endl;
+    }
+    if ( m_cache ) {
+        std::cerr << "Radiance cache: " << m_cache->used() << " of " << m_cache->size() << " cells used" << std::endl;
+    }
+    if ( m_mlt ) {
+        std::cerr << "Metropolis sampling: brightness " << m_mlt->brightness() << ", "
+            << 100.0 * m_mlt->acceptance() << "% of proposals accepted" << std::endl;
+    }
+    if ( m_gbuffer ) {
+        std::cerr << "Denoised with " << m_denoiser.settings().iterations << " A-Trous iterations in "
+            << m_stats.denoiseSeconds << " s" << std::endl;
+    }
+    writeHdr();
+
+    m_encoder.wait();
+    ImageEncoder::Stats encoded = m_encoder.stats();
+    m_stats.encodeSeconds = encoded.seconds;
+    m_stats.encodedFrames = encoded.frames;
+    std::cerr << "Encoded " << encoded.frames << " images (" << encoded.dropped << " superseded, "
+        << ( encoded.bytes >> 10 ) << " KiB) in " << encoded.seconds << " s on the encoder thread" << std::endl;
+    writeMetadata();
+
+    if ( m_adaptiveThreshold > 0 && !m_splats ) {
+        reportAdaptive();
+    }
+
+    if ( checkpoint ) {
+        // finished: keep the result in memory and drop the file
+        m_ownedFilm->copy_from(*m_film);
+        m_film = m_ownedFilm.get();
+        checkpoint->remove();
+    }
 }
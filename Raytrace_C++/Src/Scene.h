@@ -1,24 +1,66 @@
 #pragma once
 #include "Image.h"
+#include "Film.h"
 #include "Ray.h"
 #include "Camera.h"
 #include "Shape.h"
+#include "EnvironmentLight.h"
+#include "AssetManager.h"
+#include "ExrWriter.h"
+#include "ImageEncoder.h"
+#include "PreviewChannel.h"
+#include "ATrousDenoiser.h"
+#include "GBuffer.h"
+#include "RestirDI.h"
+#include "RestirGI.h"
+#include "PathGuide.h"
+#include "PhotonMap.h"
+#include "RadianceCache.h"
+#include "Bdpt.h"
+#include "Mlt.h"
+#include "SplatBuffer.h"
+
+class TileScheduler;
 
 class Scene {
 public:
     Scene(const char* fileName, int width, int height, int sample)
-        : m_image(std::make_unique<Image>(width, height))
+        : m_width(width)
+        , m_height(height)
+        , m_film(nullptr)
         , m_backColor(0.2f)
+        , m_filename(fileName)
         , m_samples(sample)
-        , m_filename(fileName) {}
+        , m_snapshotEvery(1)
+        , m_adaptiveThreshold(0)
+        , m_adaptiveMinSamples(16)
+        , m_timeBudget(0)
+        , m_errorTarget(0)
+        , m_checkpointInterval(60)
+        , m_hdrFormats(kHdrNone)
+        , m_streamTile(0)
+        , m_previewFormat(PreviewChannel::kRgb8)
+        , m_denoiser(ATrousDenoiser::Settings(0))
+        , m_lightSelection(kLightTree)
+        , m_restirSettings(0)
+        , m_restirGISettings(false)
+        , m_guideSettings(false)
+        , m_photonSettings(false)
+        , m_cacheSettings(false)
+        , m_bidirectional(false)
+        , m_mltSettings(false) {}
 
     void build();
 
     float hit_sphere(const Vector3& center, float radius, const Ray& r) const;
-    Vector3 color(const Ray& r, const Shape* world, const Shape* light, int depth) const;
+    // caustic: r left a diffuse surface through mirrors and glass only, so the emission it
+    // reaches is already in the caustic photon map and is left out
+    Vector3 color(const Ray& r, const Shape* world, const Shape* light, int depth, bool caustic = false) const;
+    // color() without the emission of the surface hrec was hit on
+    Vector3 reflected(const Ray& r, const HitRec& hrec, const Shape* world, const Shape* light, int depth, bool caustic = false) const;
 
     Vector3 background(const Vector3& d) const {
-        return m_backColor;
+        return m_environment ? m_environment->radiance(d) : m_backColor;
     }
 
     Vector3 backgroundSky(const Vector3& d) const {
@@ -29,16 +71,244 @@ public:
 
     void render();
 
+    // write the output file after every n-th progressive pass (0: only when finished)
+    void setSnapshotEvery(int passes) {
+        m_snapshotEvery = passes;
+    }
+
+    // Stop sampling pixels once their relative error drops below threshold (0: off).
+    // The sample count passed to the constructor becomes the per-pixel maximum.
+    void setAdaptive(float threshold, int minSamples = 16) {
+        m_adaptiveThreshold = threshold;
+        m_adaptiveMinSamples = minSamples;
+    }
+
+    // Keep rendering passes until the wall-clock budget (seconds, counted from the start of
+    // render()) would be exceeded and/or the film's relative RMSE estimate reaches target.
+    // With either set the constructor's sample count no longer limits the render; the pass
+    // in flight is always completed, and the next one is shortened to fit the budget.
+    void setTimeBudget(float seconds) {
+        m_timeBudget = seconds;
+    }
+    void setErrorTarget(float relativeRmse) {
+        m_errorTarget = relativeRmse;
+    }
+
+    // Keep the film, per-pixel sample counts and pass state in a memory-mapped file, synced
+    // at the first pass boundary after every interval seconds. A render started with the
+    // same file and settings resumes from the last sync and produces the same image as an
+    // uninterrupted one (time budgets aside). The file is deleted when the render finishes.
+    // Ignored with ReSTIR, path guiding, the radiance cache and Metropolis sampling, whose
+    // state is not in the file.
+    void setCheckpoint(const char* fileName, float intervalSeconds = 60) {
+        m_checkpointName = fileName;
+        m_checkpointInterval = intervalSeconds;
+    }
+
+    // exposure, tone curve and encoding of the 8-bit image
+    void setPostProcess(const PostProcess::Settings& settings) {
+        m_postSettings = settings;
+    }
+
+    // Besides the 8-bit image, write the final linear framebuffer as name.exr and/or name.pfm.
+    enum HdrFormat {
+        kHdrNone = 0,
+        kHdrExr = 1 << 0,
+        kHdrPfm = 1 << 1
+    };
+    void setHdrOutput(int formats, const ExrWriter::Options& exr = ExrWriter::Options()) {
+        m_hdrFormats = formats;
+        m_exrOptions = exr;
+    }
+
+    // Publish the preview and every pass to shared memory for an external viewer
+    // (see PreviewChannel for the layout). Not available in streamed mode.
+    void setPreviewChannel(const char* name, PreviewChannel::Format format = PreviewChannel::kRgb8) {
+        m_previewName = name;
+        m_previewFormat = format;
+    }
+
+    // Filter every resolved frame with the A-Trous denoiser, guided by first-hit albedo, normal
+    // and depth buffers rendered before the first pass. The buffers are written next to the
+    // HDR output as name_albedo, name_normal and name_depth. Not available in streamed mode.
+    void setDenoise(const ATrousDenoiser::Settings& settings = ATrousDenoiser::Settings()) {
+        m_denoiser.set_settings(settings);
+    }
+
+    // Direct light at the first diffuse hit by ReSTIR from the emitters registered in build()
+    // instead of by path tracing; bounces beyond it are path traced as before, or resampled
+    // by setRestirGI(). Every sample of a pass becomes one frame of reuse. The reservoirs are
+    // not checkpointed, so setCheckpoint() is ignored with it. Not available in streamed mode.
+    void setRestirDI(const RestirDI::Settings& settings = RestirDI::Settings()) {
+        m_restirSettings = settings;
+    }
+
+    // Indirect light at the first diffuse hit by ReSTIR GI: one path per pixel and sample,
+    // reused across samples and neighbours. Direct light there comes from setRestirDI(), or
+    // from one light sample when that is off. The GI reservoirs are not checkpointed, so
+    // setCheckpoint() is ignored with it. Not available in streamed mode.
+    void setRestirGI(const RestirGI::Settings& settings = RestirGI::Settings()) {
+        m_restirGISettings = settings;
+    }
+
+    // How light sampling picks an emitter: uniformly, by power from an alias table in O(1),
+    // or by estimated contribution to the shading point from the light tree in O(log N).
+    enum LightSelection {
+        kLightUniform,
+        kLightPower,
+        kLightTree
+    };
+    void setLightSelection(LightSelection selection) {
+        m_lightSelection = selection;
+    }
+
+    // Guide diffuse bounces by the incident light learned from earlier paths (see PathGuide).
+    // The first samples train the guide, in iterations that each learn from the one before.
+    // They are kept apart from the rest, and the two images are combined at the end with
+    // weights inversely proportional to their variance, so the noisier early guides cost
+    // little. Every guided bounce pays for a region lookup and several directional tree
+    // walks, which in a small scene can cost more than the noise they remove: compare at
+    // equal time before turning it on. The guide is not checkpointed, so setCheckpoint() is
+    // ignored with it. Not available in streamed mode.
+    void setPathGuiding(const PathGuide::Settings& settings = PathGuide::Settings()) {
+        m_guideSettings = settings;
+    }
+
+    // Caustics (light from the emitters through mirrors and glass onto diffuse surfaces) from
+    // a progressive photon map traced before every pass, instead of from paths that happen to
+    // hit an emitter through the glass. Not available with ReSTIR or in streamed mode.
+    void setCausticPhotons(const PhotonMap::Settings& settings = PhotonMap::Settings()) {
+        m_photonSettings = settings;
+    }
+
+    // End paths in a radiance cache (see RadianceCache) once they are depth bounces deep,
+    // learned from the paths of every pass so far; faster, but blurred and biased towards
+    // the early passes. Not available with caustic photons, bidirectional path tracing,
+    // Metropolis sampling or in streamed mode. The cache is not checkpointed, so
+    // setCheckpoint() is ignored with it.
+    void setRadianceCache(const RadianceCache::Settings& settings = RadianceCache::Settings()) {
+        m_cacheSettings = settings;
+    }
+
+    // Light the scene from an HDR environment map (see EnvironmentLight) instead of the
+    // background colour. It is loaded by the asset manager and picked for light sampling
+    // alongside the emitters, with its power taken as the light it sends through a sphere of
+    // settings.radius. ReSTIR's reservoirs and caustic photons only hold the emitters, and
+    // bidirectional path tracing only finds the environment with camera subpaths.
+    void setEnvironment(const EnvironmentLight::Settings& settings) {
+        m_envSettings = settings;
+    }
+
+    // Render passes by bidirectional path tracing (see Bdpt) instead of the path tracer. It
+    // replaces ReSTIR, path guiding and caustic photons, and light tracing reaching every
+    // pixel rules out adaptive sampling. Not available in streamed mode.
+    void setBidirectional(bool enabled = true) {
+        m_bidirectional = enabled;
+    }
+
+    // Render by Metropolis sampling (see Mlt) of the paths of the path tracer, or of the
+    // bidirectional one if that is on too, for lighting only a tiny fraction of paths find.
+    // Every pass runs spp mutations per pixel. Like bidirectional path tracing it replaces
+    // ReSTIR, path guiding, caustic photons and adaptive sampling. The chains leave the
+    // per-pixel error unknown, so an error target does not apply, and are not checkpointed,
+    // so setCheckpoint() is ignored. Not available in streamed mode.
+    void setMetropolis(const Mlt::Settings& settings = Mlt::Settings()) {
+        m_mltSettings = settings;
+    }
+
+    // Out-of-core mode for images too large for a full-frame film (posters, prints).
+    // Tiles are rendered to completion in order, written out as they finish (tiled EXR,
+    // PNG/BMP strips) and freed, so memory grows with tile size and thread count rather than
+    // image size. Snapshots, time budgets, error targets, checkpoints and PFM are full-frame
+    // features and do not apply. 0 turns it off.
+    void setStreaming(int tileSize = 64) {
+        m_streamTile = tileSize;
+    }
+
+    struct RenderStats {
+        int passes;
+        int maxSpp;
+        double averageSpp;
+        float relativeRmse;
+        double seconds;       // rendering, not counting image encoding
+        double encodeSeconds; // on the encoder thread, overlapped with rendering
+        int encodedFrames;
+        double denoiseSeconds; // all denoised frames, snapshots included
+    };
+    const RenderStats& stats() const { return m_stats; }
+
 	const char* getFilename() const {
 		return m_filename.c_str();
 	}
 
 private:
+    void renderPreview(TileScheduler& scheduler, int blockSize);
+    void renderPass(TileScheduler& scheduler, int firstSample, int spp, const char* label);
+    void renderGBuffer(TileScheduler& scheduler);
+    void renderRestirPass(TileScheduler& scheduler, int firstSample, int spp, const char* label);
+    void renderBdptPass(TileScheduler& scheduler, int firstSample, int spp, const char* label);
+    void renderMltPass(int spp, const char* label);
+    RestirDI::Vertex primaryVertex(int i, int j) const;
+    RestirGI::Sample secondarySample(const RestirDI::Vertex& v) const;
+    void resolveImage();
+    void renderStreamed();
+    Vector3 samplePixel(int i, int j, int firstSample, int spp, float& lumSq) const;
+    void writeImage();
+    void writeHdr() const;
+    void publishPreview(int pass, int spp, double seconds);
+    void reportAdaptive() const;
+    void writeMetadata() const;
+    std::string outputName(const char* suffix, const char* extension) const;
+    uint64_t settingsHash() const;
+
     std::unique_ptr<Camera> m_camera;
+    int m_width;
+    int m_height;
     std::unique_ptr<Image> m_image;
+    std::unique_ptr<Film> m_ownedFilm;
+    Film* m_film; // m_ownedFilm, or the checkpoint's mapped film while rendering with one
+    std::unique_ptr<Film> m_trainingFilm; // samples taken while the path guide trained
     Vector3 m_backColor;
+    EnvironmentLight::Settings m_envSettings;
+    std::shared_ptr<EnvironmentLight> m_environment; // also in m_light
 	std::string m_filename;
     std::unique_ptr<Shape> m_world;
     int m_samples;
+    int m_snapshotEvery;
+    float m_adaptiveThreshold;
+    int m_adaptiveMinSamples;
+    float m_timeBudget;
+    float m_errorTarget;
+    std::string m_checkpointName;
+    float m_checkpointInterval;
+    int m_hdrFormats;
+    ExrWriter::Options m_exrOptions;
+    PostProcess::Settings m_postSettings;
+    int m_streamTile;
+    std::string m_previewName;
+    PreviewChannel::Format m_previewFormat;
+    std::unique_ptr<PreviewChannel> m_preview;
+    ATrousDenoiser m_denoiser;
+    std::unique_ptr<GBuffer> m_gbuffer;
+    RenderStats m_stats;
     std::unique_ptr<Shape> m_light;
+    LightSelection m_lightSelection;
+    std::vector<ShapePtr> m_emitters; // every emissive shape in m_world
+    RestirDI::Settings m_restirSettings;
+    std::unique_ptr<RestirDI> m_restir;
+    RestirGI::Settings m_restirGISettings;
+    std::unique_ptr<RestirGI> m_restirGI;
+    PathGuide::Settings m_guideSettings;
+    std::unique_ptr<PathGuide> m_guide;
+    PhotonMap::Settings m_photonSettings;
+    std::unique_ptr<PhotonMap> m_photons;
+    RadianceCache::Settings m_cacheSettings;
+    std::unique_ptr<RadianceCache> m_cache;
+    bool m_bidirectional;
+    std::unique_ptr<Bdpt> m_bdpt;
+    Mlt::Settings m_mltSettings;
+    std::unique_ptr<Mlt> m_mlt;
+    std::unique_ptr<SplatBuffer> m_splats; // for light tracing and Metropolis sampling
+    AssetManager m_assets;
+    ImageEncoder m_encoder;
 };
@@ -0,0 +1,24 @@
+#include "Shape.h"
+
+#include "Ray.h"
+#include "HitRec.h"
+#include "Material.h"
+#include "Film.h"
+
+#define POWER_SAMPLES 8 // emission lookups averaged per shape
+
+float Shape::power() const {
+    float a = area();
+    if ( a <= 0 ) {
+        return 0;
+    }
+    Vector3 le(0);
+    for ( int k = 0; k < POWER_SAMPLES; ++k ) {
+        HitRec hrec;
+        sample_area(hrec);
+        if ( hrec.mat ) {
+            le += hrec.mat->emitted(Ray(hrec.p + hrec.n, -hrec.n), hrec);
+        }
+    }
+    return luminance(le) / POWER_SAMPLES * a * PI;
+}
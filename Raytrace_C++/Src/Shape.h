@@ -2,9 +2,22 @@
 
 class Ray;
 struct HitRec;
+struct LightBounds;
 class Shape {
 public:
     virtual bool hit(const Ray& r, float t0, float t1, HitRec& hrec) const = 0;
     virtual float pdf_value(const Vector3& o, const Vector3& v) const { return 0; }
     virtual Vector3 random(const Vector3& o) const { return Vector3(1, 0, 0); }
+
+    // surface area, and a point drawn uniformly over it with p, n, u, v and mat filled in
+    // (light sampling by area; 0 for shapes that do not support it)
+    virtual float area() const { return 0; }
+    virtual void sample_area(HitRec& hrec) const {}
+
+    // box and emission cone for the light tree, power left at 0 (false: not supported)
+    virtual bool light_bounds(LightBounds& b) const { return false; }
+
+    // emitted power, for picking lights: area * PI * the luminance of the radiance its
+    // material emits, averaged over a few sample_area() points (0 for shapes without area)
+    virtual float power() const;
 };
\ No newline at end of file
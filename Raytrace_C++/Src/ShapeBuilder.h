@@ -6,6 +6,7 @@
 #include "Translate.h"
 #include "Rotate.h"
 #include "FlipNormals.h"
+#include "TriangleMesh.h"
 
 class ShapeBuilder {
 public:
@@ -73,6 +74,11 @@ public:
         return *this;
     }
 
+    ShapeBuilder& mesh(const MeshAssetPtr& mesh, const MaterialPtr& m) {
+        m_ptr = std::make_shared<TriangleMesh>(mesh, m);
+        return *this;
+    }
+
     ShapeBuilder& flip() {
         m_ptr = std::make_shared<FlipNormals>(m_ptr);
         return *this;
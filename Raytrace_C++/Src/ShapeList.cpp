@@ -19,13 +19,20 @@ bool ShapeList::hit(const Ray& r, float t0, float t1, HitRec& hrec) const {
 float ShapeList::pdf_value(const Vector3& o, const Vector3& v) const {
     float weight = 1.0f / m_list.size();
     float sum = 0;
-    for ( auto& p : m_list ) {
-        sum += weight * p->pdf_value(o, v);
+    for ( size_t i = 0; i < m_list.size(); ++i ) {
+        if ( !m_table.empty() ) {
+            weight = m_table.pmf(int(i));
+            if ( weight <= 0 ) continue;
+        }
+        sum += weight * m_list[i]->pdf_value(o, v);
     }
     return sum;
 }
 
 Vector3 ShapeList::random(const Vector3& o) const {
+    if ( !m_table.empty() ) {
+        return m_list[m_table.sample(drand48())]->random(o);
+    }
     size_t n = m_list.size();
     size_t index = size_t(drand48() * n);
     if ( n > 0 && index >= n ) {
@@ -33,3 +40,11 @@ Vector3 ShapeList::random(const Vector3& o) const {
     }
     return m_list[index]->random(o);
 }
+
+void ShapeList::weight_by_power() {
+    std::vector<float> power;
+    for ( auto& p : m_list ) {
+        power.push_back(p->power());
+    }
+    m_table = AliasTable(power);
+}
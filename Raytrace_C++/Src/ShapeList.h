@@ -1,5 +1,6 @@
 #pragma once
 #include "Shape.h"
+#include "AliasTable.h"
 
 class ShapeList : public Shape {
 public:
@@ -15,6 +16,11 @@ public:
 
     virtual Vector3 random(const Vector3& o) const override;
 
+    // pick shapes in random() in proportion to their power() instead of uniformly;
+    // call once the list is complete
+    void weight_by_power();
+
 private:
     std::vector<ShapePtr> m_list;
+    AliasTable m_table; // empty: uniform
 };
\ No newline at end of file
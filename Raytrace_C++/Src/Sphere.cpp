@@ -2,6 +2,7 @@
 
 #include "Ray.h"
 #include "HitRec.h"
+#include "LightBounds.h"
 #include "ONB.h"
 
 bool Sphere::hit(const Ray& r, float t0, float t1, HitRec& hrec) const {
@@ -17,6 +18,7 @@ bool Sphere::hit(const Ray& r, float t0, float t1, HitRec& hrec) const {
             hrec.t = temp;
             hrec.p = r.at(hrec.t);
             hrec.n = ( hrec.p - m_center ) / m_radius;
+            hrec.wo = -normalize(r.direction());
             hrec.mat = m_material;
             get_sphere_uv(hrec.n, hrec.u, hrec.v);
             return true;
@@ -26,6 +28,7 @@ bool Sphere::hit(const Ray& r, float t0, float t1, HitRec& hrec) const {
             hrec.t = temp;
             hrec.p = r.at(hrec.t);
             hrec.n = ( hrec.p - m_center ) / m_radius;
+            hrec.wo = -normalize(r.direction());
             hrec.mat = m_material;
             get_sphere_uv(hrec.n, hrec.u, hrec.v);
             return true;
@@ -39,7 +42,13 @@ float Sphere::pdf_value(const Vector3& o, const Vector3& v) const {
     HitRec hrec;
     if ( this->hit(Ray(o, v), 0.001f, FLT_MAX, hrec) ) {
         float dd = lengthSqr(m_center - o);
-        float rr = std::min(pow2(m_radius), dd);
+        if ( dd <= pow2(m_radius) ) {
+            // inside: there is no cone to sample, so random() samples by area
+            float distance_squared = pow2(hrec.t) * lengthSqr(v);
+            float cosine = fabs(dot(v, hrec.n)) / length(v);
+            return distance_squared / ( cosine * area() );
+        }
+        float rr = pow2(m_radius);
         float cos_theta_max = sqrtf(1.0f - rr * recip(dd));
         float solid_angle = PI2 * ( 1.0f - cos_theta_max );
         return recip(solid_angle);
@@ -52,7 +61,37 @@ float Sphere::pdf_value(const Vector3& o, const Vector3& v) const {
 Vector3 Sphere::random(const Vector3& o) const {
     Vector3 direction = m_center - o;
     float distance_squared = lengthSqr(direction);
+    if ( distance_squared <= pow2(m_radius) ) {
+        HitRec hrec;
+        sample_area(hrec);
+        return hrec.p - o;
+    }
     ONB uvw; uvw.build_from_w(direction);
     Vector3 v = uvw.local(random_to_sphere(m_radius, distance_squared));
     return v;
 }
+
+float Sphere::area() const {
+    return 2.0f * PI2 * pow2(m_radius);
+}
+
+void Sphere::sample_area(HitRec& hrec) const {
+    float z = 1.0f - 2.0f * drand48();
+    float r = sqrtf(std::max(0.0f, 1.0f - z * z));
+    float phi = PI2 * drand48();
+    hrec.n = Vector3(r * cosf(phi), r * sinf(phi), z);
+    hrec.p = m_center + m_radius * hrec.n;
+    hrec.t = 0;
+    hrec.mat = m_material;
+    get_sphere_uv(hrec.n, hrec.u, hrec.v);
+}
+
+bool Sphere::light_bounds(LightBounds& b) const {
+    b.lo = m_center - Vector3(m_radius);
+    b.hi = m_center + Vector3(m_radius);
+    b.axis = Vector3::zAxis();
+    b.thetaO = PI;
+    b.thetaE = 0.5f * PI;
+    b.power = 0;
+    return true;
+}
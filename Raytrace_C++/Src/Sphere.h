@@ -15,6 +15,12 @@ public:
     virtual float pdf_value(const Vector3& o, const Vector3& v) const override;
 
     virtual Vector3 random(const Vector3& o) const override;
+
+    virtual float area() const override;
+
+    virtual void sample_area(HitRec& hrec) const override;
+
+    virtual bool light_bounds(LightBounds& b) const override;
 private:
     Vector3 m_center;
     float m_radius;
@@ -0,0 +1,23 @@
+#include "SplatBuffer.h"
+
+#include "Film.h"
+
+SplatBuffer::SplatBuffer(int width, int height, int threads)
+    : m_width(width)
+    , m_height(height)
+    , m_buffers(threads, std::vector<float>(3 * size_t(width) * height, 0.0f)) {
+}
+
+void SplatBuffer::flush(Film& film) {
+    for ( auto& buffer : m_buffers ) {
+        for ( int y = 0; y < m_height; ++y ) {
+            for ( int x = 0; x < m_width; ++x ) {
+                float* p = &buffer[3 * ( size_t(m_width) * y + x )];
+                if ( p[0] != 0 || p[1] != 0 || p[2] != 0 ) {
+                    film.add(x, y, Vector3(p[0], p[1], p[2]), 0, 0);
+                    p[0] = p[1] = p[2] = 0;
+                }
+            }
+        }
+    }
+}
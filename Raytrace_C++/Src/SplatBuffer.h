@@ -0,0 +1,36 @@
+#pragma once
+
+#include <vector>
+
+class Film;
+
+// a contribution to a pixel other than the one being sampled
+struct Splat {
+    int x;
+    int y; // film row, bottom-up like the camera's v axis
+    Vector3 c;
+};
+
+// Full-frame sums of splats, for light tracing and Metropolis sampling, which write to any
+// pixel. Every render thread adds into a buffer of its own, so threads never contend, and
+// flush() sums the buffers into the film between passes. Costs 12 bytes per pixel and thread.
+class SplatBuffer {
+public:
+    SplatBuffer(int width, int height, int threads);
+
+    void add(int thread, const Splat& s) {
+        float* p = &m_buffers[thread][3 * ( size_t(m_width) * s.y + s.x )];
+        p[0] += s.c.getX();
+        p[1] += s.c.getY();
+        p[2] += s.c.getZ();
+    }
+
+    // add the sums to the film, with no sample count, and clear them; must not overlap
+    // rendering
+    void flush(Film& film);
+
+private:
+    int m_width;
+    int m_height;
+    std::vector< std::vector<float> > m_buffers;
+};
@@ -0,0 +1,137 @@
+#include "StripWriter.h"
+
+#include "Deflate.h"
+
+#include <cstring>
+#include <iostream>
+
+namespace {
+    void put_le32(unsigned char* p, uint32_t v) {
+        p[0] = static_cast<unsigned char>( v );
+        p[1] = static_cast<unsigned char>( v >> 8 );
+        p[2] = static_cast<unsigned char>( v >> 16 );
+        p[3] = static_cast<unsigned char>( v >> 24 );
+    }
+
+    size_t bmp_stride(int width) {
+        return ( 3 * size_t(width) + 3 ) & ~size_t(3);
+    }
+
+    const size_t BMP_HEADER = 54;
+}
+
+StripWriter::StripWriter()
+    : m_format(ImageEncoder::kBmp)
+    , m_width(0)
+    , m_height(0)
+    , m_nextRow(0)
+    , m_ok(false)
+    , m_adler(1) {
+}
+
+bool StripWriter::open(const std::string& path, int width, int height) {
+    m_format = ImageEncoder::format_for(path) == ImageEncoder::kPng ? ImageEncoder::kPng : ImageEncoder::kBmp;
+    m_width = width;
+    m_height = height;
+    m_nextRow = 0;
+    m_adler = 1;
+    m_above.clear();
+    if ( m_format == ImageEncoder::kBmp && BMP_HEADER + uint64_t(bmp_stride(width)) * height > UINT32_MAX ) {
+        // the BMP header holds the file and image sizes in 32 bits
+        std::cerr << "StripWriter: " << path << " would be larger than 4 GiB, which BMP cannot hold; "
+            "write a .png instead" << std::endl;
+        return m_ok = false;
+    }
+    m_file.open(path, std::ios::binary | std::ios::trunc);
+    if ( !m_file ) return m_ok = false;
+
+    std::vector<unsigned char> header;
+    if ( m_format == ImageEncoder::kPng ) {
+        ImageEncoder::png_header(header, width, height);
+    }
+    else {
+        // bottom-up 24-bit BMP; rows are filled in as their strips arrive
+        uint64_t imageSize = uint64_t(bmp_stride(width)) * height;
+        header.assign(BMP_HEADER, 0);
+        header[0] = 'B';
+        header[1] = 'M';
+        put_le32(&header[2], uint32_t(BMP_HEADER + imageSize));
+        put_le32(&header[10], uint32_t(BMP_HEADER));
+        put_le32(&header[14], 40);
+        put_le32(&header[18], uint32_t(width));
+        put_le32(&header[22], uint32_t(height));
+        header[26] = 1;
+        header[28] = 24;
+        put_le32(&header[34], uint32_t(imageSize));
+        m_file.write(reinterpret_cast<const char*>( header.data() ), header.size());
+        m_file.seekp(std::streamoff(BMP_HEADER + imageSize - 1));
+        m_file.put(0);
+        return m_ok = bool(m_file);
+    }
+    m_file.write(reinterpret_cast<const char*>( header.data() ), header.size());
+    return m_ok = bool(m_file);
+}
+
+bool StripWriter::write(const unsigned char* rgb, int rows) {
+    if ( !m_ok || rows <= 0 || m_nextRow + rows > m_height ) return false;
+    m_ok = m_format == ImageEncoder::kPng ? write_png(rgb, rows) : write_bmp(rgb, rows);
+    m_nextRow += rows;
+    return m_ok;
+}
+
+bool StripWriter::write_png(const unsigned char* rgb, int rows) {
+    size_t rowBytes = 3 * size_t(m_width);
+    m_buffer.resize(rows * ( rowBytes + 1 ));
+    for ( int y = 0; y < rows; ++y ) {
+        const unsigned char* row = rgb + rowBytes * y;
+        const unsigned char* above = y > 0 ? row - rowBytes : ( m_above.empty() ? nullptr : m_above.data() );
+        ImageEncoder::png_filter_row(row, above, int(rowBytes), &m_buffer[y * ( rowBytes + 1 )]);
+    }
+    m_above.assign(rgb + rowBytes * ( rows - 1 ), rgb + rowBytes * rows);
+
+    bool last = m_nextRow + rows == m_height;
+    m_chunk.clear();
+    if ( m_nextRow == 0 ) {
+        m_chunk.push_back(0x78);
+        m_chunk.push_back(0x01);
+    }
+    Deflate::compress(m_buffer.data(), m_buffer.size(), last, m_chunk);
+    m_adler = Deflate::adler32_combine(m_adler, Deflate::adler32(m_buffer.data(), m_buffer.size()), m_buffer.size());
+    if ( last ) {
+        for ( int shift = 24; shift >= 0; shift -= 8 ) {
+            m_chunk.push_back(static_cast<unsigned char>( m_adler >> shift ));
+        }
+    }
+
+    std::vector<unsigned char> out;
+    ImageEncoder::png_chunk(out, "IDAT", m_chunk.data(), m_chunk.size());
+    if ( last ) {
+        ImageEncoder::png_chunk(out, "IEND", nullptr, 0);
+    }
+    m_file.write(reinterpret_cast<const char*>( out.data() ), out.size());
+    return bool(m_file);
+}
+
+bool StripWriter::write_bmp(const unsigned char* rgb, int rows) {
+    size_t stride = bmp_stride(m_width);
+    m_buffer.assign(stride, 0);
+    for ( int y = 0; y < rows; ++y ) {
+        const unsigned char* row = rgb + 3 * size_t(m_width) * y;
+        for ( int x = 0; x < m_width; ++x ) {
+            m_buffer[3 * x + 0] = row[3 * x + 2];
+            m_buffer[3 * x + 1] = row[3 * x + 1];
+            m_buffer[3 * x + 2] = row[3 * x + 0];
+        }
+        int bmpRow = m_height - 1 - ( m_nextRow + y );
+        m_file.seekp(std::streamoff(BMP_HEADER + uint64_t(stride) * bmpRow));
+        m_file.write(reinterpret_cast<const char*>( m_buffer.data() ), stride);
+    }
+    return bool(m_file);
+}
+
+bool StripWriter::close() {
+    if ( !m_file.is_open() ) return false;
+    bool complete = m_nextRow == m_height;
+    m_file.close();
+    return m_ok && complete;
+}
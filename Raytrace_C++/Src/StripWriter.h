@@ -0,0 +1,42 @@
+#pragma once
+
+#include "ImageEncoder.h"
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// Writes an 8-bit RGB image a strip of rows at a time, top to bottom, without ever holding
+// the whole frame. PNG strips become IDAT chunks of one deflate stream joined by sync
+// flushes; BMP strips are placed at their rows' offset in a file sized up front.
+class StripWriter {
+public:
+    StripWriter();
+
+    StripWriter(const StripWriter&) = delete;
+    StripWriter& operator=(const StripWriter&) = delete;
+
+    // PNG for .png, BMP otherwise. Fails for a BMP of more than 4 GiB.
+    bool open(const std::string& path, int width, int height);
+
+    // the next rows of the image, 3 bytes per pixel
+    bool write(const unsigned char* rgb, int rows);
+
+    bool close();
+
+private:
+    bool write_png(const unsigned char* rgb, int rows);
+    bool write_bmp(const unsigned char* rgb, int rows);
+
+    ImageEncoder::Format m_format;
+    std::ofstream m_file;
+    int m_width;
+    int m_height;
+    int m_nextRow;
+    bool m_ok;
+    uint32_t m_adler;
+    std::vector<unsigned char> m_above; // last row of the previous strip, for PNG filters
+    std::vector<unsigned char> m_buffer;
+    std::vector<unsigned char> m_chunk;
+};
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <queue>
+
+class ThreadPool {
+public:
+    explicit ThreadPool(int numThreads = 0) : m_stop(false) {
+        if ( numThreads <= 0 ) {
+            numThreads = std::max(1, int(std::thread::hardware_concurrency()));
+        }
+        for ( int i = 0; i < numThreads; ++i ) {
+            m_workers.emplace_back([this] { run(); });
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_cond.notify_all();
+        for ( auto& t : m_workers ) {
+            t.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    template<typename F>
+    std::future<void> enqueue(F&& f) {
+        auto task = std::make_shared< std::packaged_task<void()> >(std::forward<F>(f));
+        std::future<void> result = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_tasks.push([task] { ( *task )( ); });
+        }
+        m_cond.notify_one();
+        return result;
+    }
+
+    int size() const { return int(m_workers.size()); }
+
+private:
+    void run() {
+        for ( ;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_cond.wait(lock, [this] { return m_stop || !m_tasks.empty(); });
+                if ( m_stop && m_tasks.empty() ) {
+                    return;
+                }
+                task = std::move(m_tasks.front());
+                m_tasks.pop();
+            }
+            task();
+        }
+    }
+
+    std::vector<std::thread> m_workers;
+    std::queue< std::function<void()> > m_tasks;
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    bool m_stop;
+};
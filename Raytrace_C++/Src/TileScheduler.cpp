@@ -0,0 +1,173 @@
+#include "TileScheduler.h"
+
+#include "ThreadPool.h"
+
+#include <chrono>
+#include <iomanip>
+
+namespace {
+    // distance of (x, y) along a Hilbert curve covering an n x n grid (n is a power of two)
+    long long hilbert_index(int n, int x, int y) {
+        long long d = 0;
+        for ( int s = n / 2; s > 0; s /= 2 ) {
+            int rx = ( x & s ) > 0;
+            int ry = ( y & s ) > 0;
+            d += (long long)s * s * ( ( 3 * rx ) ^ ry );
+            if ( ry == 0 ) {
+                if ( rx == 1 ) {
+                    x = n - 1 - x;
+                    y = n - 1 - y;
+                }
+                std::swap(x, y);
+            }
+        }
+        return d;
+    }
+}
+
+TileScheduler::TileScheduler(int width, int height, int tileSize, int numThreads, TileOrder order)
+    : m_numThreads(numThreads > 0 ? numThreads : std::max(1, int(std::thread::hardware_concurrency())))
+    , m_completed(0) {
+
+    int tw = ( width + tileSize - 1 ) / tileSize;
+    int th = ( height + tileSize - 1 ) / tileSize;
+    int n = 1;
+    while ( n < tw || n < th ) n *= 2;
+
+    std::vector< std::pair<double, Tile> > keyed;
+    keyed.reserve(tw * th);
+    for ( int ty = 0; ty < th; ++ty ) {
+        for ( int tx = 0; tx < tw; ++tx ) {
+            Tile t;
+            t.x0 = tx * tileSize;
+            t.y0 = ty * tileSize;
+            t.x1 = std::min(t.x0 + tileSize, width);
+            t.y1 = std::min(t.y0 + tileSize, height);
+
+            double key;
+            switch ( order ) {
+                case kHilbert:
+                    key = double(hilbert_index(n, tx, ty));
+                    break;
+                case kSpiral: {
+                    // ring around the centre first, then angle within the ring
+                    float dx = tx + 0.5f - tw * 0.5f;
+                    float dy = ty + 0.5f - th * 0.5f;
+                    float ring = std::max(fabsf(dx), fabsf(dy));
+                    key = floorf(ring) * 8.0 + ( atan2f(dy, dx) + PI ) / PI2;
+                    break;
+                }
+                default:
+                    key = double(ty * tw + tx);
+                    break;
+            }
+            keyed.push_back(std::make_pair(key, t));
+        }
+    }
+    std::stable_sort(keyed.begin(), keyed.end(),
+        [](const std::pair<double, Tile>& a, const std::pair<double, Tile>& b) { return a.first < b.first; });
+
+    m_tiles.reserve(keyed.size());
+    for ( auto& k : keyed ) {
+        m_tiles.push_back(k.second);
+    }
+    m_queues.reset(new WorkQueue[m_numThreads]);
+    m_pool = std::make_unique<ThreadPool>(m_numThreads);
+}
+
+TileScheduler::~TileScheduler() {
+}
+
+bool TileScheduler::pop(int thread, int& tile) {
+    WorkQueue& q = m_queues[thread];
+    std::lock_guard<std::mutex> lock(q.mutex);
+    if ( q.tiles.empty() ) return false;
+    tile = q.tiles.front();
+    q.tiles.pop_front();
+    return true;
+}
+
+bool TileScheduler::steal(int thread, int& tile) {
+    // Take from the back of the longest other run: farthest from what its owner is working
+    // on. Its length may change between looking and taking, so look again if it emptied.
+    for ( ;;) {
+        int victim = -1;
+        size_t longest = 0;
+        for ( int k = 1; k < m_numThreads; ++k ) {
+            int t = ( thread + k ) % m_numThreads;
+            std::lock_guard<std::mutex> lock(m_queues[t].mutex);
+            if ( m_queues[t].tiles.size() > longest ) {
+                longest = m_queues[t].tiles.size();
+                victim = t;
+            }
+        }
+        if ( victim < 0 ) return false;
+
+        WorkQueue& q = m_queues[victim];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        if ( !q.tiles.empty() ) {
+            tile = q.tiles.back();
+            q.tiles.pop_back();
+            return true;
+        }
+    }
+}
+
+void TileScheduler::worker(int thread, const std::function<void(const Tile&, int)>& func) {
+    int tile;
+    while ( pop(thread, tile) || steal(thread, tile) ) {
+        func(m_tiles[tile], thread);
+        m_completed.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void TileScheduler::run(const std::function<void(const Tile&, int)>& func, const char* label) {
+    int total = tile_count();
+    for ( int t = 0; t < m_numThreads; ++t ) {
+        std::deque<int>& q = m_queues[t].tiles;
+        q.clear();
+        for ( int i = int(( long long )total * t / m_numThreads); i < int(( long long )total * ( t + 1 ) / m_numThreads); ++i ) {
+            q.push_back(i);
+        }
+    }
+    launch([&](int thread) { worker(thread, func); }, label);
+}
+
+void TileScheduler::run_in_order(const std::function<void(const Tile&, int)>& func, const char* label) {
+    std::atomic<int> next(0);
+    int total = tile_count();
+    launch([&](int thread) {
+        for ( int tile = next.fetch_add(1); tile < total; tile = next.fetch_add(1) ) {
+            func(m_tiles[tile], thread);
+            m_completed.fetch_add(1, std::memory_order_relaxed);
+        }
+    }, label);
+}
+
+void TileScheduler::launch(const std::function<void(int)>& worker, const char* label) {
+    int total = tile_count();
+    m_completed.store(0);
+
+    // one task per pool thread, so every thread index runs at the same time
+    std::vector< std::future<void> > tasks;
+    for ( int t = 0; t < m_numThreads; ++t ) {
+        tasks.push_back(m_pool->enqueue([&worker, t] { worker(t); }));
+    }
+
+    // progress is read from the atomic counter; only this thread touches the stream
+    std::ios::fmtflags flags = std::cerr.flags();
+    std::streamsize precision = std::cerr.precision();
+    for ( auto& task : tasks ) {
+        while ( task.wait_for(std::chrono::milliseconds(500)) != std::future_status::ready ) {
+            int done = m_completed.load(std::memory_order_relaxed);
+            std::cerr << "\r" << label << " " << std::fixed << std::setprecision(1)
+                << ( 100.0 * done / total ) << "% (" << done << "/" << total << " tiles, "
+                << m_numThreads << " threads)   " << std::flush;
+        }
+        task.get();
+    }
+    std::cerr << "\r" << label << " 100.0% (" << total << "/" << total << " tiles, "
+        << m_numThreads << " threads)   " << std::endl;
+    std::cerr.flags(flags);
+    std::cerr.precision(precision);
+}
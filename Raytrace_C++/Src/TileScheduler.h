@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+
+class ThreadPool;
+
+struct Tile {
+    int x0, y0; // inclusive
+    int x1, y1; // exclusive
+};
+
+// Splits the image into square tiles and renders them on all hardware threads.
+// Tiles are ordered along a Hilbert curve (or a spiral from the centre), each thread gets a
+// contiguous run of that order in its own deque, and idle threads steal from the far end
+// of the longest other deque so the tail of the frame stays balanced. The threads are
+// started once and kept for every run().
+class TileScheduler {
+public:
+    enum TileOrder {
+        kHilbert = 0,
+        kSpiral,
+        kScanline
+    };
+
+    TileScheduler(int width, int height, int tileSize = 32, int numThreads = 0, TileOrder order = kHilbert);
+    ~TileScheduler();
+
+    // Calls func(tile, threadIndex) once for every tile and returns when all are done.
+    // The calling thread only reports progress; it never blocks the workers.
+    void run(const std::function<void(const Tile&, int)>& func, const char* label = "Rendering");
+
+    // Like run(), but every thread takes the next tile from one shared counter, so tiles
+    // start strictly in order. How far apart they finish is not bounded: one slow tile can
+    // hold back any number of fast ones after it, so callers that stream finished tiles out
+    // in order must make func wait until they can take the tile (see Scene::renderStreamed).
+    void run_in_order(const std::function<void(const Tile&, int)>& func, const char* label = "Rendering");
+
+    int thread_count() const { return m_numThreads; }
+    int tile_count() const { return int(m_tiles.size()); }
+    const Tile& tile(int i) const { return m_tiles[i]; }
+
+private:
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<int> tiles;
+    };
+
+    bool pop(int thread, int& tile);
+    bool steal(int thread, int& tile);
+    void worker(int thread, const std::function<void(const Tile&, int)>& func);
+    void launch(const std::function<void(int)>& worker, const char* label);
+
+    int m_numThreads;
+    std::vector<Tile> m_tiles;
+    std::unique_ptr<WorkQueue[]> m_queues;
+    std::atomic<int> m_completed;
+    std::unique_ptr<ThreadPool> m_pool; // m_numThreads workers, one per task of launch()
+};
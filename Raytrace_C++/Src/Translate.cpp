@@ -2,6 +2,7 @@
 
 #include "Ray.h"
 #include "HitRec.h"
+#include "LightBounds.h"
 
 bool Translate::hit(const Ray& r, float t0, float t1, HitRec& hrec) const {
     Ray move_r(r.origin() - m_offset, r.direction());
@@ -13,3 +14,25 @@ bool Translate::hit(const Ray& r, float t0, float t1, HitRec& hrec) const {
         return false;
     }
 }
+
+float Translate::pdf_value(const Vector3& o, const Vector3& v) const {
+    return m_shape->pdf_value(o - m_offset, v);
+}
+
+Vector3 Translate::random(const Vector3& o) const {
+    return m_shape->random(o - m_offset);
+}
+
+void Translate::sample_area(HitRec& hrec) const {
+    m_shape->sample_area(hrec);
+    hrec.p += m_offset;
+}
+
+bool Translate::light_bounds(LightBounds& b) const {
+    if ( !m_shape->light_bounds(b) ) {
+        return false;
+    }
+    b.lo += m_offset;
+    b.hi += m_offset;
+    return true;
+}
@@ -0,0 +1,57 @@
+#include "TriangleMesh.h"
+
+#include "Ray.h"
+#include "HitRec.h"
+#include "Mesh.h"
+#include "LightBounds.h"
+
+bool TriangleMesh::hit(const Ray& r, float t0, float t1, HitRec& hrec) const {
+    const Mesh* mesh = m_mesh->get();
+    if ( mesh && mesh->hit(r, t0, t1, hrec) ) {
+        hrec.mat = m_material;
+        hrec.wo = -normalize(r.direction());
+        return true;
+    }
+    else {
+        return false;
+    }
+}
+
+float TriangleMesh::pdf_value(const Vector3& o, const Vector3& v) const {
+    const Mesh* mesh = m_mesh->get();
+    if ( !mesh || mesh->area() <= 0 ) return 0;
+    return mesh->area_to_solid_angle(Ray(o, v), 0.001f) / mesh->area();
+}
+
+Vector3 TriangleMesh::random(const Vector3& o) const {
+    const Mesh* mesh = m_mesh->get();
+    if ( !mesh || mesh->area() <= 0 ) return Vector3(1, 0, 0);
+    HitRec hrec;
+    mesh->sample_area(hrec);
+    return hrec.p - o;
+}
+
+float TriangleMesh::area() const {
+    const Mesh* mesh = m_mesh->get();
+    return mesh ? mesh->area() : 0;
+}
+
+void TriangleMesh::sample_area(HitRec& hrec) const {
+    const Mesh* mesh = m_mesh->get();
+    if ( !mesh ) return;
+    mesh->sample_area(hrec);
+    hrec.mat = m_material;
+}
+
+bool TriangleMesh::light_bounds(LightBounds& b) const {
+    const Mesh* mesh = m_mesh->get();
+    if ( !mesh || !mesh->bounds(b.lo, b.hi) ) {
+        return false;
+    }
+    // normals can face anywhere
+    b.axis = Vector3::zAxis();
+    b.thetaO = PI;
+    b.thetaE = 0.5f * PI;
+    b.power = 0;
+    return true;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "Shape.h"
+#include "AssetManager.h"
+
+class TriangleMesh : public Shape {
+public:
+    TriangleMesh(const MeshAssetPtr& mesh, const MaterialPtr& m)
+        : m_mesh(mesh)
+        , m_material(m) {
+    }
+
+    virtual bool hit(const Ray& r, float t0, float t1, HitRec& hrec) const override;
+
+    // sampled by area over all triangles; the mesh must have finished loading
+    virtual float pdf_value(const Vector3& o, const Vector3& v) const override;
+
+    virtual Vector3 random(const Vector3& o) const override;
+
+    virtual float area() const override;
+
+    virtual void sample_area(HitRec& hrec) const override;
+
+    virtual bool light_bounds(LightBounds& b) const override;
+
+private:
+    MeshAssetPtr m_mesh;
+    MaterialPtr m_material;
+};
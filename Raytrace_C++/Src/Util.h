@@ -1,4 +1,6 @@
 #pragma once
+#include "Random.h"
+
 #define PI 3.14159265359f
 #define PI2 6.28318530718f
 #define RECIP_PI 0.31830988618f
@@ -8,7 +10,7 @@
 #define GAMMA_FACTOR 2.2f
 
 inline float drand48() {
-    return float(( (double)( rand() ) / ( RAND_MAX ) )); /* RAND_MAX = 32767 */
+    return Random::local().next_float(); /* [0, 1), per-thread stream */
 }
 
 inline float pow2(float x) { return x * x; }
@@ -18,6 +20,8 @@ inline float pow5(float x) { return x * x * x * x * x; }
 inline float clamp(float x, float a, float b) { return x < a ? a : x > b ? b : x; }
 inline float saturate(float x) { return x < 0.f ? 0.f : x > 1.f ? 1.f : x; }
 inline float recip(float x) { return 1.f / x; }
+// MIS weight of a sample drawn with pdf a against a strategy that draws it with pdf b (power heuristic)
+inline float power_heuristic(float a, float b) { return a > 0 ? a * a / ( a * a + b * b ) : 0.f; }
 inline float mix(float a, float b, float t) { return a * ( 1.f - t ) + b * t; /* return a + (b-a) * t; */ }
 inline float step(float edge, float x) { return ( x < edge ) ? 0.f : 1.f; }
 inline float smoothstep(float a, float b, float t) { if ( a >= b ) return 0.f; float x = saturate(( t - a ) / ( b - a )); return x * x * ( 3.f - 2.f * t ); }